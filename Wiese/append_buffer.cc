@@ -0,0 +1,141 @@
+#include "append_buffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace wiese {
+
+namespace {
+
+template <typename Chunk>
+const wchar_t* FindChars(const std::vector<Chunk>& chunks,
+                         std::int64_t position) {
+  auto it = std::upper_bound(
+      chunks.begin(), chunks.end(), position,
+      [](std::int64_t position, const Chunk& chunk) {
+        return position < chunk.start;
+      });
+  assert(it != chunks.begin());
+  --it;
+  assert(position <= it->start + it->capacity);
+  return it->chars.get() + (position - it->start);
+}
+
+}  // namespace
+
+const wchar_t* AppendBuffer::View::GetChars(std::int64_t position) const {
+  assert(chunks_);
+  return FindChars(*chunks_, position);
+}
+
+AppendBuffer::AppendBuffer()
+    : chunks_(std::make_shared<const ChunkTable>()),
+      current_(-1),
+      current_size_(0),
+      current_chars_(nullptr),
+      char_count_(0) {}
+
+std::int64_t AppendBuffer::AddChunk(std::shared_ptr<const wchar_t> chars,
+                                    std::int64_t capacity, bool adopted) {
+  // Views may be reading the current table, so the new chunk goes to a copy.
+  // Chunks are large, so the copies are rare and small.
+  auto chunks = std::make_shared<ChunkTable>(*chunks_);
+  // Leave a gap of one position after the previous chunk so that the last
+  // run in it is never adjacent to the first run in the new chunk.
+  const std::int64_t start =
+      chunks->empty() ? 0 : chunks->back().start + chunks->back().capacity + 1;
+  chunks->push_back(Chunk{start, capacity, std::move(chars), adopted});
+  chunks_ = chunks;
+  return start;
+}
+
+std::int64_t AppendBuffer::Append(const wchar_t* chars, std::int64_t count) {
+  assert(count >= 0);
+  char_count_ += count;
+  if (count > kChunkSize / 2) {
+    std::shared_ptr<wchar_t[]> copy(
+        new wchar_t[static_cast<std::size_t>(count)]);
+    std::copy(chars, chars + count, copy.get());
+    return AddChunk({copy, copy.get()}, count, false);
+  }
+  if (current_ < 0 || kChunkSize - current_size_ < count) {
+    std::shared_ptr<wchar_t[]> chunk_chars(new wchar_t[kChunkSize]);
+    current_chars_ = chunk_chars.get();
+    AddChunk({chunk_chars, chunk_chars.get()}, kChunkSize, false);
+    current_ = static_cast<int>(chunks_->size()) - 1;
+    current_size_ = 0;
+  }
+  std::copy(chars, chars + count, current_chars_ + current_size_);
+  const std::int64_t position = (*chunks_)[current_].start + current_size_;
+  current_size_ += static_cast<int>(count);
+  return position;
+}
+
+std::int64_t AppendBuffer::Adopt(std::shared_ptr<const wchar_t> chars,
+                                 std::int64_t count) {
+  assert(count >= 0);
+  if (count <= kChunkSize / 2) return Append(chars.get(), count);
+  char_count_ += count;
+  return AddChunk(std::move(chars), count, true);
+}
+
+std::vector<AppendBuffer::Move> AppendBuffer::Compact(
+    const std::vector<Range>& live) {
+  // The old table stays as it is for the views reading it.
+  const std::shared_ptr<const ChunkTable> old_chunks = chunks_;
+  const int old_current = current_;
+  const std::int64_t old_current_size = current_size_;
+  chunks_ = std::make_shared<const ChunkTable>();
+  current_ = -1;
+  current_size_ = 0;
+  current_chars_ = nullptr;
+  char_count_ = 0;
+  std::vector<Move> moves;
+  auto range = live.begin();
+  for (std::size_t i = 0; i < old_chunks->size(); ++i) {
+    const Chunk& chunk = (*old_chunks)[i];
+    const std::int64_t size =
+        static_cast<int>(i) == old_current ? old_current_size : chunk.capacity;
+    const auto first = range;
+    std::int64_t live_count = 0;
+    for (; range != live.end() && range->start < chunk.start + size;
+         ++range) {
+      assert(chunk.start <= range->start && range->start < range->end);
+      assert(range->end <= chunk.start + size);
+      live_count += range->end - range->start;
+    }
+    // Copying from an adopted chunk would not free it unless all of it is
+    // dead, and would double the memory taken by what is live meanwhile.
+    if (chunk.adopted ? live_count > 0
+                      : live_count == size && size > kChunkSize / 2) {
+      moves.push_back({chunk.start, chunk.start + size,
+                       AddChunk(chunk.chars, size, chunk.adopted)});
+      char_count_ += size;
+      continue;
+    }
+    for (auto it = first; it != range; ++it) {
+      moves.push_back(
+          {it->start, it->end,
+           Append(chunk.chars.get() + (it->start - chunk.start),
+                  it->end - it->start)});
+    }
+  }
+  assert(range == live.end());
+  return moves;
+}
+
+const wchar_t* AppendBuffer::GetChars(std::int64_t position) const {
+  // Most accesses are to recently typed text.
+  if (current_ >= 0) {
+    const Chunk& chunk = (*chunks_)[current_];
+    if (chunk.start <= position && position <= chunk.start + current_size_) {
+      return chunk.chars.get() + (position - chunk.start);
+    }
+  }
+  return FindChars(*chunks_, position);
+}
+
+}  // namespace wiese
@@ -0,0 +1,117 @@
+#ifndef WIESE_APPEND_BUFFER_H_
+#define WIESE_APPEND_BUFFER_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace wiese {
+
+// Append-only storage for the characters added to a document. Characters are
+// kept in chunks which are never moved or freed, so pointers and views into
+// the buffer stay valid while more text is appended, and appending never
+// copies what is already stored. A chunk may also be memory the buffer does
+// not own, like a mapped file or a string moved in, which is then kept alive
+// by the chunk instead of being copied.
+//
+// Every appended run of characters gets a position, and a run always lies in
+// a single chunk. Runs in different chunks are never adjacent in terms of
+// positions, so pieces referring to them are never mistaken as contiguous.
+class AppendBuffer {
+ private:
+  struct Chunk {
+    // Position of the first character in the chunk.
+    std::int64_t start;
+    std::int64_t capacity;
+    // Either allocated by the buffer or adopted.
+    std::shared_ptr<const wchar_t> chars;
+    bool adopted;
+  };
+  using ChunkTable = std::vector<Chunk>;
+
+ public:
+  static constexpr int kChunkSize = 64 * 1024;
+
+  // A run of characters: [start, end).
+  struct Range {
+    std::int64_t start;
+    std::int64_t end;
+  };
+  // Tells that the run [start, end) was moved to |new_start| by Compact.
+  struct Move {
+    std::int64_t start;
+    std::int64_t end;
+    std::int64_t new_start;
+  };
+
+  // Read-only view of the characters appended so far. A view keeps the
+  // chunks alive and can be used on any thread while the buffer is being
+  // appended to: the table of chunks it refers to is never modified, adding
+  // a chunk makes a new one.
+  class View {
+   public:
+    View() = default;
+    const wchar_t* GetChars(std::int64_t position) const;
+    wchar_t operator[](std::int64_t position) const {
+      return *GetChars(position);
+    }
+
+   private:
+    friend class AppendBuffer;
+    explicit View(std::shared_ptr<const ChunkTable> chunks)
+        : chunks_(std::move(chunks)) {}
+
+    std::shared_ptr<const ChunkTable> chunks_;
+  };
+
+  AppendBuffer();
+  AppendBuffer(const AppendBuffer&) = delete;
+  AppendBuffer& operator=(const AppendBuffer&) = delete;
+
+  // Copies |count| characters to the buffer and returns the position of the
+  // first one. Runs longer than half a chunk get a chunk of their own.
+  std::int64_t Append(const wchar_t* chars, std::int64_t count);
+  // Adds the |count| characters |chars| points to without copying them and
+  // returns the position of the first one. They get a chunk of their own,
+  // which shares the ownership of them; they must never change. Runs no
+  // longer than half a chunk are copied like Append does, since a chunk of
+  // their own would cost more than the copy.
+  std::int64_t Adopt(std::shared_ptr<const wchar_t> chars, std::int64_t count);
+  // Drops every character not in |live|, which must be sorted, must not
+  // overlap, and must each lie in one chunk, as the runs of pieces do. The
+  // live runs are copied to new chunks, except for long chunks which are
+  // live as a whole and adopted chunks, which are kept without copying as
+  // long as any of them is live. Returns where the runs went, sorted by
+  // start; positions given out before are no longer valid. Views made before
+  // still see the old chunks, which are freed with them.
+  std::vector<Move> Compact(const std::vector<Range>& live);
+  // Returns the characters from |position| to the end of the run it belongs
+  // to.
+  const wchar_t* GetChars(std::int64_t position) const;
+  wchar_t operator[](std::int64_t position) const {
+    return *GetChars(position);
+  }
+  View GetView() const { return View(chunks_); }
+  // Number of characters appended and adopted (since the last Compact,
+  // counting the whole of the chunks it kept).
+  std::int64_t GetCharCount() const { return char_count_; }
+
+ private:
+  // Adds a chunk of |capacity| characters at |chars| and returns its start.
+  std::int64_t AddChunk(std::shared_ptr<const wchar_t> chars,
+                        std::int64_t capacity, bool adopted);
+
+  // Sorted by |start|. Replaced, not modified, when a chunk is added.
+  std::shared_ptr<const ChunkTable> chunks_;
+  // Index of the chunk short runs are appended to, or -1.
+  int current_;
+  // Number of characters used in the current chunk.
+  int current_size_;
+  // The characters of the current chunk, which the buffer owns.
+  wchar_t* current_chars_;
+  std::int64_t char_count_;
+};
+
+}  // namespace wiese
+
+#endif
@@ -0,0 +1,144 @@
+#include "append_buffer.h"
+
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+TEST(AppendBuffer, Append_ReturnsConsecutivePositionsInChunk) {
+  wiese::AppendBuffer buffer;
+  const int first = buffer.Append(L"abc", 3);
+  const int second = buffer.Append(L"de", 2);
+  EXPECT_EQ(first + 3, second);
+  EXPECT_EQ(L"abcde", std::wstring_view(buffer.GetChars(first), 5));
+  EXPECT_EQ(L'd', buffer[second]);
+}
+
+TEST(AppendBuffer, Append_DoesNotMoveStoredChars) {
+  wiese::AppendBuffer buffer;
+  const int position = buffer.Append(L"abc", 3);
+  const wchar_t* chars = buffer.GetChars(position);
+  const std::wstring filler(1000, L'x');
+  for (int i = 0; i < 1000; ++i) {
+    buffer.Append(filler.data(), static_cast<int>(filler.size()));
+  }
+  EXPECT_EQ(chars, buffer.GetChars(position));
+  EXPECT_EQ(L"abc", std::wstring_view(chars, 3));
+}
+
+TEST(AppendBuffer, Append_LeavesGapBetweenChunks) {
+  wiese::AppendBuffer buffer;
+  const std::wstring filler(wiese::AppendBuffer::kChunkSize, L'x');
+  const int first = buffer.Append(filler.data(), 10);
+  const int second =
+      buffer.Append(filler.data(), static_cast<int>(filler.size()) - 10);
+  EXPECT_NE(first + 10, second);
+}
+
+TEST(AppendBuffer, Append_LongRunGetsOwnChunk) {
+  wiese::AppendBuffer buffer;
+  const int first = buffer.Append(L"ab", 2);
+  const std::wstring long_run(wiese::AppendBuffer::kChunkSize * 3, L'y');
+  const int second =
+      buffer.Append(long_run.data(), static_cast<int>(long_run.size()));
+  const int third = buffer.Append(L"c", 1);
+  EXPECT_EQ(first + 2, third);
+  EXPECT_EQ(long_run,
+            std::wstring_view(buffer.GetChars(second), long_run.size()));
+  EXPECT_EQ(L"abc", std::wstring_view(buffer.GetChars(first), 3));
+}
+
+TEST(AppendBuffer, View_SeesCharsAppendedBefore) {
+  wiese::AppendBuffer buffer;
+  const int first = buffer.Append(L"abc", 3);
+  const auto view = buffer.GetView();
+  const std::wstring long_run(wiese::AppendBuffer::kChunkSize, L'y');
+  for (int i = 0; i < 10; ++i) {
+    buffer.Append(long_run.data(), static_cast<int>(long_run.size()));
+  }
+  EXPECT_EQ(L"abc", std::wstring_view(view.GetChars(first), 3));
+  EXPECT_EQ(L'b', view[first + 1]);
+}
+
+TEST(AppendBuffer, Adopt_DoesNotCopyLongRun) {
+  wiese::AppendBuffer buffer;
+  const std::int64_t first = buffer.Append(L"ab", 2);
+  auto blob = std::make_shared<const std::wstring>(
+      wiese::AppendBuffer::kChunkSize, L'y');
+  const std::int64_t second = buffer.Adopt(
+      {blob, blob->data()}, static_cast<std::int64_t>(blob->size()));
+  const std::int64_t third = buffer.Append(L"c", 1);
+  EXPECT_EQ(blob->data(), buffer.GetChars(second));
+  EXPECT_EQ(first + 2, third);
+  EXPECT_EQ(L"abc", std::wstring_view(buffer.GetChars(first), 3));
+}
+
+TEST(AppendBuffer, Adopt_KeepsCharsAlive) {
+  wiese::AppendBuffer buffer;
+  std::weak_ptr<const std::wstring> weak;
+  std::int64_t position;
+  {
+    auto blob = std::make_shared<const std::wstring>(
+        wiese::AppendBuffer::kChunkSize, L'y');
+    weak = blob;
+    position = buffer.Adopt({blob, blob->data()},
+                            static_cast<std::int64_t>(blob->size()));
+  }
+  const auto view = buffer.GetView();
+  EXPECT_FALSE(weak.expired());
+  EXPECT_EQ(L'y', view[position + 10]);
+}
+
+TEST(AppendBuffer, Adopt_CopiesShortRun) {
+  wiese::AppendBuffer buffer;
+  const std::int64_t first = buffer.Append(L"ab", 2);
+  auto blob = std::make_shared<const std::wstring>(L"cd");
+  const std::int64_t second = buffer.Adopt({blob, blob->data()}, 2);
+  EXPECT_EQ(first + 2, second);
+  EXPECT_NE(blob->data(), buffer.GetChars(second));
+  EXPECT_EQ(L"abcd", std::wstring_view(buffer.GetChars(first), 4));
+}
+
+TEST(AppendBuffer, Compact_KeepsOnlyLiveRuns) {
+  wiese::AppendBuffer buffer;
+  const std::int64_t first = buffer.Append(L"abcdef", 6);
+  auto blob = std::make_shared<const std::wstring>(
+      wiese::AppendBuffer::kChunkSize, L'y');
+  const std::int64_t second = buffer.Adopt(
+      {blob, blob->data()}, static_cast<std::int64_t>(blob->size()));
+  const auto view = buffer.GetView();
+  const auto moves = buffer.Compact(
+      {{first + 1, first + 3},
+       {first + 4, first + 5},
+       {second, second + wiese::AppendBuffer::kChunkSize}});
+  ASSERT_EQ(3u, moves.size());
+  EXPECT_EQ(L"bc", std::wstring_view(buffer.GetChars(moves[0].new_start), 2));
+  EXPECT_EQ(moves[0].new_start + 2, moves[1].new_start);
+  EXPECT_EQ(L'e', buffer[moves[1].new_start]);
+  // The adopted chunk is live as a whole, so it is not copied.
+  EXPECT_EQ(blob->data(), buffer.GetChars(moves[2].new_start));
+  EXPECT_EQ(3 + wiese::AppendBuffer::kChunkSize, buffer.GetCharCount());
+  EXPECT_EQ(L"abcdef", std::wstring_view(view.GetChars(first), 6));
+}
+
+TEST(AppendBuffer, Compact_KeepsAdoptedChunks) {
+  wiese::AppendBuffer buffer;
+  auto blob = std::make_shared<const std::wstring>(
+      wiese::AppendBuffer::kChunkSize, L'y');
+  const std::int64_t first = buffer.Adopt(
+      {blob, blob->data()}, static_cast<std::int64_t>(blob->size()));
+  auto dead_blob = std::make_shared<const std::wstring>(
+      wiese::AppendBuffer::kChunkSize, L'z');
+  buffer.Adopt({dead_blob, dead_blob->data()},
+               static_cast<std::int64_t>(dead_blob->size()));
+  const auto moves = buffer.Compact({{first + 10, first + 20}});
+  ASSERT_EQ(1u, moves.size());
+  // Only part of the chunk is live, but it is not copied.
+  const std::int64_t moved = moves[0].new_start + (first - moves[0].start);
+  EXPECT_EQ(blob->data() + 10, buffer.GetChars(moved + 10));
+  EXPECT_EQ(wiese::AppendBuffer::kChunkSize, buffer.GetCharCount());
+  // The dead one is dropped.
+  EXPECT_EQ(1, dead_blob.use_count());
+}
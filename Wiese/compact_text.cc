@@ -0,0 +1,215 @@
+#include "compact_text.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "newline_scan.h"
+#include "simd.h"
+
+namespace wiese {
+
+namespace {
+
+using WideUnit = std::make_unsigned_t<wchar_t>;
+
+// Widens |count| Latin-1 characters from |in| to |out|.
+void WidenLatin1(const std::uint8_t* in, std::size_t count, wchar_t* out) {
+  std::size_t i = 0;
+#ifdef WIESE_HAS_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= count; i += 16) {
+    const __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+    const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+    __m128i* p = reinterpret_cast<__m128i*>(out + i);
+    if constexpr (sizeof(wchar_t) == 2) {
+      _mm_storeu_si128(p, low);
+      _mm_storeu_si128(p + 1, high);
+    } else {
+      _mm_storeu_si128(p, _mm_unpacklo_epi16(low, zero));
+      _mm_storeu_si128(p + 1, _mm_unpackhi_epi16(low, zero));
+      _mm_storeu_si128(p + 2, _mm_unpacklo_epi16(high, zero));
+      _mm_storeu_si128(p + 3, _mm_unpackhi_epi16(high, zero));
+    }
+  }
+#endif
+  for (; i < count; ++i) out[i] = static_cast<wchar_t>(in[i]);
+}
+
+// Widens |count| UCS-2 characters from |in| to 32-bit wchar_t units.
+void WidenUcs2(const std::uint16_t* in, std::size_t count, wchar_t* out) {
+  std::size_t i = 0;
+#ifdef WIESE_HAS_SSE2
+  if constexpr (sizeof(wchar_t) == 4) {
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8) {
+      const __m128i units =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+      __m128i* p = reinterpret_cast<__m128i*>(out + i);
+      _mm_storeu_si128(p, _mm_unpacklo_epi16(units, zero));
+      _mm_storeu_si128(p + 1, _mm_unpackhi_epi16(units, zero));
+    }
+  }
+#endif
+  for (; i < count; ++i) out[i] = static_cast<wchar_t>(in[i]);
+}
+
+std::size_t AlignUp(std::size_t offset, std::size_t alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+CompactText::CompactText(std::wstring_view text)
+    : size_(static_cast<std::int64_t>(text.size())), storage_size_(0) {
+  // The encodings are chosen first, so that the storage is allocated once
+  // and no larger than needed.
+  const std::size_t block_count = (text.size() + kBlockSize - 1) / kBlockSize;
+  blocks_.resize(block_count);
+  for (std::size_t i = 0; i < block_count; ++i) {
+    Block& block = blocks_[i];
+    block.encoding = ChooseEncoding(text.substr(i * kBlockSize, kBlockSize));
+    const std::size_t width = WidthOf(block.encoding);
+    block.offset = AlignUp(storage_size_, width);
+    storage_size_ = block.offset +
+                    width * std::min<std::size_t>(text.size() - i * kBlockSize,
+                                                  kBlockSize);
+  }
+  storage_ = std::make_unique<wchar_t[]>(
+      AlignUp(storage_size_, sizeof(wchar_t)) / sizeof(wchar_t));
+  std::uint8_t* const bytes = reinterpret_cast<std::uint8_t*>(storage_.get());
+  for (std::size_t i = 0; i < block_count; ++i) {
+    const std::wstring_view chars = text.substr(i * kBlockSize, kBlockSize);
+    std::uint8_t* const out = bytes + blocks_[i].offset;
+    switch (blocks_[i].encoding) {
+      case Encoding::kLatin1:
+        std::transform(chars.begin(), chars.end(), out, [](wchar_t ch) {
+          return static_cast<std::uint8_t>(ch);
+        });
+        break;
+      case Encoding::kUcs2:
+        std::transform(chars.begin(), chars.end(),
+                       reinterpret_cast<std::uint16_t*>(out), [](wchar_t ch) {
+                         return static_cast<std::uint16_t>(ch);
+                       });
+        break;
+      case Encoding::kWide:
+        std::memcpy(out, chars.data(), chars.size() * sizeof(wchar_t));
+        break;
+    }
+  }
+}
+
+CompactText::Encoding CompactText::ChooseEncoding(std::wstring_view chars) {
+  // The characters are or'ed together instead of compared one by one, which
+  // compilers turn into vector code.
+  WideUnit bits = 0;
+  for (wchar_t ch : chars) bits |= static_cast<WideUnit>(ch);
+  if (bits < 0x100) return Encoding::kLatin1;
+  if (sizeof(wchar_t) == 4 && bits < 0x10000) return Encoding::kUcs2;
+  return Encoding::kWide;
+}
+
+std::size_t CompactText::WidthOf(Encoding encoding) {
+  switch (encoding) {
+    case Encoding::kLatin1:
+      return 1;
+    case Encoding::kUcs2:
+      return 2;
+    case Encoding::kWide:
+      return sizeof(wchar_t);
+  }
+  return sizeof(wchar_t);
+}
+
+wchar_t CompactText::GetChar(std::int64_t position) const {
+  assert(0 <= position && position < size_);
+  const Block& block = blocks_[static_cast<std::size_t>(position / kBlockSize)];
+  const std::uint8_t* const p =
+      reinterpret_cast<const std::uint8_t*>(storage_.get()) + block.offset;
+  const int index = static_cast<int>(position % kBlockSize);
+  switch (block.encoding) {
+    case Encoding::kLatin1:
+      return static_cast<wchar_t>(p[index]);
+    case Encoding::kUcs2:
+      return static_cast<wchar_t>(
+          reinterpret_cast<const std::uint16_t*>(p)[index]);
+    case Encoding::kWide:
+      break;
+  }
+  return reinterpret_cast<const wchar_t*>(p)[index];
+}
+
+std::wstring_view CompactText::GetChars(std::int64_t start, int count,
+                                        wchar_t* buffer) const {
+  assert(0 <= start && 0 <= count && start + count <= size_);
+  if (count == 0) return {};
+  assert(start / kBlockSize == (start + count - 1) / kBlockSize);
+  const Block& block = blocks_[static_cast<std::size_t>(start / kBlockSize)];
+  const std::uint8_t* const p =
+      reinterpret_cast<const std::uint8_t*>(storage_.get()) + block.offset;
+  const int index = static_cast<int>(start % kBlockSize);
+  switch (block.encoding) {
+    case Encoding::kLatin1:
+      WidenLatin1(p + index, count, buffer);
+      break;
+    case Encoding::kUcs2:
+      WidenUcs2(reinterpret_cast<const std::uint16_t*>(p) + index, count,
+                buffer);
+      break;
+    case Encoding::kWide:
+      return {reinterpret_cast<const wchar_t*>(p) + index,
+              static_cast<std::size_t>(count)};
+  }
+  return {buffer, static_cast<std::size_t>(count)};
+}
+
+std::vector<Piece> CompactText::SplitIntoLines() const {
+  std::vector<Piece> pieces;
+  std::unique_ptr<wchar_t[]> buffer = std::make_unique<wchar_t[]>(kBlockSize);
+  // Start of the text not split yet. It is past the start of a block if a
+  // CRLF ends the block before.
+  std::int64_t start = 0;
+  for (std::int64_t block_start = 0; block_start < size_;
+       block_start += kBlockSize) {
+    const std::int64_t block_end = std::min(block_start + kBlockSize, size_);
+    const std::wstring_view chars = GetChars(
+        block_start, static_cast<int>(block_end - block_start), buffer.get());
+    const wchar_t* const last = chars.data() + chars.size();
+    while (start < block_end) {
+      const wchar_t* const line_end =
+          FindLineEnd(chars.data() + (start - block_start), last);
+      const std::int64_t end = block_start + (line_end - chars.data());
+      if (end == block_end) break;
+      LineEnding ending = GetLineEndingAt(line_end, last);
+      if (ending == LineEnding::kCr && end + 1 == block_end &&
+          block_end < size_ && GetChar(block_end) == L'\n') {
+        ending = LineEnding::kCrLf;
+      }
+      pieces.push_back(Piece::MakeOriginal(start, end));
+      pieces.push_back(Piece::MakeLineBreak(ending));
+      start = end + static_cast<std::int64_t>(
+                        GetLineEndingChars(ending).size());
+    }
+    if (block_end - start > 0) {
+      pieces.push_back(Piece::MakeOriginal(start, block_end));
+      start = block_end;
+    }
+  }
+  return pieces;
+}
+
+std::size_t CompactText::GetMemoryUsage() const {
+  return AlignUp(storage_size_, sizeof(wchar_t)) +
+         blocks_.capacity() * sizeof(Block);
+}
+
+}  // namespace wiese
@@ -0,0 +1,75 @@
+#ifndef WIESE_COMPACT_TEXT_H_
+#define WIESE_COMPACT_TEXT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "piece_tree.h"
+
+namespace wiese {
+
+// How a document keeps its original text.
+enum class TextStorage {
+  // wchar_t units as they are, read in place.
+  kWide,
+  // A CompactText, which needs a half or a quarter of the memory for text
+  // which is mostly Latin-1, such as source code and logs.
+  kCompact,
+};
+
+// Read-only text stored in blocks of kBlockSize characters, each in the
+// narrowest fixed-width encoding its characters fit into: one byte per
+// character if they are all Latin-1 (ASCII included), two bytes if they are
+// all in the BMP and wchar_t is 32 bits, and wchar_t units otherwise. Since
+// the width is fixed within a block, a position is found in O(1), and
+// positions and line counts are the same as those of the wide text.
+//
+// Characters are decoded on demand a block or less at a time; wide blocks
+// are read in place.
+class CompactText {
+ public:
+  static constexpr int kBlockSize = 4096;
+
+  explicit CompactText(std::wstring_view text);
+  CompactText(const CompactText&) = delete;
+  CompactText& operator=(const CompactText&) = delete;
+
+  std::int64_t size() const { return size_; }
+  wchar_t GetChar(std::int64_t position) const;
+  // Returns the characters in [start, start + count), which must lie within
+  // one block. They are decoded into |buffer|, which must have room for
+  // |count| characters, unless they can be read in place.
+  std::wstring_view GetChars(std::int64_t start, int count,
+                             wchar_t* buffer) const;
+  // Returns the pieces of the whole text, with a line break piece for every
+  // line ending, like SplitIntoLines. Original pieces are also split at block
+  // boundaries, so that every one of them can be passed to GetChars; a CRLF
+  // may span two blocks.
+  std::vector<Piece> SplitIntoLines() const;
+  // Bytes allocated for the text and the block table.
+  std::size_t GetMemoryUsage() const;
+
+ private:
+  enum class Encoding : std::uint8_t { kLatin1, kUcs2, kWide };
+  struct Block {
+    Encoding encoding;
+    // Offset of the first character in |bytes_|.
+    std::size_t offset;
+  };
+
+  static Encoding ChooseEncoding(std::wstring_view chars);
+  static std::size_t WidthOf(Encoding encoding);
+
+  std::int64_t size_;
+  std::vector<Block> blocks_;
+  // Storage of all the blocks, wide ones aligned for wchar_t.
+  std::unique_ptr<wchar_t[]> storage_;
+  std::size_t storage_size_;
+};
+
+}  // namespace wiese
+
+#endif
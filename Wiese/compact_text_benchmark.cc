@@ -0,0 +1,109 @@
+// Benchmarks for the compact storage of the original text. They are disabled
+// by default; run them with --gtest_also_run_disabled_tests
+// --gtest_filter=*Benchmark*.
+
+#include "compact_text.h"
+
+#include "gtest/gtest.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "document.h"
+#include "literal_search.h"
+
+namespace {
+
+constexpr std::size_t kInputBytes = std::size_t{1} << 28;
+constexpr int kLineLength = 80;
+// Every this many lines one is in Japanese, which makes its block wide.
+constexpr int kLinesPerWideLine = 1000;
+// Does not occur in the text, so every search reads all of it.
+constexpr const wchar_t* kPattern = L"wiese";
+
+// Writes a file of kInputBytes of mostly ASCII lines once and returns its
+// path.
+const std::filesystem::path& GetPath() {
+  static const std::filesystem::path path = [] {
+    std::wstring text(kInputBytes / sizeof(wchar_t), L'x');
+    int line = 0;
+    for (std::size_t i = kLineLength; i < text.size(); i += kLineLength + 1) {
+      text[i] = L'\n';
+      if (++line % kLinesPerWideLine == 0) {
+        std::fill_n(text.begin() + i + 1,
+                    std::min<std::size_t>(kLineLength, text.size() - i - 1),
+                    L'\u3042');
+      }
+    }
+    auto path = std::filesystem::temp_directory_path() / "wiese_compact.txt";
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(text.data()),
+               text.size() * sizeof(wchar_t));
+    return path;
+  }();
+  return path;
+}
+
+// Returns the memory of the process which is in RAM, mapped files included.
+std::size_t GetResidentBytes() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+  return counters.WorkingSetSize;
+#else
+  std::size_t total_pages = 0;
+  std::size_t resident_pages = 0;
+  std::ifstream("/proc/self/statm") >> total_pages >> resident_pages;
+  return resident_pages * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+// Loads the file with |storage| and reports the memory it takes once all of
+// the text has been read, and the speed of searching all of it.
+void Measure(const char* name, wiese::TextStorage storage) {
+  const std::filesystem::path& path = GetPath();
+  const std::size_t resident_before = GetResidentBytes();
+  const auto load_start = std::chrono::steady_clock::now();
+  wiese::Document document(path, storage);
+  const std::chrono::duration<double> load_time =
+      std::chrono::steady_clock::now() - load_start;
+  auto snapshot = document.Snapshot();
+  wiese::LiteralSearcher searcher(kPattern, false);
+  const auto scan_start = std::chrono::steady_clock::now();
+  const int result = searcher.FindForward(snapshot, 0);
+  const std::chrono::duration<double> scan_time =
+      std::chrono::steady_clock::now() - scan_start;
+  const double megabytes =
+      static_cast<double>(GetResidentBytes() - resident_before) / (1 << 20);
+  const double gigabytes_per_second =
+      kInputBytes / scan_time.count() / (1 << 30);
+  std::cout << name << ": load " << load_time.count() << " s, " << megabytes
+            << " MB resident, scan " << gigabytes_per_second << " GB/s ("
+            << result << ")" << std::endl;
+  ::testing::Test::RecordProperty(
+      (std::string(name) + " MB").c_str(), std::to_string(megabytes));
+  ::testing::Test::RecordProperty((std::string(name) + " GB/s").c_str(),
+                                  std::to_string(gigabytes_per_second));
+}
+
+}  // namespace
+
+TEST(CompactTextBenchmark, DISABLED_Wide) {
+  Measure("TextStorage::kWide", wiese::TextStorage::kWide);
+}
+
+TEST(CompactTextBenchmark, DISABLED_Compact) {
+  Measure("TextStorage::kCompact", wiese::TextStorage::kCompact);
+}
@@ -0,0 +1,108 @@
+#include "compact_text.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int kBlockSize = wiese::CompactText::kBlockSize;
+
+// Returns a text of |block_count| blocks, each drawn from one of Latin-1,
+// the BMP and, where wchar_t is 32 bits, the whole of Unicode, with line
+// breaks in between.
+std::wstring MakeMixedText(int block_count, unsigned seed) {
+  std::mt19937 random(seed);
+  const wchar_t kHighest[] = {0x7F, 0xFF, 0xFFFF,
+                              sizeof(wchar_t) == 4 ? 0x10FFFF : 0xFFFF};
+  std::wstring text;
+  for (int i = 0; i < block_count; ++i) {
+    const wchar_t highest = kHighest[i % 4];
+    for (int j = 0; j < kBlockSize; ++j) {
+      text += random() % 10 == 0
+                  ? L'\n'
+                  : static_cast<wchar_t>(1 + random() % highest);
+    }
+  }
+  // Ends in the middle of a block.
+  text.resize(text.size() - kBlockSize / 3);
+  return text;
+}
+
+}  // namespace
+
+TEST(CompactText, Empty) {
+  wiese::CompactText text(L"");
+  EXPECT_EQ(0, text.size());
+  EXPECT_TRUE(text.SplitIntoLines().empty());
+}
+
+TEST(CompactText, GetChar) {
+  const std::wstring expected = MakeMixedText(8, 1);
+  wiese::CompactText text(expected);
+  ASSERT_EQ(static_cast<int>(expected.size()), text.size());
+  for (int i = 0; i < text.size(); ++i) {
+    ASSERT_EQ(expected[i], text.GetChar(i)) << i;
+  }
+}
+
+TEST(CompactText, GetChars) {
+  const std::wstring expected = MakeMixedText(8, 2);
+  wiese::CompactText text(expected);
+  std::vector<wchar_t> buffer(kBlockSize);
+  std::mt19937 random(3);
+  for (int i = 0; i < 1000; ++i) {
+    const std::int64_t start = random() % text.size();
+    const std::int64_t block_end =
+        std::min((start / kBlockSize + 1) * kBlockSize, text.size());
+    const int count = random() % (block_end - start + 1);
+    EXPECT_EQ(expected.substr(start, count),
+              text.GetChars(start, count, buffer.data()));
+  }
+}
+
+TEST(CompactText, SplitIntoLines) {
+  const std::wstring expected = MakeMixedText(8, 4);
+  wiese::CompactText text(expected);
+  std::vector<wchar_t> buffer(kBlockSize);
+  std::wstring actual;
+  for (const wiese::Piece& piece : text.SplitIntoLines()) {
+    if (piece.IsLineBreak()) {
+      actual += wiese::GetLineEndingChars(piece.line_ending());
+      continue;
+    }
+    ASSERT_TRUE(piece.IsOriginal());
+    // Every piece lies within a block.
+    if (piece.GetCharCount() > 0) {
+      EXPECT_EQ(piece.start() / kBlockSize, (piece.end() - 1) / kBlockSize);
+    }
+    const std::wstring_view chars =
+        text.GetChars(piece.start(), piece.GetCharCount(), buffer.data());
+    EXPECT_EQ(std::wstring_view::npos, chars.find_first_of(L"\r\n"));
+    actual += chars;
+  }
+  EXPECT_EQ(expected, actual);
+}
+
+TEST(CompactText, SplitIntoLines_CRLFBetweenBlocks) {
+  std::wstring chars(2 * kBlockSize, L'x');
+  chars[kBlockSize - 1] = L'\r';
+  chars[kBlockSize] = L'\n';
+  wiese::CompactText text(chars);
+  const std::vector<wiese::Piece> expected = {
+      wiese::Piece::MakeOriginal(0, kBlockSize - 1),
+      wiese::Piece::MakeLineBreak(wiese::LineEnding::kCrLf),
+      wiese::Piece::MakeOriginal(kBlockSize + 1, 2 * kBlockSize)};
+  EXPECT_EQ(expected, text.SplitIntoLines());
+}
+
+TEST(CompactText, NarrowsLatin1) {
+  const std::wstring latin1(10 * kBlockSize, L'\xE9');
+  wiese::CompactText text(latin1);
+  EXPECT_LT(text.GetMemoryUsage(), latin1.size() * sizeof(wchar_t) / 2 + 512);
+  EXPECT_EQ(L'\xE9', text.GetChar(5 * kBlockSize));
+}
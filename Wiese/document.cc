@@ -2,15 +2,22 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <cstring>
+#include <filesystem>
 #include <initializer_list>
 #include <iostream>
 #include <iterator>
+#include <memory>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <utility>
 #include <vector>
 
+#include "mapped_file.h"
+#include "newline_scan.h"
+
 namespace {
 
 template <typename T>
@@ -35,50 +42,133 @@ void Dump(T t, Args... args) {
 
 namespace wiese {
 
-Piece Piece::MakeOriginal(int start, int end) {
-  assert(start <= end);
-  Piece piece(Kind::kOriginal);
-  piece.start_ = start;
-  piece.end_ = end;
-  return piece;
+namespace {
+
+constexpr wchar_t kByteOrderMark = 0xfeff;
+
+// Returns |piece| of the added buffer where Compact moved it to.
+Piece MovePiece(const Piece& piece,
+                const std::vector<AppendBuffer::Move>& moves) {
+  auto it = std::upper_bound(moves.begin(), moves.end(), piece.start(),
+                             [](std::int64_t position,
+                                const AppendBuffer::Move& move) {
+                               return position < move.start;
+                             });
+  assert(it != moves.begin());
+  --it;
+  assert(piece.end() <= it->end);
+  const std::int64_t start = it->new_start + (piece.start() - it->start);
+  return Piece::MakePlain(start, start + piece.GetCharCount());
 }
 
-Piece Piece::MakePlain(int start, int end) {
-  assert(start <= end);
-  Piece piece(Kind::kPlain);
-  piece.start_ = start;
-  piece.end_ = end;
-  return piece;
-}
-
-Piece Piece::MakeLineBreak() { return Piece(Kind::kLineBreak); }
-
-Document::Document(const wchar_t* original_text)
-    : original_(original_text, original_text + std::wcslen(original_text)) {
-  int start = 0;
-  for (int i = 0; i < static_cast<int>(original_.size()); ++i) {
-    if (original_[i] == L'\n') {
-      pieces_.push_back(Piece::MakeOriginal(start, i));
-      pieces_.push_back(Piece::MakeLineBreak());
-      ++i;
-      start = i;
-    }
+// Pieces of a compact original text must lie within a block (see
+// GetCharsInPiece), so they are merged only within one.
+bool CanMerge(const Piece& piece, const Piece& next, bool compact_original) {
+  if (!piece.IsFollowedBy(next)) return false;
+  return !piece.IsOriginal() || !compact_original ||
+         piece.start() / CompactText::kBlockSize ==
+             (next.end() - 1) / CompactText::kBlockSize;
+}
+
+// Returns the change covering all of |changes|, which are as
+// DocumentObserver::OnDocumentChanged describes.
+DocumentChange CoverChanges(const std::vector<DocumentChange>& changes) {
+  std::int64_t char_delta = 0;
+  for (const DocumentChange& change : changes) {
+    char_delta += change.new_end - change.old_end;
+  }
+  return {changes.front().start, changes.back().old_end,
+          changes.back().old_end + char_delta};
+}
+
+// Returns the changes which undo |changes|.
+std::vector<DocumentChange> InvertChanges(
+    std::vector<DocumentChange> changes) {
+  std::int64_t char_delta = 0;
+  for (DocumentChange& change : changes) {
+    const std::int64_t start = change.start + char_delta;
+    char_delta += change.new_end - change.old_end;
+    change = {start, start + (change.new_end - change.start),
+              start + (change.old_end - change.start)};
   }
-  if (original_.size() - start > 0) {
-    pieces_.push_back(Piece::MakeOriginal(start, original_.size()));
+  return changes;
+}
+
+// Returns |changes|, which turn |old_count| characters into |new_count|, or
+// a change of the whole text if they do not add up. The steps of the undo
+// history only differ by the changes recorded, except if text appended from
+// a file made a CRLF with a CR ending one of them and not the other.
+std::vector<DocumentChange> CheckChanges(std::vector<DocumentChange> changes,
+                                         std::int64_t old_count,
+                                         std::int64_t new_count) {
+  const DocumentChange cover = CoverChanges(changes);
+  if (new_count - old_count != cover.new_end - cover.old_end) {
+    return {{0, old_count, new_count}};
   }
+  return changes;
 }
 
-Piece Document::AddCharsToBuffer(const wchar_t* chars, int count) {
-  int start = added_.size();
-  std::copy(chars, chars + count, std::back_inserter(added_));
+std::int64_t CountChars(const std::vector<Piece>& pieces) {
+  std::int64_t count = 0;
+  for (const Piece& piece : pieces) count += piece.GetCharCount();
+  return count;
+}
+
+}  // namespace
+
+Document::Document(const wchar_t* original_text, TextStorage storage)
+    : original_file_size_(0), original_mapped_(false), finger_{-1, 0, 0} {
+  std::vector<Piece> pieces;
+  if (storage == TextStorage::kCompact) {
+    compact_original_ = std::make_shared<const CompactText>(original_text);
+    pieces = compact_original_->SplitIntoLines();
+  } else {
+    auto text = std::make_shared<const std::wstring>(original_text);
+    original_ = *text;
+    original_owner_ = std::move(text);
+    pieces = SplitIntoLines(original_, 0);
+  }
+  line_ending_ = FindDominantLineEnding(pieces);
+  pieces_ = PieceList(pieces);
+  PublishSnapshot();
+}
+
+Document::Document(const std::filesystem::path& path, TextStorage storage)
+    : original_file_size_(0), original_mapped_(false), finger_{-1, 0, 0} {
+  auto file = std::make_shared<const MappedFile>(path);
+  original_file_size_ = file->size();
+  std::wstring_view text = {static_cast<const wchar_t*>(file->data()),
+                            file->size() / sizeof(wchar_t)};
+  const bool has_bom = !text.empty() && text[0] == kByteOrderMark;
+  std::vector<Piece> pieces;
+  if (storage == TextStorage::kCompact) {
+    // The mapping is dropped with |file| once the text is converted.
+    if (has_bom) text.remove_prefix(1);
+    compact_original_ = std::make_shared<const CompactText>(text);
+    pieces = compact_original_->SplitIntoLines();
+  } else {
+    original_ = text;
+    original_owner_ = std::move(file);
+    original_mapped_ = true;
+    pieces = SplitIntoLines(original_, has_bom ? 1 : 0);
+  }
+  line_ending_ = FindDominantLineEnding(pieces);
+  pieces_ = PieceList(pieces);
+  PublishSnapshot();
+}
+
+Piece Document::AddCharsToBuffer(const wchar_t* chars, std::int64_t count) {
+  const std::int64_t start = added_.Append(chars, count);
   return Piece::MakePlain(start, start + count);
 }
 
-wchar_t Document::GetCharInPiece(const Piece& piece, int index) const {
+wchar_t Document::GetCharInPiece(const Piece& piece, std::int64_t index) const {
   assert(index < piece.GetCharCount());
   if (piece.IsOriginal()) {
-    return original_[piece.start() + index];
+    if (compact_original_) {
+      return compact_original_->GetChar(piece.start() + index);
+    }
+    return original_[static_cast<std::size_t>(piece.start() + index)];
   } else if (piece.IsPlain()) {
     return added_[piece.start() + index];
   } else if (piece.IsLineBreak()) {
@@ -90,10 +180,17 @@ wchar_t Document::GetCharInPiece(const Piece& piece, int index) const {
 
 std::wstring_view Document::GetCharsInPiece(const Piece& piece) const {
   if (piece.IsOriginal()) {
+    if (compact_original_) {
+      decoded_.resize(CompactText::kBlockSize);
+      // Compact pieces lie within a block.
+      return compact_original_->GetChars(
+          piece.start(), static_cast<int>(piece.GetCharCount()),
+          decoded_.data());
+    }
     return {original_.data() + piece.start(),
             static_cast<std::size_t>(piece.GetCharCount())};
   } else if (piece.IsPlain()) {
-    return {added_.data() + piece.start(),
+    return {added_.GetChars(piece.start()),
             static_cast<std::size_t>(piece.GetCharCount())};
   } else if (piece.IsLineBreak()) {
     static const wchar_t kLF = L'\n';
@@ -104,12 +201,8 @@ std::wstring_view Document::GetCharsInPiece(const Piece& piece) const {
 }
 
 std::wstring_view Document::GetVisualCharsInPiece(const Piece& piece) const {
-  if (piece.IsOriginal()) {
-    return {original_.data() + piece.start(),
-            static_cast<std::size_t>(piece.GetCharCount())};
-  } else if (piece.IsPlain()) {
-    return {added_.data() + piece.start(),
-            static_cast<std::size_t>(piece.GetCharCount())};
+  if (piece.IsOriginal() || piece.IsPlain()) {
+    return GetCharsInPiece(piece);
   } else if (piece.IsLineBreak()) {
     static const wchar_t kSpace = L' ';
     return {&kSpace, 1};
@@ -118,298 +211,538 @@ std::wstring_view Document::GetVisualCharsInPiece(const Piece& piece) const {
   return {};
 }
 
-void Document::InsertCharsBefore(const wchar_t* chars, int count,
-                                 int position) {
+void Document::InsertCharsBefore(const wchar_t* chars, std::int64_t count,
+                                 std::int64_t position) {
   assert(0 <= position);
   assert(position <= GetCharCount());
-  if (position == 0) {
-    pieces_.push_front(AddCharsToBuffer(chars, count));
-    return;
-  }
-  int offset = 0;
-  for (auto it = pieces_.begin(); it != pieces_.end(); ++it) {
-    int piece_size = it->GetCharCount();
-    if (offset + piece_size == position) {
-      // Specified position is in between of two pieces.
-      // Now consider whether we can just elongate the previous piece.
-      if (it->IsPlain() && it->end() == static_cast<int>(added_.size())) {
-        std::copy(chars, chars + count, std::back_inserter(added_));
-        it->set_end(it->end() + count);
-        return;
-      }
-      // Insert a new piece at current position.
-      pieces_.insert(++it, AddCharsToBuffer(chars, count));
-      return;
-    }
-    if (position < offset + piece_size) {
-      // Specified position is in the middle of a piece.
-      // Split it and insert a new piece.
-      Piece rest = it->SplitAt(position - offset);
-      pieces_.insert(++it, AddCharsToBuffer(chars, count));
-      pieces_.insert(it, rest);
-      return;
-    }
-    offset += piece_size;
-  }
-  UNREACHABLE;
+  PushUndoStep();
+  const std::int64_t line_break_count = pieces_.GetLineBreakCount();
+  pieces_.Insert(position, AddCharsToBuffer(chars, count));
+  DidEdit({{position, position, position + count}}, line_break_count);
 }
 
-void Document::InsertCharsBefore(const wchar_t* chars, int count, int line,
-                                 int column) {
+void Document::InsertCharsBefore(const wchar_t* chars, std::int64_t count,
+                                 std::int64_t line, std::int64_t column) {
   assert(line >= 0);
   assert(column >= 0);
   assert(line < GetLineCount());
-  if (line == 0 && column == 0) {
-    pieces_.push_front(AddCharsToBuffer(chars, count));
-    return;
-  }
-
-  int offset = 0;
-  for (auto it = FindLineInternal(line); it != pieces_.end(); ++it) {
-    int piece_size = it->GetCharCount();
-    if (offset + piece_size == column) {
-      // Specified position is in between of two pieces.
-      // Now consider whether we can just elongate the previous piece.
-      if (it->IsPlain() && it->end() == static_cast<int>(added_.size())) {
-        std::copy(chars, chars + count, std::back_inserter(added_));
-        it->set_end(it->end() + count);
-        return;
-      }
-      // Insert a new piece at current position.
-      pieces_.insert(++it, AddCharsToBuffer(chars, count));
-      return;
-    }
-    if (column < offset + piece_size) {
-      // Specified position is in the middle of a piece.
-      // Split it and insert a new piece.
-      Piece rest = it->SplitAt(column - offset);
-      pieces_.insert(++it, AddCharsToBuffer(chars, count));
-      pieces_.insert(it, rest);
-      return;
-    }
-    offset += piece_size;
-  }
-  UNREACHABLE;
+  InsertCharsBefore(chars, count, ToOffset(line, column));
 }
 
-void Document::InsertCharBefore(wchar_t ch, int position) {
+void Document::InsertCharBefore(wchar_t ch, std::int64_t position) {
   TRACE(ch, position);
   InsertCharsBefore(&ch, 1, position);
 }
 
-void Document::InsertCharBefore(wchar_t ch, int line, int column) {
+void Document::InsertCharBefore(wchar_t ch, std::int64_t line,
+                                std::int64_t column) {
   TRACE(ch, line, column);
   InsertCharsBefore(&ch, 1, line, column);
 }
 
-void Document::InsertStringBefore(const wchar_t* string, int position) {
+void Document::InsertStringBefore(const wchar_t* string,
+                                  std::int64_t position) {
   TRACE(string, position);
-  InsertCharsBefore(string, std::wcslen(string), position);
+  assert(0 <= position);
+  assert(position <= GetCharCount());
+  const std::wstring_view chars(string);
+  if (chars.empty()) return;
+  InsertPiecesBefore(AddStringToBuffer(chars), position);
 }
 
-void Document::InsertLineBreakBefore(int position) {
-  TRACE(position);
-  assert(position >= 0);
+void Document::InsertStringBefore(std::wstring&& string,
+                                  std::int64_t position) {
+  TRACE(string.size(), position);
+  auto owner = std::make_shared<const std::wstring>(std::move(string));
+  const std::wstring_view chars = *owner;
+  InsertSharedStringBefore(std::move(owner), chars, position);
+}
+
+void Document::InsertSharedStringBefore(std::shared_ptr<const void> owner,
+                                        std::wstring_view string,
+                                        std::int64_t position) {
+  TRACE(string.size(), position);
+  assert(0 <= position);
   assert(position <= GetCharCount());
-  if (position == 0) {
-    pieces_.push_front(Piece::MakeLineBreak());
-    return;
+  if (string.empty()) return;
+  InsertPiecesBefore(AdoptStringToBuffer(std::move(owner), string),
+                     position);
+}
+
+void Document::InsertFileBefore(const std::filesystem::path& path,
+                                std::int64_t position) {
+  TRACE(path, position);
+  assert(0 <= position);
+  assert(position <= GetCharCount());
+  auto file = std::make_shared<const MappedFile>(path);
+  std::wstring_view text = {static_cast<const wchar_t*>(file->data()),
+                            file->size() / sizeof(wchar_t)};
+  if (!text.empty() && text[0] == kByteOrderMark) text.remove_prefix(1);
+  if (text.empty()) return;
+  const std::int64_t start = added_.Adopt(
+      {std::move(file), text.data()}, static_cast<std::int64_t>(text.size()));
+  InsertPiecesBefore(SplitAddedFileText(text, start), position);
+}
+
+void Document::InsertPiecesBefore(const std::vector<Piece>& pieces,
+                                  std::int64_t position) {
+  const std::int64_t count = CountChars(pieces);
+  PushUndoStep();
+  const std::int64_t line_break_count = pieces_.GetLineBreakCount();
+  if (pieces.size() == 1) {
+    pieces_.Insert(position, pieces.front());
+  } else {
+    pieces_.Insert(position, pieces);
   }
-  int offset = 0;
-  for (auto it = pieces_.begin(); it != pieces_.end(); ++it) {
-    int piece_size = it->GetCharCount();
-    if (offset + piece_size == position) {
-      pieces_.insert(++it, Piece::MakeLineBreak());
-      return;
-    }
-    if (position < offset + piece_size) {
-      Piece rest = it->SplitAt(position - offset);
-      pieces_.insert(++it, Piece::MakeLineBreak());
-      pieces_.insert(it, rest);
-      return;
+  DidEdit({{position, position, position + count}}, line_break_count);
+}
+
+std::vector<Piece> Document::AddStringToBuffer(std::wstring_view string) {
+  if (string.empty()) return {};
+  // The whole string is copied into the buffer at once, line breaks
+  // included, so that every line can refer to it by offset.
+  return SplitAddedString(
+      string,
+      added_.Append(string.data(), static_cast<std::int64_t>(string.size())));
+}
+
+std::vector<Piece> Document::AdoptStringToBuffer(
+    std::shared_ptr<const void> owner, std::wstring_view string) {
+  if (string.empty()) return {};
+  return SplitAddedString(
+      string, added_.Adopt({std::move(owner), string.data()},
+                           static_cast<std::int64_t>(string.size())));
+}
+
+std::vector<Piece> Document::SplitAddedString(std::wstring_view string,
+                                              std::int64_t start) const {
+  std::vector<Piece> pieces;
+  const wchar_t* const begin = string.data();
+  const wchar_t* const last = begin + string.size();
+  for (const wchar_t* first = begin;;) {
+    const wchar_t* line_end = FindLineEnd(first, last);
+    if (first != line_end) {
+      Piece::AppendPlain(start + (first - begin), start + (line_end - begin),
+                         pieces);
     }
-    offset += piece_size;
+    if (line_end == last) break;
+    // Whatever the ending, the line break gets the one of the document.
+    pieces.push_back(Piece::MakeLineBreak(line_ending_));
+    first = line_end + (GetLineEndingAt(line_end, last) == LineEnding::kCrLf
+                            ? 2
+                            : 1);
   }
-  UNREACHABLE;
+  return pieces;
+}
+
+void Document::InsertLineBreakBefore(std::int64_t position) {
+  TRACE(position);
+  assert(position >= 0);
+  assert(position <= GetCharCount());
+  PushUndoStep();
+  const std::int64_t line_break_count = pieces_.GetLineBreakCount();
+  pieces_.Insert(position, Piece::MakeLineBreak(line_ending_));
+  DidEdit({{position, position, position + 1}}, line_break_count);
 }
 
-void Document::InsertLineBreakBefore(int line, int column) {
+void Document::InsertLineBreakBefore(std::int64_t line, std::int64_t column) {
   TRACE(line, column);
   assert(line >= 0);
   assert(column >= 0);
   assert(line < GetLineCount());
-  if (line == 0 && column == 0) {
-    pieces_.push_front(Piece::MakeLineBreak());
-    return;
+  InsertLineBreakBefore(ToOffset(line, column));
+}
+
+wchar_t Document::EraseCharAt(std::int64_t position) {
+  TRACE(position);
+  assert(0 <= position);
+  assert(position < GetCharCount());
+  wchar_t ch = GetCharAt(position);
+  PushUndoStep();
+  const std::int64_t line_break_count = pieces_.GetLineBreakCount();
+  pieces_.Erase(position, position + 1);
+  DidEdit({{position, position + 1, position}}, line_break_count);
+  return ch;
+}
+
+wchar_t Document::EraseCharAt(std::int64_t line, std::int64_t column) {
+  TRACE(line, column);
+  assert(0 <= line);
+  assert(0 <= column);
+  return EraseCharAt(ToOffset(line, column));
+}
+
+void Document::EraseCharsInRange(std::int64_t start, std::int64_t end) {
+  TRACE(start, end);
+  assert(0 <= start);
+  assert(start <= end);
+  assert(end <= GetCharCount());
+  if (start == end) return;
+  PushUndoStep();
+  const std::int64_t line_break_count = pieces_.GetLineBreakCount();
+  pieces_.Erase(start, end);
+  DidEdit({{start, end, start}}, line_break_count);
+}
+
+void Document::EraseCharsInRange(std::int64_t line_start,
+                                 std::int64_t column_start,
+                                 std::int64_t line_end,
+                                 std::int64_t column_end) {
+  TRACE(line_start, column_start, line_end, column_end);
+  assert(0 <= line_start);
+  assert(0 <= column_start);
+  assert(0 <= line_end);
+  assert(0 <= column_end);
+  assert(line_start <= line_end);
+  EraseCharsInRange(ToOffset(line_start, column_start),
+                    ToOffset(line_end, column_end));
+}
+
+void Document::AppendFileText(std::wstring_view text) {
+  if (text.empty()) return;
+  const std::int64_t start =
+      added_.Append(text.data(), static_cast<std::int64_t>(text.size()));
+  const std::vector<Piece> lines = SplitAddedFileText(text, start);
+  const std::int64_t old_end = GetCharCount();
+  const std::int64_t line_break_count = pieces_.GetLineBreakCount();
+  // The text is in the file whatever is undone, so it is added to the undo
+  // and redo steps as well instead of being a step of its own.
+  const std::int64_t position =
+      AppendFileLines(lines, text, pieces_, unit_index_);
+  for (UndoStep& step : undo_stack_) {
+    AppendFileLines(lines, text, step.pieces, step.unit_index);
   }
+  for (UndoStep& step : redo_stack_) {
+    AppendFileLines(lines, text, step.pieces, step.unit_index);
+  }
+  DidChange({{position, old_end, GetCharCount()}}, line_break_count);
+}
 
-  int offset = 0;
-  for (auto it = FindLineInternal(line); it != pieces_.end(); ++it) {
-    int piece_size = it->GetCharCount();
-    if (offset + piece_size == column) {
-      pieces_.insert(++it, Piece::MakeLineBreak());
-      return;
+std::int64_t Document::AppendFileLines(const std::vector<Piece>& lines,
+                                       std::wstring_view text,
+                                       PieceList& pieces,
+                                       std::optional<UnitIndex>& unit_index)
+    const {
+  std::int64_t position = pieces.GetCharCount();
+  std::vector<Piece> added = lines;
+  // A CRLF split between the text read before and |text| is one line break.
+  if (position > 0 && added.front().IsLineBreak() &&
+      added.front().line_ending() == LineEnding::kLf) {
+    const Piece& last = *std::prev(pieces.end());
+    if (last.IsLineBreak() && last.line_ending() == LineEnding::kCr) {
+      --position;
+      added.front() = Piece::MakeLineBreak(LineEnding::kCrLf);
+      text.remove_prefix(1);
     }
-    if (column < offset + piece_size) {
-      Piece rest = it->SplitAt(column - offset);
-      pieces_.insert(++it, Piece::MakeLineBreak());
-      pieces_.insert(it, rest);
-      return;
+  }
+  const std::int64_t old_end = pieces.GetCharCount();
+  if (unit_index) {
+    // A high surrogate ending the text before may now start a pair, so the
+    // last character is scanned again along with |text|.
+    const std::int64_t scan_start = std::max<std::int64_t>(old_end - 1, 0);
+    UnitIndex::Builder builder;
+    if (scan_start < old_end) {
+      const auto last = pieces.FindPosition(scan_start);
+      const wchar_t ch = GetCharInPiece(*last, scan_start - last.offset());
+      builder.Add({&ch, 1});
     }
-    offset += piece_size;
+    builder.Add(text);
+    unit_index->Replace({{scan_start, old_end, builder.Finish()}});
   }
-  UNREACHABLE;
+  pieces.Replace({{position, old_end, std::move(added)}});
+  return position;
 }
 
-wchar_t Document::EraseCharInFrontOf(PieceList::iterator it) {
-  if (it->GetCharCount() == 1) {
-    wchar_t ch = GetCharInPiece(*it, 0);
-    pieces_.erase(it);
-    return ch;
+void Document::ReleaseOriginalFile() {
+  if (!original_mapped_) return;
+  auto text = std::make_shared<const std::wstring>(original_);
+  original_ = *text;
+  original_owner_ = std::move(text);
+  original_mapped_ = false;
+  // The published snapshot would keep the mapping.
+  PublishSnapshot();
+}
+
+std::vector<Piece> Document::SplitAddedFileText(std::wstring_view text,
+                                                std::int64_t start) {
+  // The lines are split like the original text, and refer to the buffer.
+  std::vector<Piece> pieces;
+  for (const Piece& piece : SplitIntoLines(text, 0)) {
+    if (piece.IsLineBreak()) {
+      pieces.push_back(piece);
+    } else if (piece.GetCharCount() > 0) {
+      pieces.push_back(
+          Piece::MakePlain(start + piece.start(), start + piece.end()));
+    }
   }
-  wchar_t ch = GetCharInPiece(*it, 0);
-  it->set_start(it->start() + 1);
-  return ch;
+  return pieces;
 }
 
-wchar_t Document::EraseCharAt(int position) {
-  TRACE(position);
-  assert(0 <= position);
-  assert(position < GetCharCount());
-  if (position == 0) {
-    return EraseCharInFrontOf(pieces_.begin());
+std::int64_t Document::GetInsertedCharCount(std::wstring_view string) {
+  auto count = static_cast<std::int64_t>(string.size());
+  for (std::size_t i = string.find(L"\r\n"); i != std::wstring_view::npos;
+       i = string.find(L"\r\n", i + 2)) {
+    --count;
   }
+  return count;
+}
 
-  int pos = 0;
-  for (auto it = pieces_.begin(); it != pieces_.end(); ++it) {
-    int piece_size = it->GetCharCount();
-    if (position == pos + piece_size) {
-      return EraseCharInFrontOf(++it);
-    }
-    if (position == pos + piece_size - 1) {
-      assert(it->GetCharCount() > 1);
-      wchar_t ch = GetCharInPiece(*it, it->GetCharCount() - 1);
-      it->set_end(it->end() - 1);
-      return ch;
-    }
-    if (position < pos + piece_size - 1) {
-      Piece rest = it->SplitAt(position - pos);
-      assert(rest.GetCharCount() > 1);
-      wchar_t ch = GetCharInPiece(rest, 0);
-      rest.set_start(rest.start() + 1);
-      pieces_.insert(++it, rest);
-      return ch;
+void Document::ApplyEdits(std::vector<Edit> edits) {
+  edits.erase(std::remove_if(edits.begin(), edits.end(),
+                             [](const Edit& edit) {
+                               return edit.start == edit.end &&
+                                      edit.text.empty();
+                             }),
+              edits.end());
+  if (edits.empty()) return;
+  std::stable_sort(
+      edits.begin(), edits.end(),
+      [](const Edit& lhs, const Edit& rhs) { return lhs.start < rhs.start; });
+  assert(0 <= edits.front().start);
+  assert(edits.back().end <= GetCharCount());
+  std::vector<PieceList::Replacement> replacements;
+  replacements.reserve(edits.size());
+  std::vector<DocumentChange> changes;
+  changes.reserve(edits.size());
+  for (Edit& edit : edits) {
+    assert(edit.start <= edit.end);
+    assert(replacements.empty() || replacements.back().end <= edit.start);
+    // The buffer copies short texts anyway (see AppendBuffer::Adopt), so
+    // only long ones are worth moving to the heap.
+    std::vector<Piece> pieces;
+    if (edit.text.size() > AppendBuffer::kChunkSize / 2) {
+      auto text = std::make_shared<const std::wstring>(std::move(edit.text));
+      const std::wstring_view chars = *text;
+      pieces = AdoptStringToBuffer(std::move(text), chars);
+    } else {
+      pieces = AddStringToBuffer(edit.text);
     }
-    pos += piece_size;
+    replacements.push_back({edit.start, edit.end, std::move(pieces)});
+    changes.push_back({edit.start, edit.end,
+                       edit.start + CountChars(replacements.back().pieces)});
   }
-  UNREACHABLE;
-  return 0;
+  PushUndoStep();
+  const std::int64_t line_break_count = pieces_.GetLineBreakCount();
+  pieces_.Replace(replacements);
+  DidEdit(std::move(changes), line_break_count);
 }
 
-wchar_t Document::EraseCharAt(int line, int column) {
-  TRACE(line, column);
-  assert(0 <= line);
-  assert(0 <= column);
-  if (line == 0 && column == 0) {
-    return EraseCharInFrontOf(pieces_.begin());
+void Document::AddObserver(DocumentObserver* observer) {
+  observers_.push_back(observer);
+}
+
+void Document::RemoveObserver(DocumentObserver* observer) {
+  observers_.erase(std::remove(observers_.begin(), observers_.end(), observer),
+                   observers_.end());
+}
+
+void Document::DidChange(const std::vector<DocumentChange>& changes,
+                         std::int64_t old_line_break_count) {
+  UpdateFinger(CoverChanges(changes), old_line_break_count);
+  PublishSnapshot();
+  for (DocumentObserver* observer : observers_) {
+    observer->OnDocumentChanged(*this, changes);
   }
+}
+
+void Document::DidEdit(std::vector<DocumentChange> changes,
+                       std::int64_t old_line_break_count) {
+  UpdateUnitIndex(changes);
+  undo_stack_.back().changes = changes;
+  DidChange(changes, old_line_break_count);
+}
 
-  auto it = FindLineInternal(line);
-  if (column == 0) {
-    return EraseCharInFrontOf(it);
+const UnitIndex& Document::unit_index() const {
+  if (!unit_index_) unit_index_.emplace(ScanUnits(0, GetCharCount()));
+  return *unit_index_;
+}
+
+std::vector<Piece> Document::ScanUnits(std::int64_t start,
+                                       std::int64_t end) const {
+  UnitIndex::Builder builder;
+  for (auto it = pieces_.FindPosition(start); it.offset() < end; ++it) {
+    std::wstring_view chars = GetCharsInPiece(*it);
+    const std::int64_t chars_start =
+        std::max<std::int64_t>(start - it.offset(), 0);
+    chars = chars.substr(static_cast<std::size_t>(chars_start),
+                         static_cast<std::size_t>(end - it.offset() -
+                                                  chars_start));
+    builder.Add(chars);
   }
-  int offset = 0;
-  for (; it != pieces_.end(); ++it) {
-    offset += it->GetCharCount();
-    if (offset == column) {
-      return EraseCharInFrontOf(++it);
-    }
-    if (offset - 1 == column) {
-      assert(it->GetCharCount() > 1);
-      wchar_t ch = GetCharInPiece(*it, it->GetCharCount() - 1);
-      it->set_end(it->end() - 1);
-      return ch;
-    }
-    if (offset - 1 > column) {
-      Piece rest = it->SplitAt(column);
-      assert(rest.GetCharCount() > 1);
-      wchar_t ch = GetCharInPiece(rest, 0);
-      rest.set_start(rest.start() + 1);
-      pieces_.insert(++it, rest);
-      return ch;
+  return builder.Finish(end < GetCharCount() ? GetCharAt(end) : 0);
+}
+
+void Document::UpdateUnitIndex(const std::vector<DocumentChange>& changes) {
+  if (!unit_index_) return;
+  // Whether a character takes two UTF-16 units may depend on the one after
+  // it (a high surrogate), so the character in front of every edited range
+  // is scanned again as well. Ranges which then overlap are scanned as one.
+  struct Window {
+    std::int64_t old_start;
+    std::int64_t old_end;
+    std::int64_t new_start;
+    std::int64_t new_end;
+  };
+  std::vector<Window> windows;
+  std::int64_t char_delta = 0;
+  for (const DocumentChange& change : changes) {
+    const std::int64_t old_start =
+        std::max<std::int64_t>(change.start - 1, 0);
+    const std::int64_t new_end = change.new_end + char_delta;
+    if (!windows.empty() && old_start < windows.back().old_end) {
+      windows.back().old_end = change.old_end;
+      windows.back().new_end = new_end;
+    } else {
+      windows.push_back(
+          {old_start, change.old_end, old_start + char_delta, new_end});
     }
+    char_delta += (change.new_end - change.start) -
+                  (change.old_end - change.start);
   }
-  UNREACHABLE;
-  return 0;
+  std::vector<PieceList::Replacement> replacements;
+  replacements.reserve(windows.size());
+  for (const Window& window : windows) {
+    replacements.push_back({window.old_start, window.old_end,
+                            ScanUnits(window.new_start, window.new_end)});
+  }
+  unit_index_->Replace(replacements);
 }
 
-void Document::EraseCharsInRangeSingleLine(int line, int start, int end) {
-  // FIXME: O(N^2) iteration here.
-  for (int i = 0; i < end - start; ++i) {
-    EraseCharAt(line, start);
-  }
+void Document::PushUndoStep() {
+  undo_stack_.push_back({pieces_, unit_index_, {}});
+  redo_stack_.clear();
 }
 
-void Document::EraseCharsInRangeMultipleLines(int line_start, int column_start,
-                                          int line_end, int column_end) {
-  auto it = FindLineInternal(line_start);
-  int line = line_start;
-  int offset = 0;
-  bool first_piece_erased = false;
-  while (it != pieces_.end()) {
-    if (!first_piece_erased) {
-      assert(line == line_start);
-      const int count = it->GetCharCount();
-      if (offset + count < column_start) {
-        offset += count;
-        ++it;
-        continue;
-      }
-      // first piece found
-      if (offset == column_start) {
-        it = pieces_.erase(it);
-      } else {
-        const int num_chars_to_erase = offset + count - column_start;
-        it->set_end(it->end() - num_chars_to_erase);
-        ++it;
-      }
-      first_piece_erased = true;
-      offset = 0;
-    } else if (line == line_end) {
-      const int count = it->GetCharCount();
-      if (offset + count < column_end) {
-        offset += count;
-        ++it;
-        continue;
-      }
-      // last piece found
-      if (offset != column_end) {
-        const int num_chars_to_erase = column_end - offset;
-        it->set_start(it->start() + num_chars_to_erase);
-      }
-      return;
+void Document::Undo() {
+  assert(CanUndo());
+  const std::int64_t char_count = GetCharCount();
+  const std::int64_t line_break_count = pieces_.GetLineBreakCount();
+  UndoStep& step = undo_stack_.back();
+  redo_stack_.push_back(
+      {std::move(pieces_), std::move(unit_index_), step.changes});
+  pieces_ = std::move(step.pieces);
+  unit_index_ = std::move(step.unit_index);
+  std::vector<DocumentChange> changes =
+      InvertChanges(std::move(step.changes));
+  undo_stack_.pop_back();
+  DidChange(CheckChanges(std::move(changes), char_count, GetCharCount()),
+            line_break_count);
+}
+
+void Document::Redo() {
+  assert(CanRedo());
+  const std::int64_t char_count = GetCharCount();
+  const std::int64_t line_break_count = pieces_.GetLineBreakCount();
+  UndoStep& step = redo_stack_.back();
+  undo_stack_.push_back(
+      {std::move(pieces_), std::move(unit_index_), step.changes});
+  pieces_ = std::move(step.pieces);
+  unit_index_ = std::move(step.unit_index);
+  std::vector<DocumentChange> changes = std::move(step.changes);
+  redo_stack_.pop_back();
+  DidChange(CheckChanges(std::move(changes), char_count, GetCharCount()),
+            line_break_count);
+}
+
+void Document::PublishSnapshot() {
+  std::atomic_store(&snapshot_,
+                    std::shared_ptr<const DocumentSnapshot>(
+                        std::make_shared<DocumentSnapshot>(
+                            pieces_, unit_index_, original_owner_, original_,
+                            compact_original_, added_.GetView())));
+}
+
+std::vector<AppendBuffer::Range> Document::FindLiveRanges() const {
+  std::vector<const PieceList*> trees = {&pieces_};
+  for (const UndoStep& step : undo_stack_) trees.push_back(&step.pieces);
+  for (const UndoStep& step : redo_stack_) trees.push_back(&step.pieces);
+  std::vector<AppendBuffer::Range> ranges;
+  PieceList::VisitDistinctPieces(trees, [&ranges](const Piece& piece) {
+    if (piece.IsPlain() && piece.GetCharCount() > 0) {
+      ranges.push_back({piece.start(), piece.end()});
+    }
+  });
+  std::sort(ranges.begin(), ranges.end(),
+            [](const AppendBuffer::Range& lhs, const AppendBuffer::Range& rhs) {
+              return lhs.start < rhs.start;
+            });
+  std::vector<AppendBuffer::Range> live;
+  for (const AppendBuffer::Range& range : ranges) {
+    // Runs in different chunks never touch (see AppendBuffer).
+    if (!live.empty() && range.start <= live.back().end) {
+      live.back().end = std::max(live.back().end, range.end);
     } else {
-      if (it->IsLineBreak()) ++line;
-      it = pieces_.erase(it);
+      live.push_back(range);
     }
   }
-  UNREACHABLE;
+  return live;
 }
 
-void Document::EraseCharsInRange(int line_start, int column_start, int line_end,
-                                 int column_end) {
-  TRACE(line, column);
-  assert(0 <= line_start);
-  assert(0 <= column_start);
-  assert(0 <= line_end);
-  assert(0 <= column_end);
-  assert(line_start <= line_end);
+Document::BufferStats Document::GetBufferStats() const {
+  return GetBufferStats(FindLiveRanges());
+}
 
-  if (line_start == line_end) {
-    EraseCharsInRangeSingleLine(line_start, column_start, column_end);
-  } else {
-    EraseCharsInRangeMultipleLines(line_start, column_start, line_end, column_end);
+Document::BufferStats Document::GetBufferStats(
+    const std::vector<AppendBuffer::Range>& live) const {
+  BufferStats stats;
+  stats.piece_count = pieces_.GetPieceCount();
+  for (const AppendBuffer::Range& range : live) {
+    stats.live_chars += range.end - range.start;
+  }
+  stats.dead_chars = added_.GetCharCount() - stats.live_chars;
+  return stats;
+}
+
+Document::CompactionStats Document::Compact(double min_dead_ratio) {
+  const std::vector<AppendBuffer::Range> live = FindLiveRanges();
+  CompactionStats stats;
+  stats.before = GetBufferStats(live);
+  std::vector<AppendBuffer::Move> moves;
+  if (stats.before.dead_chars > 0 &&
+      static_cast<double>(stats.before.dead_chars) >=
+          min_dead_ratio * static_cast<double>(added_.GetCharCount())) {
+    moves = added_.Compact(live);
+  }
+  std::vector<PieceList*> trees = {&pieces_};
+  for (UndoStep& step : undo_stack_) trees.push_back(&step.pieces);
+  for (UndoStep& step : redo_stack_) trees.push_back(&step.pieces);
+  const bool compact_original = compact_original_ != nullptr;
+  PieceList::RewritePieces(
+      trees, [&moves, compact_original](Piece* pieces, int count) {
+        int merged = 0;
+        for (int i = 0; i < count; ++i) {
+          Piece piece = pieces[i];
+          if (piece.IsPlain() && !moves.empty()) {
+            piece = MovePiece(piece, moves);
+          }
+          if (merged > 0 &&
+              CanMerge(pieces[merged - 1], piece, compact_original)) {
+            pieces[merged - 1].set_end(piece.end());
+          } else {
+            pieces[merged++] = piece;
+          }
+        }
+        return merged;
+      });
+  std::vector<UnitIndex*> unit_indexes;
+  auto add_unit_index = [&unit_indexes](std::optional<UnitIndex>& index) {
+    if (index) unit_indexes.push_back(&*index);
+  };
+  add_unit_index(unit_index_);
+  for (UndoStep& step : undo_stack_) add_unit_index(step.unit_index);
+  for (UndoStep& step : redo_stack_) add_unit_index(step.unit_index);
+  UnitIndex::MergeGaps(unit_indexes);
+  // The published snapshot would keep the old chunks alive.
+  PublishSnapshot();
+  for (DocumentObserver* observer : observers_) {
+    observer->OnDocumentCompacted(*this);
   }
+  stats.after = GetBufferStats(FindLiveRanges());
+  return stats;
+}
+
+std::shared_ptr<const DocumentSnapshot> Document::Snapshot() const {
+  return std::atomic_load(&snapshot_);
 }
 
 std::wstring Document::GetText() const {
@@ -420,56 +753,104 @@ std::wstring Document::GetText() const {
   return text;
 }
 
-int Document::GetCharCount() const {
-  int count = 0;
-  for (const auto& piece : pieces_) {
-    count += piece.GetCharCount();
-  }
-  return static_cast<int>(count);
-}
+std::int64_t Document::GetCharCount() const { return pieces_.GetCharCount(); }
 
-int Document::GetLineCount() const {
-  int count = 1;
-  for (const auto& piece : pieces_) {
-    if (piece.IsLineBreak()) ++count;
-  }
-  return count;
+std::int64_t Document::GetLineCount() const {
+  return pieces_.GetLineBreakCount() + 1;
 }
 
-wchar_t Document::GetCharAt(int position) const {
+wchar_t Document::GetCharAt(std::int64_t position) const {
   assert(position >= 0);
   assert(position < GetCharCount());
-  int offset = 0;
-  for (const auto& piece : pieces_) {
-    if (position < offset + piece.GetCharCount()) {
-      return GetCharInPiece(piece, position - offset);
+  auto it = pieces_.FindPosition(position);
+  return GetCharInPiece(*it, position - it.offset());
+}
+
+Document::PieceList::const_iterator Document::FindLine(
+    std::int64_t line) const {
+  return pieces_.FindLine(line);
+}
+
+void Document::MoveFinger(std::int64_t line) const {
+  ++finger_stats_.misses;
+  finger_.line = line;
+  finger_.start = pieces_.FindLine(line).offset();
+  finger_.end = line + 1 < GetLineCount()
+                    ? pieces_.FindLine(line + 1).offset() - 1
+                    : GetCharCount();
+}
+
+void Document::UpdateFinger(const DocumentChange& change,
+                            std::int64_t old_line_break_count) {
+  if (finger_.line < 0 || finger_.end < change.start) return;
+  const std::int64_t line_break_delta =
+      pieces_.GetLineBreakCount() - old_line_break_count;
+  const std::int64_t char_delta = change.new_end - change.old_end;
+  if (finger_.start <= change.start && change.old_end <= finger_.end) {
+    // Within the line. The line break ending it is not erased, so the line
+    // is split if line breaks were added.
+    if (line_break_delta != 0) {
+      finger_.line = -1;
+      return;
     }
-    offset += piece.GetCharCount();
+    finger_.end += char_delta;
+  } else if (change.old_end < finger_.start) {
+    // Before the line break in front of the line.
+    finger_.line += line_break_delta;
+    finger_.start += char_delta;
+    finger_.end += char_delta;
+  } else {
+    finger_.line = -1;
   }
-  UNREACHABLE;
-  return L'\0';
 }
 
-Document::PieceList::const_iterator Document::FindLine(int line) const {
-  return const_cast<Document&>(*this).FindLineInternal(line);
+std::int64_t Document::OffsetOfLine(std::int64_t line) const {
+  assert(0 <= line);
+  assert(line < GetLineCount());
+  if (line == finger_.line) {
+    ++finger_stats_.hits;
+  } else {
+    MoveFinger(line);
+  }
+  return finger_.start;
+}
+
+std::int64_t Document::LineOfOffset(std::int64_t offset) const {
+  assert(0 <= offset);
+  assert(offset <= GetCharCount());
+  if (finger_.line >= 0 && finger_.start <= offset && offset <= finger_.end) {
+    ++finger_stats_.hits;
+  } else {
+    MoveFinger(pieces_.CountLineBreaksBefore(offset));
+  }
+  return finger_.line;
+}
+
+std::int64_t Document::GetCharCountOfLine(std::int64_t line) const {
+  const std::int64_t start = OffsetOfLine(line);
+  return finger_.end - start;
 }
 
-Document::PieceList::iterator Document::FindLineInternal(int line) {
-  auto it = pieces_.begin();
-  AdvanceByLine(it, line, pieces_.end());
-  return it;
+LineColumn Document::ToLineColumn(std::int64_t offset) const {
+  const std::int64_t line = LineOfOffset(offset);
+  return LineColumn(line, offset - OffsetOfLine(line));
+}
+
+std::int64_t Document::ToOffset(std::int64_t line, std::int64_t column) const {
+  assert(0 <= column);
+  return OffsetOfLine(line) + column;
 }
 
-void AdvanceByLine(Document::PieceList::const_iterator& it, int count,
+void AdvanceByLine(Document::PieceList::const_iterator& it, std::int64_t count,
                    Document::PieceList::const_iterator end) {
-  for (int i = 0; i < count && it != end; ++it) {
+  for (std::int64_t i = 0; i < count && it != end; ++it) {
     if (it->IsLineBreak()) ++i;
   }
 }
 
-int GetCharCountOfLine(Document::PieceList::const_iterator it,
+std::int64_t GetCharCountOfLine(Document::PieceList::const_iterator it,
                        Document::PieceList::const_iterator end) {
-  int count = 0;
+  std::int64_t count = 0;
   for (; it != end && !it->IsLineBreak(); ++it) {
     count += it->GetCharCount();
   }
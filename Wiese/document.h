@@ -1,100 +1,200 @@
 #ifndef WIESE_DOCUMENT_H_
 #define WIESE_DOCUMENT_H_
 
-#include <cassert>
-#include <iterator>
-#include <list>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
 #include <string_view>
 #include <vector>
 
+#include "append_buffer.h"
+#include "compact_text.h"
+#include "document_snapshot.h"
+#include "piece_tree.h"
+#include "unit_index.h"
+
 namespace wiese {
 
-class Piece {
- private:
-  enum class Kind { kOriginal, kPlain, kLineBreak };
+struct LineColumn {
+  std::int64_t line;
+  std::int64_t column;
 
- public:
-  static Piece MakeOriginal(int start, int end);
-  static Piece MakePlain(int start, int end);
-  static Piece MakeLineBreak();
-  bool IsOriginal() const { return kind_ == Kind::kOriginal; }
-  bool IsPlain() const { return kind_ == Kind::kPlain; }
-  bool IsLineBreak() const { return kind_ == Kind::kLineBreak; }
-  int GetCharCount() const {
-    switch (kind_) {
-      case Kind::kOriginal:
-      case Kind::kPlain:
-        return end_ - start_;
-      case Kind::kLineBreak:
-        return 1;
-    }
-    assert(false);
-    return 0;
-  }
-  Piece SplitAt(int index) {
-    Piece rest(*this);
-    rest.end_ = end_;
-    rest.start_ = end_ = start_ + index;
-    return rest;
-  }
-  Piece Slice(int start, int end) const {
-    Piece sub_piece(*this);
-    sub_piece.start_ = start_ + start;
-    sub_piece.end_ = start_ + end;
-    return sub_piece;
-  }
-  int start() const {
-    assert(IsOriginal() || IsPlain());
-    return start_;
-  }
-  void set_start(int value) {
-    assert(IsOriginal() || IsPlain());
-    assert(value <= end_);
-    start_ = value;
-  }
-  int end() const {
-    assert(IsOriginal() || IsPlain());
-    return end_;
-  }
-  void set_end(int value) {
-    assert(IsOriginal() || IsPlain());
-    assert(start_ <= value);
-    end_ = value;
-  }
-  bool operator==(const Piece& rhs) const {
-    return kind_ == rhs.kind_ && start_ == rhs.start_ && end_ == rhs.end_;
+  LineColumn() : line(0), column(0) {}
+  LineColumn(std::int64_t line, std::int64_t column)
+      : line(line), column(column) {}
+  bool operator==(const LineColumn& rhs) const {
+    return line == rhs.line && column == rhs.column;
   }
+  bool operator!=(const LineColumn& rhs) const { return !operator==(rhs); }
+};
 
- private:
-  Piece(Kind kind) : kind_(kind) {}
-  Kind kind_;
-  int start_;
-  int end_;
+// Replaces the characters in [start, end) with |text|.
+struct Edit {
+  std::int64_t start;
+  std::int64_t end;
+  std::wstring text;
+};
+
+// Describes a change to the text of a document: the characters in
+// [start, old_end) of the old text became [start, new_end) of the new one.
+struct DocumentChange {
+  std::int64_t start;
+  std::int64_t old_end;
+  std::int64_t new_end;
+};
+
+class Document;
+
+class DocumentObserver {
+ public:
+  virtual ~DocumentObserver() = default;
+  // Called after every edit, undo and redo with a change for every range
+  // edited, sorted. Each one is as if it had been the only one: its start
+  // and old_end refer to the old text, and its new_end is its start plus the
+  // number of characters it put there. So an edit at many places, or the
+  // undo of one, costs observers in proportion to the characters changed.
+  virtual void OnDocumentChanged(
+      const Document& document,
+      const std::vector<DocumentChange>& changes) = 0;
+  // Called after Compact, which does not change the text, so that observers
+  // can compact what they keep about it as well.
+  virtual void OnDocumentCompacted(const Document&) {}
 };
 
 class Document {
  public:
-  using PieceList = std::list<Piece>;
+  using PieceList = PieceTree;
+
+  // Counts how often OffsetOfLine and LineOfOffset were answered from the
+  // cached line (see Finger below) and how often they had to search the
+  // tree.
+  struct FingerStats {
+    std::int64_t hits;
+    std::int64_t misses;
+
+    FingerStats() : hits(0), misses(0) {}
+  };
 
-  Document(const wchar_t* original_text);
+  // |storage| tells how the original text is kept (see TextStorage).
+  Document(const wchar_t* original_text,
+           TextStorage storage = TextStorage::kWide);
+  // Maps the file at |path| and uses it as the original text without copying
+  // it. The file must hold wchar_t units as they are in memory (UTF-16LE on
+  // Windows); a leading byte order mark is skipped. Throws std::system_error
+  // if the file cannot be mapped. With TextStorage::kCompact the file is
+  // converted and unmapped instead.
+  explicit Document(const std::filesystem::path& path,
+                    TextStorage storage = TextStorage::kWide);
   Document(const Document&) = delete;
   Document& operator=(const Document&) = delete;
 
-  void InsertCharBefore(wchar_t ch, int position);
-  void InsertCharBefore(wchar_t ch, int line, int column);
-  void InsertStringBefore(const wchar_t* string, int position);
-  void InsertLineBreakBefore(int position);
-  void InsertLineBreakBefore(int line, int column);
-  wchar_t EraseCharAt(int position);
-  wchar_t EraseCharAt(int line, int column);
-  void EraseCharsInRange(int line_start, int column_start, int line_end,
-                         int column_end);
+  void InsertCharBefore(wchar_t ch, std::int64_t position);
+  void InsertCharBefore(wchar_t ch, std::int64_t line, std::int64_t column);
+  // Every line ending in |string| (L"\n", L"\r\n" or a lone L'\r') becomes
+  // a line break piece with line_ending(), so a CRLF is one character.
+  // The string is added to the buffer and spliced into the tree in one go, so
+  // pasting many lines is O(k + log n) for k lines.
+  void InsertStringBefore(const wchar_t* string, std::int64_t position);
+  // Same as above, but a long |string| is adopted by the buffer instead of
+  // being copied, so pasting a large text costs only splitting it into lines.
+  void InsertStringBefore(std::wstring&& string, std::int64_t position);
+  // Same as above for characters kept alive by |owner|, like the contents of
+  // a vector, which must not change while the document, its undo steps or
+  // snapshots may refer to them.
+  void InsertSharedStringBefore(std::shared_ptr<const void> owner,
+                                std::wstring_view string,
+                                std::int64_t position);
+  // Maps the file at |path| and inserts its text without copying it. The
+  // file is read like the constructor reads it, and its line endings are
+  // kept. The mapping stays until the document and its snapshots are gone.
+  // Throws std::system_error if the file cannot be mapped.
+  void InsertFileBefore(const std::filesystem::path& path,
+                        std::int64_t position);
+  void InsertLineBreakBefore(std::int64_t position);
+  void InsertLineBreakBefore(std::int64_t line, std::int64_t column);
+  wchar_t EraseCharAt(std::int64_t position);
+  wchar_t EraseCharAt(std::int64_t line, std::int64_t column);
+  // Erases the characters in [start, end). Only the pieces on both ends are
+  // touched; the ones in between are unlinked at once, so this is O(log n)
+  // plus the number of pieces removed.
+  void EraseCharsInRange(std::int64_t start, std::int64_t end);
+  void EraseCharsInRange(std::int64_t line_start, std::int64_t column_start,
+                         std::int64_t line_end, std::int64_t column_end);
+  // Appends |text|, which the file the document was read from has grown by,
+  // to the end, the way the file was read: line endings are kept, and an
+  // L'\n' at the start of |text| makes a CRLF of a CR line break ending the
+  // document. The text is copied to the buffer and spliced in with its line
+  // breaks in O(k + log n) for k characters; existing pieces and snapshots
+  // are not touched. The text is no undo step: it is in the file whatever is
+  // undone, so it is appended to every undo and redo step as well, each in
+  // O(log n).
+  void AppendFileText(std::wstring_view text);
+  // Copies the original text out of the mapping of the file it was read
+  // from, if it is mapped, and releases the mapping, so that the file may be
+  // truncated or rewritten without the document noticing. Snapshots taken
+  // before keep the mapping until they are gone. O(n), and the copy takes
+  // as much memory as the text, where the mapping took only the pages read;
+  // call it only if the file may really shrink (see FileFollower).
+  void ReleaseOriginalFile();
+  // Returns the number of characters |string| takes once inserted: a CRLF
+  // in it becomes one line break.
+  static std::int64_t GetInsertedCharCount(std::wstring_view string);
+  // Applies |edits| as one transaction: one undo step and one notification
+  // with a change for each of them. Positions refer to the text before
+  // the edits, which must not overlap; edits inserting at the same position
+  // are applied in the given order. The edits are sorted and the tree is
+  // rebuilt in one sweep, so this is O(k log n) for k edits. Long texts are
+  // adopted like InsertStringBefore does with a moved string.
+  void ApplyEdits(std::vector<Edit> edits);
+
+  // |observer| must be removed before it is destroyed.
+  void AddObserver(DocumentObserver* observer);
+  void RemoveObserver(DocumentObserver* observer);
+
+  // The line ending new line breaks get. It starts as the one most of the
+  // line breaks of the original text have (LF if there are none); the line
+  // breaks already there keep theirs, so mixed line endings are saved as they
+  // were read.
+  LineEnding line_ending() const { return line_ending_; }
+  void set_line_ending(LineEnding ending) { line_ending_ = ending; }
+
+  // Every call to one of the edit functions above is one undo step. The steps
+  // are kept as copies of the piece tree, which share all the nodes an edit
+  // did not touch, so undo and redo only swap the tree. Each step also keeps
+  // the changes of its edit, so that observers are told which ranges undo and
+  // redo changed rather than the whole text.
+  bool CanUndo() const { return !undo_stack_.empty(); }
+  bool CanRedo() const { return !redo_stack_.empty(); }
+  void Undo();
+  void Redo();
+
+  // Returns the text as of the last edit. Unlike the other functions, this may
+  // be called on any thread while the document is being edited; the snapshot
+  // is published atomically after every edit, and reading it needs no lock.
+  std::shared_ptr<const DocumentSnapshot> Snapshot() const;
+
+  // Number of bytes of the file read by the constructor, or 0 if the
+  // document was not read from a file.
+  std::size_t GetOriginalFileSize() const { return original_file_size_; }
 
   std::wstring GetText() const;
-  int GetCharCount() const;
-  int GetLineCount() const;
-  wchar_t GetCharAt(int position) const;
+  std::int64_t GetCharCount() const;
+  std::int64_t GetLineCount() const;
+  wchar_t GetCharAt(std::int64_t position) const;
+
+  // Conversion between positions and line/column pairs. All of them are
+  // O(log n) in the number of pieces, and O(1) for the line looked up last.
+  std::int64_t OffsetOfLine(std::int64_t line) const;
+  std::int64_t LineOfOffset(std::int64_t offset) const;
+  std::int64_t GetCharCountOfLine(std::int64_t line) const;
+  LineColumn ToLineColumn(std::int64_t offset) const;
+  std::int64_t ToOffset(std::int64_t line, std::int64_t column) const;
 
+  // Pieces of a compact original text are decoded into a buffer of the
+  // document, so the characters are only valid until the next call.
   std::wstring_view GetCharsInPiece(const Piece& piece) const;
   std::wstring_view GetVisualCharsInPiece(const Piece& piece) const;
   PieceList::const_iterator PieceIteratorBegin() const {
@@ -102,27 +202,160 @@ class Document {
   }
   PieceList::const_iterator PieceIteratorEnd() const { return pieces_.end(); }
   
-  PieceList::const_iterator FindLine(int line) const;
+  PieceList::const_iterator FindLine(std::int64_t line) const;
+
+  // Converts positions to and from UTF-16 and code point offsets in
+  // O(log n). It is built by the first call, since opening a file would
+  // otherwise take a second pass over the text, and then kept up to date by
+  // the edits and undone with them.
+  const UnitIndex& unit_index() const;
+
+  const FingerStats& finger_stats() const { return finger_stats_; }
+
+  // Tells how much of the buffer holding the added text is still in use.
+  struct BufferStats {
+    // Number of pieces of the text.
+    std::int64_t piece_count;
+    // Characters of the buffer the text or its undo and redo steps refer to.
+    std::int64_t live_chars;
+    // Characters of the buffer nothing refers to any more.
+    std::int64_t dead_chars;
+
+    BufferStats() : piece_count(0), live_chars(0), dead_chars(0) {}
+  };
+  struct CompactionStats {
+    BufferStats before;
+    BufferStats after;
+  };
+
+  // O(p log p) for the p pieces of the text and its undo and redo steps;
+  // pieces they share are counted once.
+  BufferStats GetBufferStats() const;
+  // Merges the pieces which follow each other both in the text and in their
+  // buffer (within a node of the piece tree, so that nodes stay shared), and
+  // the gaps of the unit indexes, and if at least |min_dead_ratio| of the
+  // characters of the added buffer are dead, copies the live ones to new
+  // chunks so that the old ones can be freed. The text and its undo and redo
+  // steps are moved over together and keep sharing their pieces; snapshots
+  // keep the old chunks until they are gone. The text does not change, so
+  // this is no undo step and OnDocumentChanged is not called, but characters
+  // returned by GetCharsInPiece may no longer be valid. Observers get
+  // OnDocumentCompacted instead. Takes as long as GetBufferStats plus
+  // copying the live characters.
+  CompactionStats Compact(double min_dead_ratio = 0.5);
 
  private:
-  Piece AddCharsToBuffer(const wchar_t* chars, int count);
-  void InsertCharsBefore(const wchar_t* chars, int count, int position);
-  void InsertCharsBefore(const wchar_t* chars, int count, int line, int column);
-  wchar_t GetCharInPiece(const Piece& piece, int index) const;
-  wchar_t EraseCharInFrontOf(PieceList::iterator it);
-  void EraseCharsInRangeSingleLine(int line, int start, int end);
-  void EraseCharsInRangeMultipleLines(int line_start, int column_start, int line_end, int column_end);
-  PieceList::iterator FindLineInternal(int line);
+  Piece AddCharsToBuffer(const wchar_t* chars, std::int64_t count);
+  // Adds |string| to the buffer and returns the pieces for it, with a line
+  // break piece with |line_ending_| for every line ending in it (L"\n",
+  // L"\r\n" or a lone L'\r'), so that pasted text gets the line endings of
+  // the document. The pieces may then hold fewer characters than |string|.
+  std::vector<Piece> AddStringToBuffer(std::wstring_view string);
+  // Same as AddStringToBuffer, but adopts |string|, which |owner| keeps
+  // alive, instead of copying it (see AppendBuffer::Adopt).
+  std::vector<Piece> AdoptStringToBuffer(std::shared_ptr<const void> owner,
+                                         std::wstring_view string);
+  // Returns the pieces for |string|, which is in the buffer at |start|, like
+  // AddStringToBuffer.
+  std::vector<Piece> SplitAddedString(std::wstring_view string,
+                                      std::int64_t start) const;
+  // Returns the pieces for |text| read from a file, which is in the buffer at
+  // |start|, keeping its line endings.
+  static std::vector<Piece> SplitAddedFileText(std::wstring_view text,
+                                               std::int64_t start);
+  // Appends |lines|, the pieces of |text| as split by SplitAddedFileText, to
+  // |pieces| and |unit_index|, if it is built, as AppendFileText describes,
+  // and returns the position of the first piece replaced.
+  std::int64_t AppendFileLines(const std::vector<Piece>& lines,
+                               std::wstring_view text, PieceList& pieces,
+                               std::optional<UnitIndex>& unit_index) const;
+  // Returns the runs of the added buffer the text or its undo and redo steps
+  // refer to, sorted and merged where they overlap or touch.
+  std::vector<AppendBuffer::Range> FindLiveRanges() const;
+  BufferStats GetBufferStats(
+      const std::vector<AppendBuffer::Range>& live) const;
+  // Inserts |pieces| as one edit.
+  void InsertPiecesBefore(const std::vector<Piece>& pieces,
+                          std::int64_t position);
+  void InsertCharsBefore(const wchar_t* chars, std::int64_t count,
+                         std::int64_t position);
+  void InsertCharsBefore(const wchar_t* chars, std::int64_t count,
+                         std::int64_t line, std::int64_t column);
+  wchar_t GetCharInPiece(const Piece& piece, std::int64_t index) const;
+  // Records the current text as an undo step before an edit.
+  void PushUndoStep();
+  // Makes the current text available to Snapshot() after an edit.
+  void PublishSnapshot();
+  // Makes |line| the finger, looking up its bounds in the tree.
+  void MoveFinger(std::int64_t line) const;
+  // Adjusts the finger after |change|, or drops it if the line itself was
+  // split or joined.
+  void UpdateFinger(const DocumentChange& change,
+                    std::int64_t old_line_break_count);
+  // Updates the finger and the snapshot, and notifies the observers.
+  // |changes| are as DocumentObserver::OnDocumentChanged describes.
+  void DidChange(const std::vector<DocumentChange>& changes,
+                 std::int64_t old_line_break_count);
+  // Returns the pieces of the unit index for the characters in [start, end).
+  std::vector<Piece> ScanUnits(std::int64_t start, std::int64_t end) const;
+  // Updates the unit index, if it is built, after edits, one change for each
+  // edited range as if it had been the only one. The changes must be sorted.
+  void UpdateUnitIndex(const std::vector<DocumentChange>& changes);
+  // Updates the unit index after an edit, records |changes| in the undo step
+  // pushed for it and calls DidChange.
+  void DidEdit(std::vector<DocumentChange> changes,
+               std::int64_t old_line_break_count);
 
   PieceList pieces_;
-  const std::vector<wchar_t> original_;
-  std::vector<wchar_t> added_;
+  // Keeps the memory |original_| points to alive: either a copy of the text
+  // given to the constructor or a mapping of the file.
+  std::shared_ptr<const void> original_owner_;
+  std::wstring_view original_;
+  std::size_t original_file_size_;
+  // Whether |original_owner_| is the mapping of the file.
+  bool original_mapped_;
+  // The original text if it is compact; original pieces then refer to it and
+  // |original_| is empty.
+  std::shared_ptr<const CompactText> compact_original_;
+  // Holds the characters GetCharsInPiece decoded last.
+  mutable std::wstring decoded_;
+  AppendBuffer added_;
+  // Empty until unit_index() is called.
+  mutable std::optional<UnitIndex> unit_index_;
+  LineEnding line_ending_;
+  // Typing, deleting and moving the caret hit the same line over and over,
+  // so the bounds of the line looked up last are kept and updated by edits.
+  struct Finger {
+    // -1 if there is no finger.
+    std::int64_t line;
+    // Position of the first character of the line.
+    std::int64_t start;
+    // Position of the line break ending the line, or the end of the text.
+    std::int64_t end;
+  };
+  mutable Finger finger_;
+  mutable FingerStats finger_stats_;
+
+  std::vector<DocumentObserver*> observers_;
+  struct UndoStep {
+    PieceList pieces;
+    // Empty if the unit index was not built yet when the step was recorded.
+    std::optional<UnitIndex> unit_index;
+    // The changes of the edit between this step and the next text, which
+    // undo and redo report.
+    std::vector<DocumentChange> changes;
+  };
+  std::vector<UndoStep> undo_stack_;
+  std::vector<UndoStep> redo_stack_;
+  // Accessed only with std::atomic_load and std::atomic_store.
+  std::shared_ptr<const DocumentSnapshot> snapshot_;
 };
 
-void AdvanceByLine(Document::PieceList::const_iterator& it, int count,
+void AdvanceByLine(Document::PieceList::const_iterator& it,
+                   std::int64_t count,
                    Document::PieceList::const_iterator end);
-int GetCharCountOfLine(Document::PieceList::const_iterator it,
-                       Document::PieceList::const_iterator end);
+std::int64_t GetCharCountOfLine(Document::PieceList::const_iterator it,
+                                Document::PieceList::const_iterator end);
 
 }  // namespace wiese
 
@@ -0,0 +1,139 @@
+#include "document_snapshot.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace wiese {
+
+DocumentSnapshot::DocumentSnapshot(
+    PieceTree pieces, std::optional<UnitIndex> unit_index,
+    std::shared_ptr<const void> original_owner,
+    std::wstring_view original,
+    std::shared_ptr<const CompactText> compact_original,
+    AppendBuffer::View added)
+    : pieces_(std::move(pieces)),
+      unit_index_(std::move(unit_index)),
+      original_owner_(std::move(original_owner)),
+      original_(original),
+      compact_original_(std::move(compact_original)),
+      added_(std::move(added)) {}
+
+std::wstring DocumentSnapshot::GetText() const {
+  std::wstring text;
+  text.reserve(static_cast<std::size_t>(GetCharCount()));
+  wchar_t buffer[CompactText::kBlockSize];
+  for (const auto& piece : pieces_) {
+    text += GetCharsInPiece(piece, buffer);
+  }
+  return text;
+}
+
+const UnitIndex& DocumentSnapshot::unit_index() const {
+  std::lock_guard<std::mutex> lock(unit_index_mutex_);
+  if (!unit_index_) {
+    UnitIndex::Builder builder;
+    wchar_t buffer[CompactText::kBlockSize];
+    for (const auto& piece : pieces_) {
+      builder.Add(GetCharsInPiece(piece, buffer));
+    }
+    unit_index_.emplace(builder.Finish());
+  }
+  return *unit_index_;
+}
+
+wchar_t DocumentSnapshot::GetCharAt(std::int64_t position) const {
+  assert(0 <= position);
+  assert(position < GetCharCount());
+  auto it = pieces_.FindPosition(position);
+  const std::int64_t index = position - it.offset();
+  if (it->IsOriginal() && is_compact()) {
+    return compact_original_->GetChar(it->start() + index);
+  }
+  return GetCharsInPiece(*it, nullptr)[static_cast<std::size_t>(index)];
+}
+
+std::int64_t DocumentSnapshot::OffsetOfLine(std::int64_t line) const {
+  assert(0 <= line);
+  assert(line < GetLineCount());
+  return pieces_.FindLine(line).offset();
+}
+
+std::int64_t DocumentSnapshot::LineOfOffset(std::int64_t offset) const {
+  assert(0 <= offset);
+  assert(offset <= GetCharCount());
+  return pieces_.CountLineBreaksBefore(offset);
+}
+
+std::wstring_view DocumentSnapshot::GetCharsInPiece(const Piece& piece,
+                                                    wchar_t* buffer) const {
+  if (piece.IsOriginal()) {
+    if (is_compact()) {
+      return compact_original_->GetChars(
+          piece.start(), static_cast<int>(piece.GetCharCount()), buffer);
+    }
+    return {original_.data() + piece.start(),
+            static_cast<std::size_t>(piece.GetCharCount())};
+  } else if (piece.IsPlain()) {
+    return {added_.GetChars(piece.start()),
+            static_cast<std::size_t>(piece.GetCharCount())};
+  }
+  assert(piece.IsLineBreak());
+  static const wchar_t kLF = L'\n';
+  return {&kLF, 1};
+}
+
+namespace {
+
+// Returns true if |p| points into |text| or right after it.
+bool IsWithin(const wchar_t* p, std::wstring_view text) {
+  // Pointers into different arrays can only be ordered with std::less.
+  return !std::less<const wchar_t*>()(p, text.data()) &&
+         !std::less<const wchar_t*>()(text.data() + text.size(), p);
+}
+
+}  // namespace
+
+std::wstring_view DocumentSnapshot::AppendToRun(
+    std::wstring_view run, const Piece& next, bool raw_line_endings) const {
+  const wchar_t* const run_end = run.data() + run.size();
+  if (run.empty() || !IsWithin(run_end, original_)) return run;
+  const std::size_t position = run_end - original_.data();
+  if (next.IsLineBreak()) {
+    const std::wstring_view chars =
+        raw_line_endings ? GetLineEndingChars(next.line_ending()) : L"\n";
+    if (original_.substr(position, chars.size()) == chars) {
+      return {run.data(), run.size() + chars.size()};
+    }
+  } else if (next.IsOriginal() &&
+             static_cast<std::size_t>(next.start()) == position) {
+    return {run.data(),
+            run.size() + static_cast<std::size_t>(next.GetCharCount())};
+  }
+  return run;
+}
+
+std::wstring_view DocumentSnapshot::PrependToRun(const Piece& previous,
+                                                 std::wstring_view run) const {
+  if (run.empty() || !IsWithin(run.data(), original_)) return run;
+  const std::size_t position = run.data() - original_.data();
+  if (previous.IsLineBreak()) {
+    if (position > 0 && original_[position - 1] == L'\n') {
+      return {run.data() - 1, run.size() + 1};
+    }
+  } else if (previous.IsOriginal() &&
+             static_cast<std::size_t>(previous.end()) == position) {
+    const auto count = static_cast<std::size_t>(previous.GetCharCount());
+    return {run.data() - count, run.size() + count};
+  }
+  return run;
+}
+
+}  // namespace wiese
@@ -0,0 +1,81 @@
+#ifndef WIESE_DOCUMENT_SNAPSHOT_H_
+#define WIESE_DOCUMENT_SNAPSHOT_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "append_buffer.h"
+#include "compact_text.h"
+#include "piece_tree.h"
+#include "unit_index.h"
+
+namespace wiese {
+
+// Immutable view of the text of a document at some point. Snapshots share
+// the piece tree and the buffers with the document, so taking one is O(1),
+// and they can be read on any thread without locking while the document
+// keeps being edited. A snapshot stays valid as long as it is held, even
+// after the document is gone.
+class DocumentSnapshot {
+ public:
+  // Original pieces refer to |compact_original| if it is not null, and to
+  // |original| otherwise. |unit_index| is built from |pieces| when first
+  // asked for if it is empty.
+  DocumentSnapshot(PieceTree pieces, std::optional<UnitIndex> unit_index,
+                   std::shared_ptr<const void> original_owner,
+                   std::wstring_view original,
+                   std::shared_ptr<const CompactText> compact_original,
+                   AppendBuffer::View added);
+  DocumentSnapshot(const DocumentSnapshot&) = delete;
+  DocumentSnapshot& operator=(const DocumentSnapshot&) = delete;
+
+  std::wstring GetText() const;
+  std::int64_t GetCharCount() const { return pieces_.GetCharCount(); }
+  std::int64_t GetLineCount() const {
+    return pieces_.GetLineBreakCount() + 1;
+  }
+  wchar_t GetCharAt(std::int64_t position) const;
+  std::int64_t OffsetOfLine(std::int64_t line) const;
+  std::int64_t LineOfOffset(std::int64_t offset) const;
+
+  // True if the original text is a CompactText, whose pieces are at most
+  // CompactText::kBlockSize characters long and have to be decoded.
+  bool is_compact() const { return compact_original_ != nullptr; }
+  // Returns the characters of |piece|. Pieces of a compact original text are
+  // decoded into |buffer|, which must have room for CompactText::kBlockSize
+  // characters; the others are read in place.
+  std::wstring_view GetCharsInPiece(const Piece& piece, wchar_t* buffer) const;
+  // If the characters |next| stands for follow |run| in memory, returns |run|
+  // extended by them, otherwise |run| itself. Only runs in the original text
+  // are extended, which is where long runs of unedited pieces are. Line
+  // breaks are pieces of their own, so a line break continues a run if the
+  // original text has one in that place. If |raw_line_endings|, a line break
+  // stands for the characters of its line ending instead of L'\n' (see
+  // TextCursor::NextRawRun).
+  std::wstring_view AppendToRun(std::wstring_view run, const Piece& next,
+                                bool raw_line_endings = false) const;
+  // Same as AppendToRun for the piece in front of |run|.
+  std::wstring_view PrependToRun(const Piece& previous,
+                                 std::wstring_view run) const;
+  const PieceTree& pieces() const { return pieces_; }
+  // See Document::unit_index(). Safe to call on any thread.
+  const UnitIndex& unit_index() const;
+
+ private:
+  const PieceTree pieces_;
+  mutable std::mutex unit_index_mutex_;
+  // Guarded by |unit_index_mutex_|; not changed once it is built.
+  mutable std::optional<UnitIndex> unit_index_;
+  const std::shared_ptr<const void> original_owner_;
+  const std::wstring_view original_;
+  const std::shared_ptr<const CompactText> compact_original_;
+  const AppendBuffer::View added_;
+};
+
+}  // namespace wiese
+
+#endif
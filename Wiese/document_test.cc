@@ -2,9 +2,23 @@
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iterator>
+#include <memory>
 #include <ostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
 
 constexpr const wchar_t* kText = L"0123456789";
 constexpr const wchar_t* kMultiLineText = L"01234\n6789a";
@@ -23,8 +37,25 @@ std::ostream& operator<<(std::ostream& os, const Piece& piece) {
   return os;
 }
 
+std::ostream& operator<<(std::ostream& os, const LineColumn& line_column) {
+  return os << "(" << line_column.line << "," << line_column.column << ")";
+}
+
 }  // namespace wiese
 
+namespace {
+
+std::filesystem::path WriteTemporaryFile(const char* name,
+                                         std::wstring_view text) {
+  auto path = std::filesystem::temp_directory_path() / name;
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(text.data()),
+             text.size() * sizeof(wchar_t));
+  return path;
+}
+
+}  // namespace
+
 TEST(Document, Constructor) {
   wiese::Document doc(kText);
   EXPECT_EQ(kText, doc.GetText());
@@ -38,6 +69,125 @@ TEST(Document, Constructor_ConvertLFIntoLineBreak) {
   EXPECT_EQ(wiese::Piece::MakeOriginal(6, 11), *++it);
 }
 
+TEST(Document, Constructor_ConsecutiveLineBreaks) {
+  wiese::Document doc(L"a\n\nb");
+  EXPECT_EQ(3, doc.GetLineCount());
+  EXPECT_EQ(L'\n', doc.GetCharAt(2));
+  EXPECT_EQ(L"a\n\nb", doc.GetText());
+}
+
+TEST(Document, Constructor_KeepsLineEndings) {
+  wiese::Document doc(L"ab\r\ncd\re\nf\r\n");
+  EXPECT_EQ(L"ab\ncd\ne\nf\n", doc.GetText());
+  EXPECT_EQ(5, doc.GetLineCount());
+  EXPECT_EQ(2, doc.GetCharCountOfLine(0));
+  EXPECT_EQ(wiese::LineColumn(1, 1), doc.ToLineColumn(4));
+  auto it = doc.PieceIteratorBegin();
+  EXPECT_EQ(wiese::Piece::MakeOriginal(0, 2), *it);
+  EXPECT_EQ(wiese::Piece::MakeLineBreak(wiese::LineEnding::kCrLf), *++it);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(4, 6), *++it);
+  EXPECT_EQ(wiese::Piece::MakeLineBreak(wiese::LineEnding::kCr), *++it);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(7, 8), *++it);
+  EXPECT_EQ(wiese::Piece::MakeLineBreak(wiese::LineEnding::kLf), *++it);
+  // CRLF is the most common, so new line breaks get it.
+  EXPECT_EQ(wiese::LineEnding::kCrLf, doc.line_ending());
+  doc.InsertLineBreakBefore(1);
+  doc.InsertStringBefore(L"\n", 0);
+  EXPECT_EQ(wiese::Piece::MakeLineBreak(wiese::LineEnding::kCrLf),
+            *doc.PieceIteratorBegin());
+  EXPECT_EQ(wiese::Piece::MakeLineBreak(wiese::LineEnding::kCrLf),
+            *std::next(doc.PieceIteratorBegin(), 2));
+}
+
+TEST(Document, Constructor_LineEndingDefaultsToLF) {
+  wiese::Document doc(L"abc");
+  EXPECT_EQ(wiese::LineEnding::kLf, doc.line_ending());
+  doc.set_line_ending(wiese::LineEnding::kCr);
+  doc.InsertLineBreakBefore(1);
+  EXPECT_EQ(wiese::Piece::MakeLineBreak(wiese::LineEnding::kCr),
+            *std::next(doc.PieceIteratorBegin()));
+}
+
+TEST(Document, Constructor_FromFile) {
+  auto path = WriteTemporaryFile("wiese_from_file.txt", kMultiLineText);
+  {
+    wiese::Document doc(path);
+    EXPECT_EQ(kMultiLineText, doc.GetText());
+    EXPECT_EQ(2, doc.GetLineCount());
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(Document, Constructor_FromFile_SkipsByteOrderMark) {
+  auto path = WriteTemporaryFile("wiese_from_file_bom.txt", L"\xfeff" L"abc");
+  {
+    wiese::Document doc(path);
+    EXPECT_EQ(L"abc", doc.GetText());
+    EXPECT_EQ(wiese::Piece::MakeOriginal(1, 4), *doc.PieceIteratorBegin());
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(Document, Constructor_FromEmptyFile) {
+  auto path = WriteTemporaryFile("wiese_from_empty_file.txt", L"");
+  {
+    wiese::Document doc(path);
+    EXPECT_EQ(0, doc.GetCharCount());
+    doc.InsertCharBefore(L'a', 0);
+    EXPECT_EQ(L"a", doc.GetText());
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(Document, Constructor_FromMissingFile) {
+  EXPECT_THROW(wiese::Document(std::filesystem::path(L"no_such_file.txt")),
+               std::system_error);
+}
+
+TEST(Document, Constructor_Compact) {
+  const std::wstring text = L"01234\n\u3042\u3044\n\n\xE9";
+  wiese::Document doc(text.c_str(), wiese::TextStorage::kCompact);
+  EXPECT_EQ(text, doc.GetText());
+  EXPECT_EQ(text, doc.Snapshot()->GetText());
+  EXPECT_EQ(4, doc.GetLineCount());
+  for (int i = 0; i < static_cast<int>(text.size()); ++i) {
+    EXPECT_EQ(text[i], doc.GetCharAt(i));
+    EXPECT_EQ(text[i], doc.Snapshot()->GetCharAt(i));
+  }
+  doc.EraseCharsInRange(2, 7);
+  doc.InsertStringBefore(L"x\ny", 3);
+  EXPECT_EQ(L"01\u3044x\ny\n\n\xE9", doc.GetText());
+  doc.Undo();
+  doc.Undo();
+  EXPECT_EQ(text, doc.GetText());
+}
+
+TEST(Document, Constructor_FromFile_CRLF) {
+  std::wstring text;
+  for (int i = 0; i < 1000; ++i) text += L"line\r\n";
+  auto path = WriteTemporaryFile("wiese_from_file_crlf.txt", text);
+  for (auto storage :
+       {wiese::TextStorage::kWide, wiese::TextStorage::kCompact}) {
+    wiese::Document doc(path, storage);
+    EXPECT_EQ(1001, doc.GetLineCount());
+    EXPECT_EQ(5000, doc.GetCharCount());
+    EXPECT_EQ(4, doc.GetCharCountOfLine(999));
+    EXPECT_EQ(wiese::LineEnding::kCrLf, doc.line_ending());
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(Document, Constructor_FromFile_Compact) {
+  auto path =
+      WriteTemporaryFile("wiese_from_file_compact.txt", L"\xfeff" L"ab\nc");
+  {
+    wiese::Document doc(path, wiese::TextStorage::kCompact);
+    EXPECT_EQ(L"ab\nc", doc.GetText());
+    EXPECT_EQ(2, doc.GetLineCount());
+  }
+  std::filesystem::remove(path);
+}
+
 TEST(Document, GetCharCount) {
   wiese::Document doc(kText);
   EXPECT_EQ(static_cast<int>(std::wcslen(kText)), doc.GetCharCount());
@@ -119,6 +269,118 @@ TEST(Document, InsertStringBefore_End) {
   EXPECT_EQ(L"0123456789end", doc.GetText());
 }
 
+TEST(Document, InsertStringBefore_MultipleLines) {
+  wiese::Document doc(kMultiLineText);
+  doc.InsertStringBefore(L"ab\n\ncd\n", 3);
+  EXPECT_EQ(L"012ab\n\ncd\n34\n6789a", doc.GetText());
+  EXPECT_EQ(5, doc.GetLineCount());
+  EXPECT_EQ(wiese::LineColumn(3, 1), doc.ToLineColumn(11));
+}
+
+TEST(Document, InsertStringBefore_CrLf) {
+  wiese::Document doc(L"x\r\ny");
+  doc.InsertStringBefore(L"a\r\nb", 1);
+  EXPECT_EQ(L"xa\nb\ny", doc.GetText());
+  EXPECT_EQ(3, doc.GetLineCount());
+  EXPECT_EQ(wiese::LineColumn(1, 1), doc.ToLineColumn(4));
+  doc.InsertSharedStringBefore(nullptr, L"c\rd\n", 0);
+  doc.ApplyEdits({{doc.GetCharCount(), doc.GetCharCount(), L"\r\ne\r"}});
+  EXPECT_EQ(L"c\nd\nxa\nb\ny\ne\n", doc.GetText());
+  EXPECT_EQ(7, doc.GetLineCount());
+  for (auto it = doc.PieceIteratorBegin(); it != doc.PieceIteratorEnd(); ++it) {
+    if (it->IsLineBreak()) {
+      EXPECT_EQ(wiese::LineEnding::kCrLf, it->line_ending());
+    } else {
+      EXPECT_EQ(std::wstring_view::npos,
+                doc.GetCharsInPiece(*it).find(L'\r'));
+    }
+  }
+}
+
+TEST(Document, InsertStringBefore_ManyLines) {
+  std::wstring text;
+  for (int i = 0; i < 500000; ++i) text += L"line\n";
+  wiese::Document doc(kText);
+  doc.InsertStringBefore(text.c_str(), 5);
+  EXPECT_EQ(500001, doc.GetLineCount());
+  EXPECT_EQ(L"01234line\nline\n", doc.GetText().substr(0, 15));
+  EXPECT_EQ(2500005, doc.OffsetOfLine(500000));
+}
+
+TEST(Document, InsertStringBefore_AdoptsMovedString) {
+  std::wstring text;
+  for (int i = 0; i < 100000; ++i) text += L"line\n";
+  const wchar_t* const chars = text.data();
+  wiese::Document doc(kText);
+  doc.InsertStringBefore(std::move(text), 5);
+  EXPECT_EQ(100001, doc.GetLineCount());
+  EXPECT_EQ(500010, doc.GetCharCount());
+  auto it = doc.FindLine(1);
+  ASSERT_TRUE(it->IsPlain());
+  EXPECT_EQ(chars + 5, doc.GetCharsInPiece(*it).data());
+  doc.Undo();
+  EXPECT_EQ(kText, doc.GetText());
+  doc.Redo();
+  EXPECT_EQ(L"01234line\nline\n", doc.GetText().substr(0, 15));
+}
+
+TEST(Document, InsertSharedStringBefore_KeepsOwnerAlive) {
+  auto owner = std::make_shared<std::vector<wchar_t>>(100000, L'x');
+  (*owner)[50000] = L'\n';
+  const std::weak_ptr<std::vector<wchar_t>> weak = owner;
+  wiese::Document doc(kText);
+  doc.InsertSharedStringBefore(owner, {owner->data(), owner->size()}, 10);
+  owner.reset();
+  EXPECT_FALSE(weak.expired());
+  EXPECT_EQ(2, doc.GetLineCount());
+  EXPECT_EQ(50010, doc.GetCharCountOfLine(0));
+  EXPECT_EQ(L'x', doc.GetCharAt(100009));
+  auto snapshot = doc.Snapshot();
+  doc.EraseCharsInRange(0, doc.GetCharCount());
+  EXPECT_EQ(L"0123456789xxx", snapshot->GetText().substr(0, 13));
+}
+
+TEST(Document, InsertFileBefore) {
+  std::wstring text = L"\xfeff";
+  for (int i = 0; i < 20000; ++i) text += L"line\r\n";
+  auto path = WriteTemporaryFile("wiese_insert_file.txt", text);
+  {
+    wiese::Document doc(L"ab\ncd");
+    doc.InsertFileBefore(path, 1);
+    EXPECT_EQ(20002, doc.GetLineCount());
+    EXPECT_EQ(L"aline\nline\n", doc.GetText().substr(0, 11));
+    auto line_break = doc.FindLine(1);
+    --line_break;
+    EXPECT_EQ(wiese::LineEnding::kCrLf, line_break->line_ending());
+    EXPECT_EQ(L"b", doc.GetText().substr(100001, 1));
+    doc.Undo();
+    EXPECT_EQ(L"ab\ncd", doc.GetText());
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(Document, InsertFileBefore_MissingFile) {
+  wiese::Document doc(kText);
+  EXPECT_THROW(doc.InsertFileBefore("wiese_missing_file.txt", 0),
+               std::system_error);
+  EXPECT_EQ(kText, doc.GetText());
+  EXPECT_FALSE(doc.CanUndo());
+}
+
+TEST(Document, GetCharsInPiece_StaysValidAfterInsertion) {
+  wiese::Document doc(kText);
+  doc.InsertStringBefore(L"abc", 5);
+  std::wstring_view chars;
+  for (auto it = doc.PieceIteratorBegin(); it != doc.PieceIteratorEnd();
+       ++it) {
+    if (it->IsPlain()) chars = doc.GetCharsInPiece(*it);
+  }
+  const std::wstring filler(100000, L'x');
+  doc.InsertStringBefore(filler.c_str(), 0);
+  doc.InsertStringBefore(filler.c_str(), 0);
+  EXPECT_EQ(L"abc", chars);
+}
+
 TEST(Document, InsertLineBreakBefore_Beginning) {
   wiese::Document doc(kText);
   doc.InsertLineBreakBefore(0);
@@ -209,6 +471,525 @@ TEST(Document, EraseCharsInRange_MultiLine) {
   EXPECT_EQ(L"01289a", doc.GetText());
 }
 
+TEST(Document, EraseCharsInRange_ByPosition) {
+  wiese::Document doc(kMultiLineText);
+  doc.EraseCharsInRange(3, 8);
+  EXPECT_EQ(L"01289a", doc.GetText());
+  EXPECT_EQ(1, doc.GetLineCount());
+}
+
+TEST(Document, EraseCharsInRange_Empty) {
+  wiese::Document doc(kText);
+  doc.EraseCharsInRange(4, 4);
+  EXPECT_EQ(kText, doc.GetText());
+}
+
+TEST(Document, EraseCharsInRange_AcrossInsertedPieces) {
+  wiese::Document doc(kText);
+  doc.InsertStringBefore(L"abc", 2);
+  doc.InsertStringBefore(L"def", 8);
+  doc.EraseCharsInRange(3, 10);
+  EXPECT_EQ(L"01af56789", doc.GetText());
+}
+
+TEST(Document, EraseCharsInRange_Everything) {
+  wiese::Document doc(kMultiLineText);
+  doc.EraseCharsInRange(0, doc.GetCharCount());
+  EXPECT_EQ(0, doc.GetCharCount());
+  EXPECT_EQ(1, doc.GetLineCount());
+}
+
+TEST(Document, AppendFileText) {
+  wiese::Document doc(L"ab\r\ncd");
+  doc.InsertCharBefore(L'x', 0);
+  ASSERT_TRUE(doc.CanUndo());
+  auto snapshot = doc.Snapshot();
+  doc.AppendFileText(L"e\r\nf\rg\n");
+  EXPECT_EQ(L"xab\ncde\nf\ng\n", doc.GetText());
+  EXPECT_EQ(5, doc.GetLineCount());
+  EXPECT_EQ(L"xab\ncd", snapshot->GetText());
+  std::vector<wiese::LineEnding> endings;
+  for (auto it = doc.PieceIteratorBegin(); it != doc.PieceIteratorEnd(); ++it) {
+    if (it->IsLineBreak()) endings.push_back(it->line_ending());
+  }
+  EXPECT_EQ((std::vector<wiese::LineEnding>{
+                wiese::LineEnding::kCrLf, wiese::LineEnding::kCrLf,
+                wiese::LineEnding::kCr, wiese::LineEnding::kLf}),
+            endings);
+  // The appended text stays whatever is undone and redone.
+  doc.Undo();
+  EXPECT_EQ(L"ab\ncde\nf\ng\n", doc.GetText());
+  EXPECT_FALSE(doc.CanUndo());
+  doc.Redo();
+  EXPECT_EQ(L"xab\ncde\nf\ng\n", doc.GetText());
+}
+
+TEST(Document, AppendFileText_JoinsCrLf) {
+  wiese::Document doc(L"a\r");
+  doc.AppendFileText(L"\nb\r");
+  doc.AppendFileText(L"\n");
+  EXPECT_EQ(L"a\nb\n", doc.GetText());
+  EXPECT_EQ(3, doc.GetLineCount());
+  for (auto it = doc.PieceIteratorBegin(); it != doc.PieceIteratorEnd(); ++it) {
+    if (it->IsLineBreak()) {
+      EXPECT_EQ(wiese::LineEnding::kCrLf, it->line_ending());
+    }
+  }
+  EXPECT_FALSE(doc.CanUndo());
+}
+
+TEST(Document, AppendFileText_JoinsCrLfInUndoSteps) {
+  wiese::Document doc(L"a");
+  doc.InsertCharBefore(L'x', 0);
+  doc.AppendFileText(L"\r");
+  doc.AppendFileText(L"\nb");
+  EXPECT_EQ(L"xa\nb", doc.GetText());
+  doc.Undo();
+  EXPECT_EQ(L"a\nb", doc.GetText());
+  EXPECT_EQ(2, doc.GetLineCount());
+  EXPECT_EQ(wiese::LineEnding::kCrLf,
+            std::next(doc.PieceIteratorBegin())->line_ending());
+}
+
+TEST(Document, AppendFileText_PairsSurrogatesAcrossCalls) {
+  wiese::Document doc(L"a");
+  doc.AppendFileText(L"\xD83D");
+  doc.AppendFileText(L"\xDE00");
+  EXPECT_EQ(doc.GetCharCount(), doc.unit_index().GetUtf16Count());
+  EXPECT_EQ(sizeof(wchar_t) == 2 ? 2 : 3,
+            doc.unit_index().GetCodePointCount());
+}
+
+TEST(Document, ApplyEdits) {
+  wiese::Document doc(kMultiLineText);
+  doc.ApplyEdits({{9, 11, L"xy"}, {0, 1, L""}, {5, 6, L" "}, {3, 3, L"a\nb"}});
+  EXPECT_EQ(L"12a\nb34 678xy", doc.GetText());
+  EXPECT_EQ(2, doc.GetLineCount());
+  doc.Undo();
+  EXPECT_EQ(kMultiLineText, doc.GetText());
+}
+
+TEST(Document, ApplyEdits_InsertsAtSamePositionInOrder) {
+  wiese::Document doc(kText);
+  doc.ApplyEdits({{2, 2, L"a"}, {2, 2, L"b"}, {2, 3, L"c"}});
+  EXPECT_EQ(L"01abc3456789", doc.GetText());
+}
+
+TEST(Document, ApplyEdits_LongText) {
+  // Long enough to be adopted by the buffer instead of copied.
+  std::wstring line(wiese::AppendBuffer::kChunkSize, L'x');
+  line += L"\n";
+  wiese::Document doc(kText);
+  doc.ApplyEdits({{1, 2, line + line}, {5, 5, L"ab\n"}});
+  const std::wstring expected = L"0" + line + line + L"234ab\n56789";
+  EXPECT_EQ(expected, doc.GetText());
+  EXPECT_EQ(4, doc.GetLineCount());
+  doc.Compact(0);
+  EXPECT_EQ(expected, doc.GetText());
+  doc.Undo();
+  EXPECT_EQ(kText, doc.GetText());
+}
+
+TEST(Document, ApplyEdits_NotifiesOnce) {
+  class Observer : public wiese::DocumentObserver {
+   public:
+    void OnDocumentChanged(
+        const wiese::Document&,
+        const std::vector<wiese::DocumentChange>& changes) override {
+      notifications.push_back(changes);
+    }
+    std::vector<std::vector<wiese::DocumentChange>> notifications;
+  } observer;
+  const auto expect_changes =
+      [](const std::vector<wiese::DocumentChange>& changes,
+         const std::vector<std::array<std::int64_t, 3>>& expected) {
+        ASSERT_EQ(expected.size(), changes.size());
+        for (std::size_t i = 0; i < changes.size(); ++i) {
+          EXPECT_EQ(expected[i][0], changes[i].start) << i;
+          EXPECT_EQ(expected[i][1], changes[i].old_end) << i;
+          EXPECT_EQ(expected[i][2], changes[i].new_end) << i;
+        }
+      };
+  wiese::Document doc(kText);
+  doc.AddObserver(&observer);
+  doc.ApplyEdits({{7, 9, L""}, {1, 2, L"abc"}});
+  ASSERT_EQ(1u, observer.notifications.size());
+  // One change for every edited range, not one from the first to the last.
+  expect_changes(observer.notifications[0], {{1, 2, 4}, {7, 9, 7}});
+  // Undo and redo report the same ranges, not the whole text.
+  doc.Undo();
+  ASSERT_EQ(2u, observer.notifications.size());
+  expect_changes(observer.notifications[1], {{1, 4, 2}, {9, 9, 11}});
+  doc.Redo();
+  ASSERT_EQ(3u, observer.notifications.size());
+  expect_changes(observer.notifications[2], {{1, 2, 4}, {7, 9, 7}});
+  doc.RemoveObserver(&observer);
+  doc.InsertCharBefore(L'a', 0);
+  EXPECT_EQ(3u, observer.notifications.size());
+}
+
+TEST(Document, UnitIndex_FollowsEdits) {
+  // Expects the unit index of |doc| to be the one made from its text.
+  const auto expect_unit_index = [](const wiese::Document& doc) {
+    const std::wstring text = doc.GetText();
+    wiese::UnitIndex::Builder builder;
+    builder.Add(text);
+    const wiese::UnitIndex expected(builder.Finish());
+    const wiese::UnitIndex& actual = doc.unit_index();
+    ASSERT_EQ(doc.GetCharCount(), actual.GetCharCount());
+    for (int i = 0; i <= doc.GetCharCount(); ++i) {
+      ASSERT_EQ(expected.ToUtf16Offset(i), actual.ToUtf16Offset(i));
+      ASSERT_EQ(expected.ToCodePointOffset(i), actual.ToCodePointOffset(i));
+    }
+    EXPECT_EQ(expected.GetCodePointCount(),
+              doc.Snapshot()->unit_index().GetCodePointCount());
+  };
+  // Surrogates are inserted one by one, so that edits join and split pairs.
+  const wchar_t kChars[] = {L'a', L'\n', static_cast<wchar_t>(0xD83D),
+                            static_cast<wchar_t>(0xDE00),
+                            static_cast<wchar_t>(sizeof(wchar_t) == 4
+                                                     ? 0x1F600
+                                                     : 0xDE01)};
+  std::mt19937 random(1);
+  const auto random_text = [&] {
+    std::wstring text(random() % 4, L'a');
+    for (wchar_t& ch : text) ch = kChars[random() % 5];
+    return text;
+  };
+  wiese::Document doc(random_text().c_str());
+  for (int i = 0; i < 300; ++i) {
+    const int char_count = doc.GetCharCount();
+    const int position = random() % (char_count + 1);
+    switch (random() % 3) {
+      case 0:
+        doc.InsertCharBefore(kChars[random() % 5], position);
+        break;
+      case 1:
+        if (position < char_count) doc.EraseCharAt(position);
+        break;
+      case 2: {
+        const int second = random() % (char_count + 1);
+        const int third = std::min(second + 2, char_count);
+        const int first = std::min(position, second);
+        doc.ApplyEdits({{first, first, random_text()},
+                        {second, third, random_text()},
+                        {third, third, random_text()}});
+        break;
+      }
+    }
+    expect_unit_index(doc);
+  }
+  for (int i = 0; i < 10; ++i) doc.Undo();
+  expect_unit_index(doc);
+  doc.Redo();
+  expect_unit_index(doc);
+}
+
+TEST(Document, UnitIndex_BuiltOnFirstUse) {
+  const std::wstring kPair = {static_cast<wchar_t>(0xD83D),
+                              static_cast<wchar_t>(0xDE00)};
+  // Code points of a text with |pairs| surrogate pairs and |others| other
+  // characters, wherever wchar_t is UTF-16.
+  const auto code_points = [](int pairs, int others) {
+    return sizeof(wchar_t) == 2 ? pairs + others : pairs * 2 + others;
+  };
+  wiese::Document doc((L"a\n" + kPair).c_str(),
+                      wiese::TextStorage::kCompact);
+  // Steps recorded before the index is built are built when undone to.
+  doc.InsertStringBefore(kPair.c_str(), 0);
+  doc.AppendFileText(L"b" + kPair);
+  EXPECT_EQ(code_points(3, 3),
+            doc.Snapshot()->unit_index().GetCodePointCount());
+  EXPECT_EQ(code_points(3, 3), doc.unit_index().GetCodePointCount());
+  doc.EraseCharAt(0);
+  doc.AppendFileText(L"c");
+  EXPECT_EQ(code_points(2, 5), doc.unit_index().GetCodePointCount());
+  doc.Undo();
+  EXPECT_EQ(code_points(3, 4), doc.unit_index().GetCodePointCount());
+  doc.Undo();
+  EXPECT_EQ(code_points(2, 4), doc.unit_index().GetCodePointCount());
+  EXPECT_EQ(code_points(2, 4),
+            doc.Snapshot()->unit_index().GetCodePointCount());
+  doc.Redo();
+  EXPECT_EQ(code_points(3, 4), doc.unit_index().GetCodePointCount());
+}
+
+TEST(Document, Undo) {
+  wiese::Document doc(kMultiLineText);
+  EXPECT_FALSE(doc.CanUndo());
+  doc.InsertStringBefore(L"ab\ncd", 3);
+  doc.EraseCharsInRange(0, 4);
+  doc.InsertLineBreakBefore(2);
+  EXPECT_EQ(L"b\n\ncd34\n6789a", doc.GetText());
+  doc.Undo();
+  EXPECT_EQ(L"b\ncd34\n6789a", doc.GetText());
+  doc.Undo();
+  EXPECT_EQ(L"012ab\ncd34\n6789a", doc.GetText());
+  doc.Undo();
+  EXPECT_EQ(kMultiLineText, doc.GetText());
+  EXPECT_EQ(2, doc.GetLineCount());
+  EXPECT_FALSE(doc.CanUndo());
+}
+
+TEST(Document, Redo) {
+  wiese::Document doc(kText);
+  doc.InsertCharBefore(L'a', 0);
+  doc.EraseCharAt(5);
+  doc.Undo();
+  doc.Undo();
+  EXPECT_TRUE(doc.CanRedo());
+  doc.Redo();
+  EXPECT_EQ(L"a0123456789", doc.GetText());
+  doc.Redo();
+  EXPECT_EQ(L"a012356789", doc.GetText());
+  EXPECT_FALSE(doc.CanRedo());
+}
+
+TEST(Document, Redo_ClearedByEdit) {
+  wiese::Document doc(kText);
+  doc.InsertCharBefore(L'a', 0);
+  doc.Undo();
+  doc.InsertCharBefore(L'b', 0);
+  EXPECT_FALSE(doc.CanRedo());
+  doc.Undo();
+  EXPECT_EQ(kText, doc.GetText());
+}
+
+TEST(Document, Snapshot_IsNotAffectedByEdits) {
+  wiese::Document doc(kMultiLineText);
+  doc.InsertStringBefore(L"abc", 2);
+  auto snapshot = doc.Snapshot();
+  doc.EraseCharsInRange(0, 8);
+  doc.InsertStringBefore(L"de\nf", 0);
+  EXPECT_EQ(L"01abc234\n6789a", snapshot->GetText());
+  EXPECT_EQ(2, snapshot->GetLineCount());
+  EXPECT_EQ(L'c', snapshot->GetCharAt(4));
+  EXPECT_EQ(9, snapshot->OffsetOfLine(1));
+  EXPECT_EQ(doc.GetText(), doc.Snapshot()->GetText());
+}
+
+TEST(Document, Snapshot_OutlivesDocument) {
+  std::shared_ptr<const wiese::DocumentSnapshot> snapshot;
+  {
+    wiese::Document doc(kText);
+    doc.InsertStringBefore(L"abc", 5);
+    snapshot = doc.Snapshot();
+  }
+  EXPECT_EQ(L"01234abc56789", snapshot->GetText());
+}
+
+TEST(Document, Snapshot_ReadOnOtherThread) {
+  wiese::Document doc(kText);
+  std::atomic<bool> done(false);
+  std::thread reader([&] {
+    while (!done) {
+      auto snapshot = doc.Snapshot();
+      const std::wstring text = snapshot->GetText();
+      ASSERT_EQ(static_cast<std::size_t>(snapshot->GetCharCount()),
+                text.size());
+      ASSERT_EQ(L"01234", text.substr(0, 5));
+    }
+  });
+  for (int i = 0; i < 2000; ++i) {
+    doc.InsertStringBefore(L"x\ny", doc.GetCharCount());
+    if (i % 3 == 0) doc.EraseCharAt(7);
+  }
+  done = true;
+  reader.join();
+  EXPECT_EQ(doc.GetText(), doc.Snapshot()->GetText());
+}
+
+TEST(Document, GetBufferStats) {
+  wiese::Document doc(kText);
+  doc.InsertStringBefore(L"abcd", 5);
+  doc.EraseCharsInRange(6, 8);
+  const wiese::Document::BufferStats stats = doc.GetBufferStats();
+  EXPECT_EQ(4, stats.piece_count);
+  // The erased characters are still referred to by the undo steps.
+  EXPECT_EQ(4, stats.live_chars);
+  EXPECT_EQ(0, stats.dead_chars);
+}
+
+TEST(Document, Compact) {
+  wiese::Document doc(kText);
+  for (int i = 0; i < 1000; ++i) doc.InsertCharBefore(L'x', 5);
+  doc.EraseCharsInRange(6, 1004);
+  while (doc.CanUndo()) doc.Undo();
+  doc.Redo();
+  doc.InsertStringBefore(L"ab", 0);
+  EXPECT_EQ(L"ab01234x56789", doc.GetText());
+  // The redo steps are gone, but the first undo step refers to the "x".
+  const wiese::Document::CompactionStats stats = doc.Compact();
+  EXPECT_EQ(3, stats.before.live_chars);
+  EXPECT_EQ(999, stats.before.dead_chars);
+  EXPECT_EQ(3, stats.after.live_chars);
+  EXPECT_EQ(0, stats.after.dead_chars);
+  EXPECT_EQ(L"ab01234x56789", doc.GetText());
+  doc.Undo();
+  EXPECT_EQ(L"01234x56789", doc.GetText());
+  doc.Undo();
+  EXPECT_EQ(kText, doc.GetText());
+  doc.Redo();
+  doc.Redo();
+  EXPECT_EQ(L"ab01234x56789", doc.GetText());
+}
+
+TEST(Document, Compact_MergesPieces) {
+  wiese::Document doc(kText);
+  for (int i = 1; i < 10; ++i) {
+    doc.InsertCharBefore(L'x', i);
+    doc.EraseCharAt(i);
+  }
+  const wiese::Document::CompactionStats stats = doc.Compact();
+  EXPECT_EQ(10, stats.before.piece_count);
+  EXPECT_EQ(1, stats.after.piece_count);
+  EXPECT_EQ(kText, doc.GetText());
+  doc.Undo();
+  EXPECT_EQ(L"012345678x9", doc.GetText());
+}
+
+TEST(Document, Compact_MergesMovedPieces) {
+  wiese::Document doc(kText);
+  for (int i = 0; i < 100; ++i) {
+    // The "bc"s are dropped with the redo step.
+    doc.InsertStringBefore(L"bc", doc.GetCharCount() - 2);
+    doc.Undo();
+    doc.InsertCharBefore(L'a', doc.GetCharCount() - 2);
+  }
+  const wiese::Document::CompactionStats stats = doc.Compact();
+  EXPECT_EQ(102, stats.before.piece_count);
+  EXPECT_EQ(100, stats.before.live_chars);
+  EXPECT_EQ(200, stats.before.dead_chars);
+  // The "a"s are merged within every node of the tree.
+  EXPECT_LE(stats.after.piece_count,
+            102 / wiese::PieceTree::kMaxPiecesPerNode + 4);
+  EXPECT_EQ(0, stats.after.dead_chars);
+  EXPECT_EQ(L"01234567" + std::wstring(100, L'a') + L"89", doc.GetText());
+}
+
+TEST(Document, Compact_BelowRatio) {
+  wiese::Document doc(kText);
+  doc.InsertStringBefore(L"abcd", 5);
+  doc.EraseCharsInRange(6, 8);
+  while (doc.CanUndo()) doc.Undo();
+  doc.Redo();
+  doc.Redo();
+  doc.InsertCharBefore(L'x', 0);
+  const wiese::Document::CompactionStats stats = doc.Compact(0.5);
+  EXPECT_EQ(5, stats.before.live_chars);
+  EXPECT_EQ(0, stats.before.dead_chars);
+  EXPECT_EQ(stats.before.live_chars, stats.after.live_chars);
+  EXPECT_EQ(L"x01234ad56789", doc.GetText());
+}
+
+TEST(Document, Compact_KeepsSnapshots) {
+  wiese::Document doc(kText);
+  const std::wstring filler(100000, L'x');
+  doc.InsertStringBefore(filler.c_str(), 5);
+  doc.InsertStringBefore(L"abc", 0);
+  auto snapshot = doc.Snapshot();
+  doc.EraseCharsInRange(3, 100008);
+  while (doc.CanUndo()) doc.Undo();
+  doc.Redo();
+  doc.InsertCharBefore(L'y', 0);
+  doc.Compact();
+  EXPECT_EQ(L"y01234" + filler + L"56789", doc.GetText());
+  EXPECT_EQ(L"abc01234" + filler + L"56789", snapshot->GetText());
+  EXPECT_EQ(L"y01234" + filler + L"56789", doc.Snapshot()->GetText());
+}
+
+TEST(Document, Compact_KeepsBlocksOfCompactText) {
+  std::wstring text(10000, L'a');
+  wiese::Document doc(text.c_str(), wiese::TextStorage::kCompact);
+  doc.InsertCharBefore(L'b', 5000);
+  doc.EraseCharAt(5000);
+  doc.Compact(0.0);
+  EXPECT_EQ(text, doc.GetText());
+  for (auto it = doc.PieceIteratorBegin(); it != doc.PieceIteratorEnd();
+       ++it) {
+    EXPECT_LE(it->GetCharCount(), wiese::CompactText::kBlockSize);
+  }
+}
+
+TEST(Document, OffsetOfLine) {
+  wiese::Document doc(kMultiLineText);
+  EXPECT_EQ(0, doc.OffsetOfLine(0));
+  EXPECT_EQ(6, doc.OffsetOfLine(1));
+}
+
+TEST(Document, OffsetOfLine_AfterLineBreakInserted) {
+  wiese::Document doc(kMultiLineText);
+  doc.InsertLineBreakBefore(0, 2);
+  EXPECT_EQ(3, doc.OffsetOfLine(1));
+  EXPECT_EQ(7, doc.OffsetOfLine(2));
+}
+
+TEST(Document, LineOfOffset) {
+  wiese::Document doc(kMultiLineText);
+  EXPECT_EQ(0, doc.LineOfOffset(0));
+  EXPECT_EQ(0, doc.LineOfOffset(5));
+  EXPECT_EQ(1, doc.LineOfOffset(6));
+  EXPECT_EQ(1, doc.LineOfOffset(11));
+}
+
+TEST(Document, LineOfOffset_AfterLineBreakErased) {
+  wiese::Document doc(kMultiLineText);
+  doc.EraseCharAt(0, 5);
+  EXPECT_EQ(0, doc.LineOfOffset(8));
+}
+
+TEST(Document, GetCharCountOfLine) {
+  wiese::Document doc(kMultiLineText);
+  EXPECT_EQ(5, doc.GetCharCountOfLine(0));
+  EXPECT_EQ(5, doc.GetCharCountOfLine(1));
+  doc.InsertStringBefore(L"abc", 7);
+  EXPECT_EQ(8, doc.GetCharCountOfLine(1));
+  doc.InsertLineBreakBefore(1, 2);
+  EXPECT_EQ(2, doc.GetCharCountOfLine(1));
+  EXPECT_EQ(6, doc.GetCharCountOfLine(2));
+}
+
+TEST(Document, Finger_HitsWhileTypingOnOneLine) {
+  std::wstring text;
+  for (int i = 0; i < 1000; ++i) text += L"line\n";
+  wiese::Document doc(text.c_str());
+  int line = 500;
+  doc.InsertCharBefore(L'a', line, 0);
+  const auto misses = doc.finger_stats().misses;
+  for (int i = 1; i < 100; ++i) {
+    doc.InsertCharBefore(L'a', line, i);
+    doc.InsertLineBreakBefore(0);
+    ++line;
+    ASSERT_EQ(i + 5, doc.GetCharCountOfLine(line));
+  }
+  EXPECT_EQ(misses, doc.finger_stats().misses);
+  EXPECT_LT(0, doc.finger_stats().hits);
+}
+
+TEST(Document, Finger_DroppedWhenLineIsJoined) {
+  wiese::Document doc(kMultiLineText);
+  EXPECT_EQ(6, doc.OffsetOfLine(1));
+  doc.EraseCharAt(5);
+  EXPECT_EQ(0, doc.LineOfOffset(7));
+  EXPECT_EQ(10, doc.GetCharCountOfLine(0));
+}
+
+TEST(Document, ToLineColumn) {
+  wiese::Document doc(kMultiLineText);
+  EXPECT_EQ(wiese::LineColumn(0, 0), doc.ToLineColumn(0));
+  EXPECT_EQ(wiese::LineColumn(0, 5), doc.ToLineColumn(5));
+  EXPECT_EQ(wiese::LineColumn(1, 0), doc.ToLineColumn(6));
+  EXPECT_EQ(wiese::LineColumn(1, 5), doc.ToLineColumn(11));
+}
+
+TEST(Document, ToOffset) {
+  wiese::Document doc(kMultiLineText);
+  EXPECT_EQ(0, doc.ToOffset(0, 0));
+  EXPECT_EQ(5, doc.ToOffset(0, 5));
+  EXPECT_EQ(6, doc.ToOffset(1, 0));
+  EXPECT_EQ(11, doc.ToOffset(1, 5));
+}
+
 TEST(Document, RegressionCase1) {
   wiese::Document doc(kText);
   doc.InsertCharBefore(L'a', 0);
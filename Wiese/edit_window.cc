@@ -11,8 +11,10 @@
 #include <optional>
 #include <queue>
 #include <string_view>
+#include <utility>
 #include <vector>
 
+#include "text_cursor.h"
 #include "text_store.h"
 #include "util.h"
 
@@ -126,22 +128,24 @@ void EditWindow::DrawLines() {
   }
 
   std::queue<DrawStringOperation> queue;
-  int line = 0;
-  int column = 0;
+  std::int64_t line = 0;
+  std::int64_t column = 0;
   float x_offset = 0;
   bool in_selection = false;
   for (auto it = document_.PieceIteratorBegin();
        it != document_.PieceIteratorEnd(); ++it) {
-    int char_count = it->GetCharCount();
+    const std::int64_t char_count = it->GetCharCount();
     if (line == selection_start.line && column <= selection_start.column &&
         selection_start.column < column + char_count) {
-      int start_point = selection_start.column - column;
+      const std::size_t start_point =
+          static_cast<std::size_t>(selection_start.column - column);
       std::wstring_view string = document_.GetVisualCharsInPiece(*it);
       queue.push({string.substr(0, start_point), false});
       if (line == selection_end.line && column <= selection_end.column &&
           selection_end.column < column + char_count) {
         // I_Pieceɂꍇ
-        int end_point = selection_end.column - column;
+        const std::size_t end_point =
+            static_cast<std::size_t>(selection_end.column - column);
         queue.push({string.substr(start_point, end_point - start_point), true});
         queue.push({string.substr(end_point), false});
       } else {
@@ -151,7 +155,8 @@ void EditWindow::DrawLines() {
     } else if (in_selection) {
       if (line == selection_end.line && column <= selection_end.column &&
           selection_end.column < column + char_count) {
-        int end_point = selection_end.column - column;
+        const std::size_t end_point =
+            static_cast<std::size_t>(selection_end.column - column);
         std::wstring_view string = document_.GetCharsInPiece(*it);
         queue.push({string.substr(0, end_point), true});
         queue.push({string.substr(end_point), false});
@@ -166,9 +171,9 @@ void EditWindow::DrawLines() {
     while (!queue.empty()) {
       DrawStringOperation& op = queue.front();
       if (!op.text.empty()) {
-        x_offset +=
-            DrawString(op.text, x_offset, line_height * line,
-                       op.selected ? selection_background_brush_ : nullptr);
+        x_offset += DrawString(
+            op.text, x_offset, line_height * static_cast<float>(line),
+            op.selected ? selection_background_brush_ : nullptr);
       }
       queue.pop();
     }
@@ -230,37 +235,50 @@ float EditWindow::MeasureStringWidth(std::wstring_view string) {
   return MeasureGlyphIndicesWidth(glyph_indices.get(), string.size());
 }
 
-void EditWindow::UpdateCaretPosition() {
-  const float line_height = DesignUnitsToWindowCoordinates(
-      font_metrics_.ascent + font_metrics_.descent + font_metrics_.lineGap);
-  if (selection_.caret_pos.column == 0) {
-    scaled_api_.SetCaretPos(
-        0, static_cast<int>(line_height * selection_.caret_pos.line));
-    return;
-  }
+float EditWindow::MeasureXOfPoint(const SelectionPoint& point) {
+  if (point.column == 0) return 0.0f;
 
-  auto it = document_.FindLine(selection_.caret_pos.line);
-  int offset = 0;
-  std::optional<Piece> piece_before_caret;
+  auto it = document_.FindLine(point.line);
+  std::int64_t offset = 0;
+  std::optional<Piece> piece_before_point;
   for (; it != document_.PieceIteratorEnd(); ++it) {
-    int end_of_current_piece = offset + it->GetCharCount();
-    if (selection_.caret_pos.column == end_of_current_piece) {
-      piece_before_caret = *it;
+    const std::int64_t end_of_current_piece = offset + it->GetCharCount();
+    if (point.column == end_of_current_piece) {
+      piece_before_point = *it;
       break;
     }
-    if (selection_.caret_pos.column < end_of_current_piece) {
-      piece_before_caret = it->Slice(0, selection_.caret_pos.column - offset);
+    if (point.column < end_of_current_piece) {
+      piece_before_point = it->Slice(0, point.column - offset);
       break;
     }
     offset = end_of_current_piece;
   }
-  float x = MeasureStringWidth(document_.GetCharsInPiece(*piece_before_caret));
+  float x = MeasureStringWidth(document_.GetCharsInPiece(*piece_before_point));
   while (it != document_.PieceIteratorBegin() && !(--it)->IsLineBreak()) {
     x += MeasureStringWidth(document_.GetCharsInPiece(*it));
   }
+  return x;
+}
+
+void EditWindow::UpdateCaretPosition() {
+  const float line_height = CalculateLineHeight(font_metrics_, kFontEmSize);
   scaled_api_.SetCaretPos(
-      static_cast<int>(x),
-      static_cast<int>(line_height * selection_.caret_pos.line));
+      static_cast<int>(MeasureXOfPoint(selection_.caret_pos)),
+      static_cast<int>(line_height *
+                       static_cast<float>(selection_.caret_pos.line)));
+}
+
+void EditWindow::DrawSecondaryCarets() {
+  const float line_height = CalculateLineHeight(font_metrics_, kFontEmSize);
+  const MultiSelection::Range& primary = selections_.primary();
+  for (const MultiSelection::Range& range : selections_.ranges()) {
+    if (&range == &primary) continue;
+    const LineColumn caret = document_.ToLineColumn(range.caret);
+    const float x = MeasureXOfPoint(SelectionPoint(caret.line, caret.column));
+    const float y = line_height * static_cast<float>(caret.line);
+    render_target_->FillRectangle(
+        D2D1::RectF(x, y, x + 1.0f, y + line_height), text_brush_);
+  }
 }
 
 float EditWindow::DesignUnitsToWindowCoordinates(UINT32 design_unit) {
@@ -273,8 +291,7 @@ void EditWindow::MoveSelectionPointBack(SelectionPoint& point) {
     if (point.line > 0) {
       --point.line;
 
-      point.column = GetCharCountOfLine(document_.FindLine(point.line),
-                                        document_.PieceIteratorEnd());
+      point.column = document_.GetCharCountOfLine(point.line);
     }
   } else {
     --point.column;
@@ -282,11 +299,8 @@ void EditWindow::MoveSelectionPointBack(SelectionPoint& point) {
 }
 
 void EditWindow::MoveSelectionPointForward(SelectionPoint& point) {
-  auto it = document_.FindLine(point.line);
-  auto end = document_.PieceIteratorEnd();
-  if (point.column == GetCharCountOfLine(it, end)) {
-    AdvanceByLine(it, 1, end);
-    if (it != end) {
+  if (point.column == document_.GetCharCountOfLine(point.line)) {
+    if (point.line + 1 < document_.GetLineCount()) {
       ++point.line;
       point.column = 0;
     }
@@ -295,7 +309,108 @@ void EditWindow::MoveSelectionPointForward(SelectionPoint& point) {
   }
 }
 
-void EditWindow::DeleteSelectedText() {}
+void EditWindow::DeleteSelectedText() {
+  WillEditSelections();
+  selections_.EraseSelectedText(document_);
+  DidEditSelections();
+}
+
+void EditWindow::ClampSelectionPoint(SelectionPoint& point) {
+  point.line = std::min(point.line, document_.GetLineCount() - 1);
+  point.column =
+      std::min(point.column, document_.GetCharCountOfLine(point.line));
+}
+
+void EditWindow::Undo() {
+  if (!document_.CanUndo()) return;
+  document_.Undo();
+  selections_.RemoveSecondary();
+  ClampSelectionPoint(selection_.caret_pos);
+  ClampSelectionPoint(selection_.anchor);
+  InvalidateRect(hwnd(), nullptr, FALSE);
+  UpdateCaretPosition();
+}
+
+void EditWindow::Redo() {
+  if (!document_.CanRedo()) return;
+  document_.Redo();
+  selections_.RemoveSecondary();
+  ClampSelectionPoint(selection_.caret_pos);
+  ClampSelectionPoint(selection_.anchor);
+  InvalidateRect(hwnd(), nullptr, FALSE);
+  UpdateCaretPosition();
+}
+
+MultiSelection::Range EditWindow::ToRange(const Selection& selection) const {
+  return {document_.ToOffset(selection.anchor.line, selection.anchor.column),
+          document_.ToOffset(selection.caret_pos.line,
+                             selection.caret_pos.column)};
+}
+
+Selection EditWindow::ToSelection(const MultiSelection::Range& range) const {
+  const LineColumn caret = document_.ToLineColumn(range.caret);
+  const LineColumn anchor = document_.ToLineColumn(range.anchor);
+  return Selection(SelectionPoint(caret.line, caret.column),
+                   SelectionPoint(anchor.line, anchor.column));
+}
+
+void EditWindow::WillEditSelections() {
+  selections_.SetPrimary(ToRange(selection_));
+}
+
+void EditWindow::DidEditSelections() {
+  selection_ = ToSelection(selections_.primary());
+  InvalidateRect(hwnd(), nullptr, FALSE);
+  UpdateCaretPosition();
+}
+
+void EditWindow::AddCaretOnAdjacentLine(int delta) {
+  SelectionPoint point = selection_.caret_pos;
+  point.line += delta;
+  if (point.line < 0 || document_.GetLineCount() <= point.line) return;
+  ClampSelectionPoint(point);
+  WillEditSelections();
+  const std::int64_t offset = document_.ToOffset(point.line, point.column);
+  selections_.Add({offset, offset});
+  DidEditSelections();
+}
+
+void EditWindow::FindNext(bool backward) {
+  const MultiSelection::Range range = ToRange(selection_);
+  if (!range.IsEmpty()) {
+    const auto length = static_cast<std::size_t>(range.end() - range.start());
+    std::wstring pattern;
+    TextCursor cursor(document_.Snapshot(), range.start());
+    while (pattern.size() < length) {
+      const std::wstring_view chunk = cursor.NextChunk();
+      pattern.append(chunk.substr(0, length - pattern.size()));
+    }
+    if (!match_index_ || pattern != search_pattern_) {
+      search_pattern_ = std::move(pattern);
+      match_index_ =
+          std::make_unique<MatchIndex>(document_, search_pattern_, true);
+    }
+  }
+  if (!match_index_) return;
+  std::int64_t found;
+  if (backward) {
+    // The last match which ends at or before the selection.
+    found = match_index_->FindPrevious(
+        std::max<std::int64_t>(range.start() - match_index_->length() + 1,
+                               0));
+    if (found < 0) {
+      found = match_index_->FindPrevious(document_.GetCharCount());
+    }
+  } else {
+    found = match_index_->FindNext(range.end());
+    if (found < 0) found = match_index_->FindNext(0);
+  }
+  if (found < 0) return;
+  selections_.RemoveSecondary();
+  selection_ = ToSelection({found, found + match_index_->length()});
+  InvalidateRect(hwnd(), nullptr, FALSE);
+  UpdateCaretPosition();
+}
 
 void EditWindow::OnSetFocus() {
   int kCaretWidth = 1;
@@ -318,6 +433,7 @@ void EditWindow::OnPaint() {
   render_target_->Clear(D2D1::ColorF(D2D1::ColorF::FloralWhite, 1.0f));
 
   DrawLines();
+  DrawSecondaryCarets();
 
   HRESULT hr = render_target_->EndDraw();
   if (hr == D2DERR_RECREATE_TARGET) {
@@ -331,32 +447,26 @@ void EditWindow::OnPaint() {
 void EditWindow::OnKeyDown(char key) {
   switch (key) {
     case VK_BACK: {
-      if (selection_.HasRange()) {
-        DeleteSelectedText();
-      } else {
-        if (selection_.caret_pos == SelectionPoint(0, 0)) return;
-        MoveSelectionPointBack(selection_.caret_pos);
-        selection_.anchor = selection_.caret_pos;
-        document_.EraseCharAt(selection_.caret_pos.line,
-                              selection_.caret_pos.column);
-        InvalidateRect(hwnd(), nullptr, FALSE);
-        UpdateCaretPosition();
-      }
+      WillEditSelections();
+      selections_.EraseBackward(document_);
+      DidEditSelections();
       return;
     }
     case VK_RETURN: {
-      if (selection_.HasRange()) {
-      } else {
-        document_.InsertLineBreakBefore(selection_.caret_pos.line,
-                                        selection_.caret_pos.column);
-        selection_.SetCaretAndAnchorLine(selection_.caret_pos.line + 1);
-        selection_.SetCaretAndAnchorColumn(0);
-        InvalidateRect(hwnd(), nullptr, FALSE);
-        UpdateCaretPosition();
+      WillEditSelections();
+      selections_.InsertText(document_, L"\n");
+      DidEditSelections();
+      return;
+    }
+    case VK_UP:
+    case VK_DOWN: {
+      if (IsKeyPressed(VK_CONTROL) && IsKeyPressed(VK_MENU)) {
+        AddCaretOnAdjacentLine(key == VK_UP ? -1 : 1);
       }
       return;
     }
     case VK_LEFT: {
+      selections_.RemoveSecondary();
       if (IsKeyPressed(VK_SHIFT)) {
         MoveSelectionPointBack(selection_.anchor);
         InvalidateRect(hwnd(), nullptr, FALSE);
@@ -368,6 +478,7 @@ void EditWindow::OnKeyDown(char key) {
       return;
     }
     case VK_RIGHT: {
+      selections_.RemoveSecondary();
       if (IsKeyPressed(VK_SHIFT)) {
         MoveSelectionPointForward(selection_.anchor);
         InvalidateRect(hwnd(), nullptr, FALSE);
@@ -378,46 +489,33 @@ void EditWindow::OnKeyDown(char key) {
       }
       return;
     }
+    case VK_F3: {
+      FindNext(IsKeyPressed(VK_SHIFT));
+      return;
+    }
+    case 'Z': {
+      if (IsKeyPressed(VK_CONTROL)) Undo();
+      return;
+    }
+    case 'Y': {
+      if (IsKeyPressed(VK_CONTROL)) Redo();
+      return;
+    }
     case VK_DELETE: {
-      if (selection_.HasRange()) {
-        SelectionPoint point1, point2;
-        if (selection_.caret_pos <= selection_.anchor) {
-          point1 = selection_.caret_pos;
-          point2 = selection_.anchor;
-        } else {
-          point1 = selection_.anchor;
-          point2 = selection_.caret_pos;
-        }
-        document_.EraseCharsInRange(point1.line, point1.column, point2.line,
-                                    point2.column);
-        selection_.SetCaretAndAnchorLine(point1.line);
-        selection_.SetCaretAndAnchorColumn(point1.column);
-        InvalidateRect(hwnd(), nullptr, FALSE);
-        UpdateCaretPosition();
-      } else {
-        if (selection_.caret_pos.line == document_.GetLineCount() - 1) {
-          auto it = document_.FindLine(selection_.caret_pos.line);
-          auto end = document_.PieceIteratorEnd();
-          if (selection_.caret_pos.column == GetCharCountOfLine(it, end))
-            return;
-        }
-        document_.EraseCharAt(selection_.caret_pos.line,
-                              selection_.caret_pos.column);
-        InvalidateRect(hwnd(), nullptr, FALSE);
-        UpdateCaretPosition();
-      }
+      WillEditSelections();
+      selections_.EraseForward(document_);
+      DidEditSelections();
       return;
     }
   }
 }
 
 void EditWindow::OnChar(wchar_t ch) {
-  if (ch == 0x08 || ch == 0x0d) return;
-  document_.InsertCharBefore(ch, selection_.caret_pos.line,
-                             selection_.caret_pos.column);
-  selection_.SetCaretAndAnchorColumn(selection_.caret_pos.column + 1);
-  InvalidateRect(hwnd(), nullptr, FALSE);
-  UpdateCaretPosition();
+  // Backspace, Enter, Ctrl+Y and Ctrl+Z are handled in OnKeyDown.
+  if (ch == 0x08 || ch == 0x0d || ch == 0x19 || ch == 0x1a) return;
+  WillEditSelections();
+  selections_.InsertText(document_, std::wstring_view(&ch, 1));
+  DidEditSelections();
 }
 
 LRESULT EditWindow::WindowProcedure(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp) {
@@ -5,22 +5,27 @@
 #include <comdef.h>
 #include <d2d1.h>
 
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <string_view>
 
 #include "comptr_typedef.h"
 #include "document.h"
+#include "match_index.h"
+#include "multi_selection.h"
 #include "util.h"
 #include "window_base.h"
 
 namespace wiese {
 
 struct SelectionPoint {
-  int line;
-  int column;
+  std::int64_t line;
+  std::int64_t column;
 
   SelectionPoint() : line(0), column(0) {}
-  SelectionPoint(int line, int column) : line(line), column(column) {}
+  SelectionPoint(std::int64_t line, std::int64_t column)
+      : line(line), column(column) {}
   bool operator==(const SelectionPoint& rhs) const {
     return line == rhs.line && column == rhs.column;
   }
@@ -44,8 +49,10 @@ struct Selection {
   Selection() : caret_pos(), anchor() {}
   Selection(const SelectionPoint& caret_pos, const SelectionPoint& anchor)
       : caret_pos(caret_pos), anchor(anchor) {}
-  void SetCaretAndAnchorLine(int line) { caret_pos.line = anchor.line = line; }
-  void SetCaretAndAnchorColumn(int column) {
+  void SetCaretAndAnchorLine(std::int64_t line) {
+    caret_pos.line = anchor.line = line;
+  }
+  void SetCaretAndAnchorColumn(std::int64_t column) {
     caret_pos.column = anchor.column = column;
   }
   bool HasRange() const { return caret_pos != anchor; }
@@ -65,12 +72,36 @@ class EditWindow : public WindowBase {
   float DrawString(std::wstring_view text, float x, float y, ID2D1BrushPtr background_brush);
   float MeasureGlyphIndicesWidth(const std::uint16_t* indices, int count);
   float MeasureStringWidth(std::wstring_view string);
+  // Returns the x coordinate of the left edge of the character at |point|.
+  float MeasureXOfPoint(const SelectionPoint& point);
   void UpdateCaretPosition();
+  // The system caret shows the primary selection only; the others are drawn
+  // as thin bars.
+  void DrawSecondaryCarets();
   float DesignUnitsToWindowCoordinates(UINT32 design_unit);
 
   void MoveSelectionPointBack(SelectionPoint& point);
   void MoveSelectionPointForward(SelectionPoint& point);
   void DeleteSelectedText();
+  // Moves |point| back into the document if it is beyond the last line or
+  // the end of its line.
+  void ClampSelectionPoint(SelectionPoint& point);
+  void Undo();
+  void Redo();
+  MultiSelection::Range ToRange(const Selection& selection) const;
+  Selection ToSelection(const MultiSelection::Range& range) const;
+  // Makes |selections_| follow |selection_| before an edit of all the
+  // selections.
+  void WillEditSelections();
+  // Makes |selection_| follow the primary selection after an edit.
+  void DidEditSelections();
+  // Adds a caret |delta| lines below the caret, e.g. -1 for the line above,
+  // and makes it the primary one.
+  void AddCaretOnAdjacentLine(int delta);
+  // Selects the next (or previous) occurrence of the selected text, or of
+  // the text searched for last if nothing is selected, wrapping around at
+  // the end of the document. Case is ignored.
+  void FindNext(bool backward);
 
   void OnSetFocus();
   void OnKillFocus();
@@ -96,6 +127,14 @@ class EditWindow : public WindowBase {
 
   Document document_;
   Selection selection_;
+  // All the selections, including the one |selection_| holds as line/column
+  // pairs. Typing and deleting edit every one of them.
+  MultiSelection selections_;
+  std::wstring search_pattern_;
+  // Matches of |search_pattern_|, kept up to date as the document is edited
+  // so that moving to the next one is O(log n). Declared after |document_|,
+  // which it observes.
+  std::unique_ptr<MatchIndex> match_index_;
 };
 
 }  // namespace wiese
@@ -0,0 +1,48 @@
+#include "file_follower.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+namespace wiese {
+
+FileFollower::FileFollower(Document& document, std::filesystem::path path,
+                           Truncation truncation)
+    : document_(document),
+      path_(std::move(path)),
+      offset_(document.GetOriginalFileSize()),
+      following_(true) {
+  if (truncation == Truncation::kExpected) document_.ReleaseOriginalFile();
+}
+
+std::size_t FileFollower::Poll() {
+  // Throws std::filesystem::filesystem_error, a std::system_error.
+  if (!following_) return 0;
+  const std::uintmax_t size = std::filesystem::file_size(path_);
+  if (size < offset_) {
+    following_ = false;
+    return 0;
+  }
+  const std::uintmax_t unit_count = (size - offset_) / sizeof(wchar_t);
+  if (unit_count == 0) return 0;
+  buffer_.resize(static_cast<std::size_t>(unit_count));
+  std::ifstream file(path_, std::ios::binary);
+  file.seekg(static_cast<std::streamoff>(offset_));
+  file.read(reinterpret_cast<char*>(&buffer_[0]),
+            static_cast<std::streamsize>(buffer_.size() * sizeof(wchar_t)));
+  if (!file) {
+    throw std::system_error(std::make_error_code(std::errc::io_error),
+                            "read");
+  }
+  std::wstring_view text = buffer_;
+  if (text.back() == L'\r') text.remove_suffix(1);
+  document_.AppendFileText(text);
+  offset_ += text.size() * sizeof(wchar_t);
+  return text.size();
+}
+
+}  // namespace wiese
@@ -0,0 +1,72 @@
+#ifndef WIESE_FILE_FOLLOWER_H_
+#define WIESE_FILE_FOLLOWER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "document.h"
+
+namespace wiese {
+
+// Keeps a document up to date with the file it was read from while the file
+// grows, such as a log being written. Every Poll reads only the bytes the
+// file has grown by and appends them with Document::AppendFileText, so
+// following a file costs O(new bytes) however large it is.
+//
+// The file is opened for every Poll and closed again, so that the program
+// writing it can rotate or delete it. A document read with TextStorage::kWide
+// keeps the file mapped, though, and reads the text it started with from the
+// mapping; what happens when the file is truncated or rewritten in place
+// under it then depends on the system (on POSIX, reading a page beyond the
+// new end raises SIGBUS; Windows refuses to truncate a mapped file). A
+// program which may do that to the file must be followed with
+// Truncation::kExpected.
+class FileFollower {
+ public:
+  enum class Truncation {
+    // The file only grows while it is followed. Following costs nothing
+    // beyond the new data.
+    kNotExpected,
+    // The file may be truncated, rotated or rewritten. The document copies
+    // its original text out of the mapping when following starts (see
+    // Document::ReleaseOriginalFile), which takes O(n) time and as much
+    // memory as the text, e.g. gigabytes for a large log.
+    kExpected,
+  };
+
+  // Follows |path| from the end of what |document|, which must have been read
+  // from it, holds.
+  FileFollower(Document& document, std::filesystem::path path,
+               Truncation truncation = Truncation::kNotExpected);
+  FileFollower(const FileFollower&) = delete;
+  FileFollower& operator=(const FileFollower&) = delete;
+
+  // Appends what the file has grown by since the last call to the document
+  // and returns the number of wchar_t units read. Bytes which do not make a
+  // whole unit yet, and an L'\r' at the end which may be the first half of a
+  // CRLF, are left for the next call. If the file shrank, e.g. because it
+  // was truncated when a log was rotated, the text read so far is no longer
+  // what the file holds, so following stops and this returns 0 from then on.
+  // Throws std::system_error if the file cannot be read.
+  std::size_t Poll();
+
+  // False once the file was found to have shrunk.
+  bool IsFollowing() const { return following_; }
+
+  // Number of bytes of the file in the document.
+  std::uintmax_t offset() const { return offset_; }
+
+ private:
+  Document& document_;
+  const std::filesystem::path path_;
+  std::uintmax_t offset_;
+  bool following_;
+  // What was read last, kept to save allocating it for every Poll.
+  std::wstring buffer_;
+};
+
+}  // namespace wiese
+
+#endif
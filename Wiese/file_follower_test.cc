@@ -0,0 +1,136 @@
+#include "file_follower.h"
+
+#include "gtest/gtest.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "document.h"
+
+namespace {
+
+class FileFollowerTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = std::filesystem::temp_directory_path() /
+            (std::string("wiese_") +
+             testing::UnitTest::GetInstance()->current_test_info()->name() +
+             ".txt");
+    WriteFile(L"");
+  }
+  void TearDown() override { std::filesystem::remove(path_); }
+
+  void WriteFile(std::wstring_view text) {
+    std::ofstream file(path_, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(text.data()),
+               text.size() * sizeof(wchar_t));
+  }
+  void AppendToFile(std::wstring_view text) {
+    AppendBytes(reinterpret_cast<const char*>(text.data()),
+                text.size() * sizeof(wchar_t));
+  }
+  void AppendBytes(const char* bytes, std::size_t count) {
+    std::ofstream file(path_, std::ios::binary | std::ios::app);
+    file.write(bytes, count);
+  }
+
+  std::filesystem::path path_;
+};
+
+}  // namespace
+
+TEST_F(FileFollowerTest, Poll) {
+  WriteFile(L"\xfeff" L"a\nb");
+  wiese::Document doc(path_);
+  wiese::FileFollower follower(doc, path_);
+  EXPECT_EQ(4 * sizeof(wchar_t), follower.offset());
+  EXPECT_EQ(0u, follower.Poll());
+  AppendToFile(L"c\nd\n");
+  EXPECT_EQ(4u, follower.Poll());
+  EXPECT_EQ(L"a\nbc\nd\n", doc.GetText());
+  EXPECT_EQ(4, doc.GetLineCount());
+  EXPECT_EQ(8 * sizeof(wchar_t), follower.offset());
+  EXPECT_EQ(0u, follower.Poll());
+}
+
+TEST_F(FileFollowerTest, Poll_HoldsBackCarriageReturn) {
+  WriteFile(L"a\r\n");
+  wiese::Document doc(path_);
+  wiese::FileFollower follower(doc, path_);
+  AppendToFile(L"b\r");
+  EXPECT_EQ(1u, follower.Poll());
+  EXPECT_EQ(L"a\nb", doc.GetText());
+  AppendToFile(L"\nc\r");
+  // The L'\r' held back is read again.
+  EXPECT_EQ(3u, follower.Poll());
+  EXPECT_EQ(L"a\nb\nc", doc.GetText());
+  EXPECT_EQ(3, doc.GetLineCount());
+  auto it = doc.PieceIteratorEnd();
+  std::advance(it, -2);
+  EXPECT_EQ(wiese::LineEnding::kCrLf, it->line_ending());
+}
+
+TEST_F(FileFollowerTest, Poll_HoldsBackPartialUnit) {
+  wiese::Document doc(path_);
+  wiese::FileFollower follower(doc, path_);
+  const std::wstring_view text = L"ab";
+  const char* bytes = reinterpret_cast<const char*>(text.data());
+  AppendBytes(bytes, sizeof(wchar_t) + 1);
+  EXPECT_EQ(1u, follower.Poll());
+  EXPECT_EQ(L"a", doc.GetText());
+  AppendBytes(bytes + sizeof(wchar_t) + 1, sizeof(wchar_t) - 1);
+  EXPECT_EQ(1u, follower.Poll());
+  EXPECT_EQ(L"ab", doc.GetText());
+}
+
+TEST_F(FileFollowerTest, Poll_KeepsSnapshotsAndUndo) {
+  WriteFile(L"a\n");
+  wiese::Document doc(path_);
+  wiese::FileFollower follower(doc, path_);
+  doc.InsertCharBefore(L'x', 0);
+  auto snapshot = doc.Snapshot();
+  AppendToFile(L"b");
+  EXPECT_EQ(1u, follower.Poll());
+  EXPECT_EQ(L"xa\nb", doc.GetText());
+  EXPECT_EQ(L"xa\n", snapshot->GetText());
+  // What was read is not undone with the edit before it.
+  doc.Undo();
+  EXPECT_EQ(L"a\nb", doc.GetText());
+  EXPECT_FALSE(doc.CanUndo());
+  doc.Redo();
+  EXPECT_EQ(L"xa\nb", doc.GetText());
+}
+
+TEST_F(FileFollowerTest, Poll_AfterUndoMatchesTheFile) {
+  WriteFile(L"a\n");
+  wiese::Document doc(path_);
+  wiese::FileFollower follower(doc, path_);
+  doc.InsertCharBefore(L'x', 0);
+  AppendToFile(L"b\n");
+  EXPECT_EQ(2u, follower.Poll());
+  doc.Undo();
+  AppendToFile(L"c\n");
+  EXPECT_EQ(2u, follower.Poll());
+  EXPECT_EQ(L"a\nb\nc\n", doc.GetText());
+}
+
+TEST_F(FileFollowerTest, Poll_StopsWhenFileShrinks) {
+  std::wstring text;
+  for (int i = 0; i < 10000; ++i) text += L"line\n";
+  WriteFile(text);
+  // The document maps the file, which is then truncated under it.
+  wiese::Document doc(path_);
+  wiese::FileFollower follower(doc, path_,
+                               wiese::FileFollower::Truncation::kExpected);
+  WriteFile(L"a");
+  EXPECT_EQ(0u, follower.Poll());
+  EXPECT_FALSE(follower.IsFollowing());
+  EXPECT_EQ(text, doc.GetText());
+  EXPECT_EQ(text, doc.Snapshot()->GetText());
+  AppendToFile(std::wstring(text.size(), L'x'));
+  EXPECT_EQ(0u, follower.Poll());
+  EXPECT_EQ(text, doc.GetText());
+}
@@ -0,0 +1,308 @@
+#include "file_saver.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include "text_cursor.h"
+
+namespace wiese {
+
+namespace {
+
+#ifdef _WIN32
+
+[[noreturn]] void ThrowLastError(const char* what) {
+  throw std::system_error(static_cast<int>(GetLastError()),
+                          std::system_category(), what);
+}
+
+// File opened for writing from the start, closed when destroyed.
+class OutputFile {
+ public:
+  explicit OutputFile(const std::filesystem::path& path) {
+    file_ = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                        nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) ThrowLastError("CreateFileW");
+  }
+  OutputFile(const OutputFile&) = delete;
+  OutputFile& operator=(const OutputFile&) = delete;
+  ~OutputFile() {
+    if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+  }
+
+  // Writes the |count| blocks in |blocks| one after another. Windows can only
+  // gather page-aligned blocks into unbuffered files, so every block is one
+  // large write.
+  void Write(const std::string_view* blocks, int count) {
+    for (int i = 0; i < count; ++i) {
+      const char* data = blocks[i].data();
+      std::size_t size = blocks[i].size();
+      while (size > 0) {
+        const DWORD chunk =
+            static_cast<DWORD>(std::min<std::size_t>(size, 1u << 30));
+        DWORD written;
+        if (!WriteFile(file_, data, chunk, &written, nullptr)) {
+          ThrowLastError("WriteFile");
+        }
+        data += written;
+        size -= written;
+      }
+    }
+  }
+
+  // ReplaceFileW gives the new file the attributes and security of the old
+  // one (see RenameOver).
+  void CopyModeAndOwner(const std::filesystem::path&) {}
+
+  // Flushes the file to disk and closes it.
+  void Close() {
+    if (!FlushFileBuffers(file_)) ThrowLastError("FlushFileBuffers");
+    const HANDLE file = file_;
+    file_ = INVALID_HANDLE_VALUE;
+    if (!CloseHandle(file)) ThrowLastError("CloseHandle");
+  }
+
+ private:
+  HANDLE file_;
+};
+
+// Unlike MoveFileExW, ReplaceFileW keeps the attributes, security and
+// streams of |to|, and works while a document has |to| mapped (MappedFile
+// shares it for deletion).
+void RenameOver(const std::filesystem::path& from,
+                const std::filesystem::path& to) {
+  if (ReplaceFileW(to.c_str(), from.c_str(), nullptr,
+                   REPLACEFILE_IGNORE_MERGE_ERRORS, nullptr, nullptr)) {
+    return;
+  }
+  if (GetLastError() != ERROR_FILE_NOT_FOUND) ThrowLastError("ReplaceFileW");
+  if (!MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_WRITE_THROUGH)) {
+    ThrowLastError("MoveFileExW");
+  }
+}
+
+#else
+
+[[noreturn]] void ThrowErrno(const char* what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+// File opened for writing from the start, closed when destroyed.
+class OutputFile {
+ public:
+  explicit OutputFile(const std::filesystem::path& path) {
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd_ < 0) ThrowErrno("open");
+  }
+  OutputFile(const OutputFile&) = delete;
+  OutputFile& operator=(const OutputFile&) = delete;
+  ~OutputFile() {
+    if (fd_ >= 0) close(fd_);
+  }
+
+  // Writes the |count| blocks in |blocks| one after another with as few
+  // writev calls as the kernel allows.
+  void Write(const std::string_view* blocks, int count) {
+    std::array<iovec, kSaveBufferCount> vectors;
+    int vector_count = 0;
+    for (int i = 0; i < count && i < kSaveBufferCount; ++i) {
+      if (blocks[i].empty()) continue;
+      vectors[vector_count].iov_base = const_cast<char*>(blocks[i].data());
+      vectors[vector_count].iov_len = blocks[i].size();
+      ++vector_count;
+    }
+    iovec* next = vectors.data();
+    while (vector_count > 0) {
+      ssize_t written = writev(fd_, next, vector_count);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        ThrowErrno("writev");
+      }
+      // Skips what was written, which may end in the middle of a block.
+      while (vector_count > 0 &&
+             static_cast<std::size_t>(written) >= next->iov_len) {
+        written -= next->iov_len;
+        ++next;
+        --vector_count;
+      }
+      if (vector_count > 0) {
+        next->iov_base = static_cast<char*>(next->iov_base) + written;
+        next->iov_len -= written;
+      }
+    }
+  }
+
+  // Gives the file the mode and owner of |original|, if it exists, since
+  // replacing |original| would reset them to the defaults. Only a privileged
+  // process may give a file to another user, so the owner is kept if it
+  // cannot be changed; the group is then tried on its own.
+  void CopyModeAndOwner(const std::filesystem::path& original) {
+    struct stat status;
+    if (stat(original.c_str(), &status) < 0) {
+      if (errno == ENOENT) return;
+      ThrowErrno("stat");
+    }
+    // Changing the owner clears the set-user-ID bits, so it goes first.
+    if (fchown(fd_, status.st_uid, status.st_gid) < 0) {
+      if (errno != EPERM) ThrowErrno("fchown");
+      if (fchown(fd_, static_cast<uid_t>(-1), status.st_gid) < 0 &&
+          errno != EPERM) {
+        ThrowErrno("fchown");
+      }
+    }
+    if (fchmod(fd_, status.st_mode & 07777) < 0) ThrowErrno("fchmod");
+  }
+
+  // Flushes the file to disk and closes it.
+  void Close() {
+    if (fsync(fd_) < 0) ThrowErrno("fsync");
+    const int fd = fd_;
+    fd_ = -1;
+    if (close(fd) < 0) ThrowErrno("close");
+  }
+
+ private:
+  int fd_;
+};
+
+// Flushes the entries of |directory| to disk, so that a rename in it is.
+void SyncDirectory(const std::filesystem::path& directory) {
+  const int fd = open(directory.empty() ? "." : directory.c_str(),
+                      O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) ThrowErrno("open");
+  if (fsync(fd) < 0) {
+    const int error = errno;
+    close(fd);
+    throw std::system_error(error, std::generic_category(), "fsync");
+  }
+  if (close(fd) < 0) ThrowErrno("close");
+}
+
+void RenameOver(const std::filesystem::path& from,
+                const std::filesystem::path& to) {
+  if (rename(from.c_str(), to.c_str()) < 0) ThrowErrno("rename");
+  SyncDirectory(to.parent_path());
+}
+
+#endif
+
+// The save buffers. Encoded text is added to the current buffer; when one is
+// full the next one is used, and when all of them are, they are written to
+// the file together and used again from the first one.
+class SaveBuffers {
+ public:
+  explicit SaveBuffers(OutputFile& file)
+      : file_(file), current_(0), sizes_{} {
+    for (auto& buffer : buffers_) {
+      buffer = std::make_unique<char[]>(kSaveBufferSize);
+    }
+  }
+
+  // Free space in the current buffer.
+  char* room() { return buffers_[current_].get() + sizes_[current_]; }
+  std::size_t room_size() const { return kSaveBufferSize - sizes_[current_]; }
+  // Makes sure the current buffer has at least |size| bytes of room.
+  void Reserve(std::size_t size) {
+    if (room_size() >= size) return;
+    if (++current_ == kSaveBufferCount) Flush();
+  }
+  // Adds the |size| bytes written to room().
+  void Commit(std::size_t size) { sizes_[current_] += size; }
+  // Writes every buffer to the file and empties them.
+  void Flush() {
+    std::array<std::string_view, kSaveBufferCount> blocks;
+    for (int i = 0; i < kSaveBufferCount; ++i) {
+      blocks[i] = {buffers_[i].get(), sizes_[i]};
+    }
+    file_.Write(blocks.data(), kSaveBufferCount);
+    sizes_.fill(0);
+    current_ = 0;
+  }
+
+ private:
+  OutputFile& file_;
+  std::array<std::unique_ptr<char[]>, kSaveBufferCount> buffers_;
+  int current_;
+  std::array<std::size_t, kSaveBufferCount> sizes_;
+};
+
+void WriteText(const std::shared_ptr<const DocumentSnapshot>& snapshot,
+               OutputFile& file, TextEncoding encoding) {
+  SaveBuffers buffers(file);
+  if (encoding == TextEncoding::kUtf16Le) {
+    buffers.room()[0] = '\xFF';
+    buffers.room()[1] = '\xFE';
+    buffers.Commit(2);
+  }
+  TextEncoder encoder(encoding);
+  TextCursor cursor(snapshot, 0);
+  while (!cursor.AtEnd()) {
+    std::wstring_view run = cursor.NextRawRun();
+    while (!run.empty()) {
+      buffers.Reserve(TextEncoder::MaxEncodedSize(1));
+      // As many characters as surely fit into the current buffer, so that
+      // MaxEncodedSize(count) <= room_size().
+      const std::size_t count = std::min(
+          run.size(),
+          (buffers.room_size() - TextEncoder::MaxEncodedSize(0)) / 4);
+      buffers.Commit(encoder.Encode(run.substr(0, count), buffers.room()));
+      run.remove_prefix(count);
+    }
+  }
+  buffers.Reserve(TextEncoder::MaxEncodedSize(0));
+  buffers.Commit(encoder.Finish(buffers.room()));
+  buffers.Flush();
+}
+
+}  // namespace
+
+void SaveSnapshot(const std::shared_ptr<const DocumentSnapshot>& snapshot,
+                  const std::filesystem::path& path, TextEncoding encoding) {
+  // Saving through a symbolic link replaces the file it points to, which the
+  // temporary file must be next to, and keeps the link.
+  const std::filesystem::path target =
+      std::filesystem::is_symlink(path)
+          ? std::filesystem::weakly_canonical(path)
+          : path;
+  std::filesystem::path temporary_path = target;
+  temporary_path += L".wiese-save";
+  try {
+    OutputFile file(temporary_path);
+    file.CopyModeAndOwner(target);
+    WriteText(snapshot, file, encoding);
+    file.Close();
+    RenameOver(temporary_path, target);
+  } catch (...) {
+    std::error_code ignored;
+    std::filesystem::remove(temporary_path, ignored);
+    throw;
+  }
+}
+
+std::future<void> SaveSnapshotInBackground(
+    std::shared_ptr<const DocumentSnapshot> snapshot,
+    std::filesystem::path path, TextEncoding encoding) {
+  return std::async(std::launch::async,
+                    [snapshot = std::move(snapshot), path = std::move(path),
+                     encoding] { SaveSnapshot(snapshot, path, encoding); });
+}
+
+}  // namespace wiese
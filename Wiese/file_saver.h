@@ -0,0 +1,43 @@
+#ifndef WIESE_FILE_SAVER_H_
+#define WIESE_FILE_SAVER_H_
+
+#include <cstddef>
+#include <filesystem>
+#include <future>
+#include <memory>
+
+#include "document_snapshot.h"
+#include "text_encoder.h"
+
+namespace wiese {
+
+// Size and number of the buffers the text is encoded into on its way to the
+// file. They are all the memory a save needs, whatever the size of the text.
+constexpr std::size_t kSaveBufferSize = std::size_t{1} << 20;
+constexpr int kSaveBufferCount = 4;
+
+// Writes the text of |snapshot| to |path| in |encoding|, UTF-16LE with a byte
+// order mark. The pieces are read in place and encoded a run at a time into
+// the save buffers, which are written out together with one gathering write
+// whenever they are full, so the text is never copied as a whole. Every line
+// break is written with its own line ending (see LineEnding).
+//
+// The text goes to a temporary file next to |path|, which is flushed to disk
+// and renamed over |path| at the end, so |path| holds either the old or the
+// new text even if saving fails half way, and the rename is flushed as well.
+// The new file keeps the mode and owner (on Windows, the attributes and
+// security) of the old one, and if |path| is a symbolic link, the file it
+// points to is replaced. Throws std::system_error.
+void SaveSnapshot(const std::shared_ptr<const DocumentSnapshot>& snapshot,
+                  const std::filesystem::path& path, TextEncoding encoding);
+
+// Runs SaveSnapshot on a thread of its own, so that the editor can go on
+// while the file is written. The future rethrows what SaveSnapshot threw;
+// destroying it waits for the save to end.
+std::future<void> SaveSnapshotInBackground(
+    std::shared_ptr<const DocumentSnapshot> snapshot,
+    std::filesystem::path path, TextEncoding encoding);
+
+}  // namespace wiese
+
+#endif
@@ -0,0 +1,88 @@
+// Benchmarks for saving. They are disabled by default; run them with
+// --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*.
+
+#include "file_saver.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "document.h"
+#include "text_encoder.h"
+
+namespace {
+
+constexpr std::size_t kInputBytes = std::size_t{1} << 28;
+constexpr int kLineLength = 80;
+// Distance between the characters inserted to break the text into pieces.
+constexpr int kPieceLength = 4096;
+
+// Returns a document of kInputBytes whose text is split into pieces of about
+// kPieceLength characters from both buffers, plus the line breaks.
+const wiese::Document& GetDocument() {
+  static const std::unique_ptr<wiese::Document> document = [] {
+    std::wstring text(kInputBytes / sizeof(wchar_t), L'x');
+    for (std::size_t i = kLineLength; i < text.size(); i += kLineLength + 1) {
+      text[i] = L'\n';
+    }
+    auto document = std::make_unique<wiese::Document>(text.c_str());
+    std::vector<wiese::Edit> edits;
+    for (std::size_t i = 0; i < text.size(); i += kPieceLength) {
+      const int position = static_cast<int>(i);
+      edits.push_back({position, position + 1, L"\u3042"});
+    }
+    document->ApplyEdits(std::move(edits));
+    return document;
+  }();
+  return *document;
+}
+
+std::filesystem::path GetPath() {
+  return std::filesystem::temp_directory_path() / "wiese_benchmark.txt";
+}
+
+template <typename Function>
+void Measure(const char* name, Function function) {
+  const auto start = std::chrono::steady_clock::now();
+  function();
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  const double gigabytes_per_second =
+      kInputBytes / elapsed.count() / (1 << 30);
+  std::cout << name << ": " << gigabytes_per_second << " GB/s" << std::endl;
+  ::testing::Test::RecordProperty(name, std::to_string(gigabytes_per_second));
+  std::filesystem::remove(GetPath());
+}
+
+}  // namespace
+
+TEST(FileSaverBenchmark, DISABLED_GetTextAndWrite) {
+  auto snapshot = GetDocument().Snapshot();
+  Measure("GetText + std::ofstream", [&] {
+    const std::wstring text = snapshot->GetText();
+    std::ofstream file(GetPath(), std::ios::binary);
+    file.write(reinterpret_cast<const char*>(text.data()),
+               text.size() * sizeof(wchar_t));
+  });
+}
+
+TEST(FileSaverBenchmark, DISABLED_SaveUtf8) {
+  auto snapshot = GetDocument().Snapshot();
+  Measure("SaveSnapshot(UTF-8)", [&] {
+    wiese::SaveSnapshot(snapshot, GetPath(), wiese::TextEncoding::kUtf8);
+  });
+}
+
+TEST(FileSaverBenchmark, DISABLED_SaveUtf16Le) {
+  auto snapshot = GetDocument().Snapshot();
+  Measure("SaveSnapshot(UTF-16LE)", [&] {
+    wiese::SaveSnapshot(snapshot, GetPath(), wiese::TextEncoding::kUtf16Le);
+  });
+}
@@ -0,0 +1,150 @@
+#include "file_saver.h"
+
+#include "gtest/gtest.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "document.h"
+#include "text_encoder.h"
+
+namespace {
+
+class FileSaverTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    directory_ = std::filesystem::temp_directory_path() /
+                 testing::UnitTest::GetInstance()->current_test_info()->name();
+    std::filesystem::create_directories(directory_);
+    path_ = directory_ / "saved.txt";
+  }
+  void TearDown() override { std::filesystem::remove_all(directory_); }
+
+  std::string ReadFile() const {
+    std::ifstream file(path_, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file),
+            std::istreambuf_iterator<char>()};
+  }
+
+  std::filesystem::path directory_;
+  std::filesystem::path path_;
+};
+
+std::string Encode(wiese::TextEncoding encoding, const std::wstring& text) {
+  wiese::TextEncoder encoder(encoding);
+  std::string bytes(wiese::TextEncoder::MaxEncodedSize(text.size()), '\0');
+  const std::size_t size = encoder.Encode(text, &bytes[0]);
+  bytes.resize(size + encoder.Finish(&bytes[size]));
+  return bytes;
+}
+
+}  // namespace
+
+TEST_F(FileSaverTest, SavesUtf8) {
+  wiese::Document doc(L"abc\ndef");
+  doc.InsertStringBefore(L"\u3042\n", 4);
+  wiese::SaveSnapshot(doc.Snapshot(), path_, wiese::TextEncoding::kUtf8);
+  EXPECT_EQ("abc\n\xE3\x81\x82\ndef", ReadFile());
+}
+
+TEST_F(FileSaverTest, SavesUtf16LeWithByteOrderMark) {
+  wiese::Document doc(L"a\nb");
+  wiese::SaveSnapshot(doc.Snapshot(), path_, wiese::TextEncoding::kUtf16Le);
+  EXPECT_EQ(std::string("\xFF\xFE" "a\0\n\0b\0", 8), ReadFile());
+}
+
+TEST_F(FileSaverTest, KeepsLineEndings) {
+  wiese::Document doc(L"a\r\nb\rc\nd\r\n");
+  doc.InsertLineBreakBefore(1);
+  wiese::SaveSnapshot(doc.Snapshot(), path_, wiese::TextEncoding::kUtf8);
+  EXPECT_EQ("a\r\n\r\nb\rc\nd\r\n", ReadFile());
+}
+
+TEST_F(FileSaverTest, SavesTextLargerThanTheBuffers) {
+  std::mt19937 random(1);
+  std::wstring text(3 * wiese::kSaveBufferSize / 2, L'a');
+  for (wchar_t& ch : text) ch = L"ab\n\u00E9\u3042"[random() % 5];
+  wiese::Document doc(text.c_str());
+  // Splits the text into many pieces from both buffers.
+  std::vector<wiese::Edit> edits;
+  for (int i = 0; i < static_cast<int>(text.size()); i += 1000) {
+    edits.push_back({i, i + 1, L"\u3044"});
+    text[i] = L'\u3044';
+  }
+  doc.ApplyEdits(std::move(edits));
+  ASSERT_EQ(text, doc.GetText());
+  for (auto encoding :
+       {wiese::TextEncoding::kUtf8, wiese::TextEncoding::kUtf16Le}) {
+    wiese::SaveSnapshot(doc.Snapshot(), path_, encoding);
+    std::string expected = Encode(encoding, text);
+    if (encoding == wiese::TextEncoding::kUtf16Le) {
+      expected.insert(0, "\xFF\xFE");
+    }
+    EXPECT_EQ(expected, ReadFile());
+  }
+}
+
+TEST_F(FileSaverTest, ReplacesTheFile) {
+  {
+    std::ofstream file(path_);
+    file << "old text which is longer";
+  }
+  wiese::Document doc(L"new");
+  wiese::SaveSnapshot(doc.Snapshot(), path_, wiese::TextEncoding::kUtf8);
+  EXPECT_EQ("new", ReadFile());
+  // Only the file itself is left.
+  EXPECT_EQ(1, std::distance(std::filesystem::directory_iterator(directory_),
+                             std::filesystem::directory_iterator()));
+}
+
+#ifndef _WIN32
+TEST_F(FileSaverTest, KeepsThePermissions) {
+  {
+    std::ofstream file(path_);
+    file << "#!/bin/sh";
+  }
+  const auto permissions = std::filesystem::perms::owner_all |
+                           std::filesystem::perms::group_read |
+                           std::filesystem::perms::group_exec;
+  std::filesystem::permissions(path_, permissions);
+  wiese::Document doc(L"#!/bin/sh\n");
+  wiese::SaveSnapshot(doc.Snapshot(), path_, wiese::TextEncoding::kUtf8);
+  EXPECT_EQ("#!/bin/sh\n", ReadFile());
+  EXPECT_EQ(permissions, std::filesystem::status(path_).permissions());
+}
+
+TEST_F(FileSaverTest, ReplacesTheFileALinkPointsTo) {
+  {
+    std::ofstream file(path_);
+    file << "old";
+  }
+  const std::filesystem::path link = directory_ / "link.txt";
+  std::filesystem::create_symlink(path_, link);
+  wiese::Document doc(L"new");
+  wiese::SaveSnapshot(doc.Snapshot(), link, wiese::TextEncoding::kUtf8);
+  EXPECT_TRUE(std::filesystem::is_symlink(link));
+  EXPECT_EQ("new", ReadFile());
+}
+#endif
+
+TEST_F(FileSaverTest, ThrowsIfTheFileCannotBeWritten) {
+  wiese::Document doc(L"text");
+  EXPECT_THROW(wiese::SaveSnapshot(doc.Snapshot(), directory_ / "no" / "file",
+                                   wiese::TextEncoding::kUtf8),
+               std::system_error);
+}
+
+TEST_F(FileSaverTest, SavesInBackground) {
+  wiese::Document doc(L"saved");
+  std::future<void> saved = wiese::SaveSnapshotInBackground(
+      doc.Snapshot(), path_, wiese::TextEncoding::kUtf8);
+  // Edits do not change the snapshot being saved.
+  doc.InsertStringBefore(L"not ", 0);
+  saved.get();
+  EXPECT_EQ("saved", ReadFile());
+}
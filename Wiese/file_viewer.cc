@@ -0,0 +1,166 @@
+#include "file_viewer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#include "newline_scan.h"
+
+namespace wiese {
+
+namespace {
+
+constexpr wchar_t kByteOrderMark = 0xfeff;
+
+// The thread started by StartIndexing takes this many checkpoints at a time,
+// so that a line asked for on another thread waits for at most this many.
+constexpr std::int64_t kCheckpointsPerBatch = 16;
+
+std::wstring_view GetTextOf(const MappedFile& file) {
+  std::wstring_view text = {static_cast<const wchar_t*>(file.data()),
+                            file.size() / sizeof(wchar_t)};
+  if (!text.empty() && text[0] == kByteOrderMark) text.remove_prefix(1);
+  return text;
+}
+
+}  // namespace
+
+FileViewer::FileViewer(const std::filesystem::path& path,
+                       std::int64_t checkpoint_interval)
+    : file_(path),
+      text_(GetTextOf(file_)),
+      checkpoint_interval_(checkpoint_interval),
+      max_checkpoint_count_(
+          (GetCharCount() + checkpoint_interval - 1) / checkpoint_interval + 1),
+      checkpoints_(std::make_unique<std::int64_t[]>(
+          static_cast<std::size_t>(max_checkpoint_count_))),
+      checkpoint_count_(1),
+      stopping_(false) {
+  assert(checkpoint_interval > 0);
+}
+
+FileViewer::~FileViewer() {
+  stopping_.store(true, std::memory_order_relaxed);
+  if (indexer_.joinable()) indexer_.join();
+}
+
+template <typename Predicate>
+std::int64_t FileViewer::TakeCheckpointsWhile(Predicate needs_more) const {
+  std::int64_t count = checkpoint_count_.load(std::memory_order_acquire);
+  if (count == max_checkpoint_count_ || !needs_more(count - 1)) return count;
+  std::lock_guard<std::mutex> lock(mutex_);
+  count = checkpoint_count_.load(std::memory_order_relaxed);
+  while (count < max_checkpoint_count_ && needs_more(count - 1)) {
+    const std::int64_t line_break_count = CountLineBreaks(
+        OffsetOfCheckpoint(count - 1), OffsetOfCheckpoint(count));
+    Checkpoint(count) = Checkpoint(count - 1) + line_break_count;
+    checkpoint_count_.store(++count, std::memory_order_release);
+  }
+  return count;
+}
+
+void FileViewer::StartIndexing() {
+  if (indexer_.joinable()) return;
+  indexer_ = std::thread([this] {
+    std::int64_t count = checkpoint_count_.load(std::memory_order_acquire);
+    while (count < max_checkpoint_count_ &&
+           !stopping_.load(std::memory_order_relaxed)) {
+      const std::int64_t target = count + kCheckpointsPerBatch;
+      count = TakeCheckpointsWhile(
+          [target](std::int64_t last) { return last + 1 < target; });
+    }
+  });
+}
+
+bool FileViewer::IsIndexed() const {
+  return checkpoint_count_.load(std::memory_order_acquire) ==
+         max_checkpoint_count_;
+}
+
+std::int64_t FileViewer::GetIndexedCharCount() const {
+  return OffsetOfCheckpoint(
+      checkpoint_count_.load(std::memory_order_acquire) - 1);
+}
+
+std::int64_t FileViewer::GetKnownLineCount() const {
+  const std::int64_t count = checkpoint_count_.load(std::memory_order_acquire);
+  return Checkpoint(count - 1) + 1;
+}
+
+std::int64_t FileViewer::GetLineCount() const {
+  const std::int64_t count =
+      TakeCheckpointsWhile([](std::int64_t) { return true; });
+  return Checkpoint(count - 1) + 1;
+}
+
+std::int64_t FileViewer::OffsetOfLine(std::int64_t line) const {
+  assert(0 <= line);
+  if (line == 0) return 0;
+  // Takes checkpoints until one is past the line break in front of |line|.
+  const std::int64_t count = TakeCheckpointsWhile(
+      [this, line](std::int64_t last) { return Checkpoint(last) < line; });
+  if (count == max_checkpoint_count_ && Checkpoint(count - 1) < line) {
+    return -1;
+  }
+  // The last checkpoint with fewer line breaks in front of it than |line|;
+  // the first one has none.
+  const std::int64_t index =
+      std::lower_bound(checkpoints_.get(), checkpoints_.get() + count, line) -
+      checkpoints_.get() - 1;
+  std::int64_t remaining = line - Checkpoint(index);
+  const wchar_t* const last = text_.data() + text_.size();
+  const wchar_t* p = text_.data() + OffsetOfCheckpoint(index);
+  while (true) {
+    p = FindLineEnd(p, last);
+    assert(p != last);
+    // The L'\r' of a CRLF is not a line break of its own; the L'\n' is.
+    if (GetLineEndingAt(p, last) != LineEnding::kCrLf && --remaining == 0) {
+      return p + 1 - text_.data();
+    }
+    ++p;
+  }
+}
+
+std::int64_t FileViewer::LineOfOffset(std::int64_t offset) const {
+  assert(0 <= offset);
+  assert(offset <= GetCharCount());
+  const std::int64_t index = offset / checkpoint_interval_;
+  TakeCheckpointsWhile([index](std::int64_t last) { return last < index; });
+  return Checkpoint(index) +
+         CountLineBreaks(OffsetOfCheckpoint(index), offset);
+}
+
+std::wstring_view FileViewer::GetLine(std::int64_t line) const {
+  const std::int64_t start = OffsetOfLine(line);
+  assert(start >= 0);
+  const wchar_t* const first = text_.data() + start;
+  const wchar_t* const end = FindLineEnd(first, text_.data() + text_.size());
+  return {first, static_cast<std::size_t>(end - first)};
+}
+
+std::int64_t FileViewer::OffsetOfCheckpoint(std::int64_t index) const {
+  return std::min(index * checkpoint_interval_, GetCharCount());
+}
+
+std::int64_t FileViewer::CountLineBreaks(std::int64_t start,
+                                         std::int64_t end) const {
+  // A CRLF counts where its L'\n' is, so looking at the character after the
+  // range is fine, but the one after the text is not there.
+  const wchar_t* const text_end = text_.data() + text_.size();
+  const wchar_t* const last = text_.data() + end;
+  std::int64_t count = 0;
+  for (const wchar_t* p = text_.data() + start;
+       (p = FindLineEnd(p, last)) != last; ++p) {
+    if (GetLineEndingAt(p, text_end) != LineEnding::kCrLf) ++count;
+  }
+  return count;
+}
+
+}  // namespace wiese
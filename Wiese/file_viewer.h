@@ -0,0 +1,104 @@
+#ifndef WIESE_FILE_VIEWER_H_
+#define WIESE_FILE_VIEWER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#include "mapped_file.h"
+
+namespace wiese {
+
+// Read-only view of a file too large to be opened as a Document, such as a
+// log of many gigabytes. The file is mapped and nothing is read up front, so
+// opening it takes the same time whatever its size.
+//
+// Instead of a piece for every line, the view takes a checkpoint every
+// |checkpoint_interval| characters, which holds the number of line breaks in
+// front of it. Checkpoints are taken on demand, as far as the line or the
+// offset asked for needs, and by StartIndexing on a thread going through the
+// rest of the file, so that the line count fills in while the first lines
+// are already shown. Finding a line or an offset scans forward from the
+// checkpoint in front of it, which is O(checkpoint_interval).
+//
+// Line breaks are L"\n", L"\r\n" and a lone L'\r', as in documents. Offsets
+// count the wchar_t units of the file, line endings included; a leading byte
+// order mark is skipped. All functions but StartIndexing may be called on any
+// thread.
+class FileViewer {
+ public:
+  // 128 KB of UTF-16, so that a 20 GB file needs about a megabyte of
+  // checkpoints, and finding a line scans less than a millisecond.
+  static constexpr std::int64_t kDefaultCheckpointInterval = 64 << 10;
+
+  // Throws std::system_error if the file cannot be mapped.
+  explicit FileViewer(
+      const std::filesystem::path& path,
+      std::int64_t checkpoint_interval = kDefaultCheckpointInterval);
+  FileViewer(const FileViewer&) = delete;
+  FileViewer& operator=(const FileViewer&) = delete;
+  // Stops the thread started by StartIndexing.
+  ~FileViewer();
+
+  // Starts taking the checkpoints of the whole file on a thread of its own.
+  // Does nothing if it has been started already.
+  void StartIndexing();
+  // True once there is a checkpoint at the end of the file, which makes the
+  // line count exact.
+  bool IsIndexed() const;
+  // Number of characters in front of the last checkpoint taken so far.
+  std::int64_t GetIndexedCharCount() const;
+
+  std::int64_t GetCharCount() const {
+    return static_cast<std::int64_t>(text_.size());
+  }
+  // Number of lines found so far, without waiting or reading anything. It
+  // only grows, and is the line count once IsIndexed().
+  std::int64_t GetKnownLineCount() const;
+  // Takes the checkpoints of the rest of the file if needed.
+  std::int64_t GetLineCount() const;
+
+  // Returns the offset of the first character of |line|, or -1 if the file
+  // has fewer lines.
+  std::int64_t OffsetOfLine(std::int64_t line) const;
+  std::int64_t LineOfOffset(std::int64_t offset) const;
+  // Returns the characters of |line| without its line ending, read in place.
+  // |line| must be less than the line count.
+  std::wstring_view GetLine(std::int64_t line) const;
+  std::wstring_view GetText() const { return text_; }
+
+ private:
+  std::int64_t OffsetOfCheckpoint(std::int64_t index) const;
+  // Returns the number of line breaks in [start, end).
+  std::int64_t CountLineBreaks(std::int64_t start, std::int64_t end) const;
+  // Takes checkpoints one after another as long as |needs_more| returns true
+  // for the index of the last one taken, and returns the number of them.
+  template <typename Predicate>
+  std::int64_t TakeCheckpointsWhile(Predicate needs_more) const;
+  std::int64_t& Checkpoint(std::int64_t index) const {
+    return checkpoints_[static_cast<std::size_t>(index)];
+  }
+
+  const MappedFile file_;
+  const std::wstring_view text_;
+  const std::int64_t checkpoint_interval_;
+  // The number of line breaks in front of OffsetOfCheckpoint(i). Allocated
+  // for the whole file up front and never moved, so that the first
+  // |checkpoint_count_| of them can be read without locking.
+  const std::int64_t max_checkpoint_count_;
+  const std::unique_ptr<std::int64_t[]> checkpoints_;
+  mutable std::atomic<std::int64_t> checkpoint_count_;
+  // Held while checkpoints are taken.
+  mutable std::mutex mutex_;
+  std::atomic<bool> stopping_;
+  std::thread indexer_;
+};
+
+}  // namespace wiese
+
+#endif
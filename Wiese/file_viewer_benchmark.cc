@@ -0,0 +1,84 @@
+// Benchmarks for viewing large files. They are disabled by default; run them
+// with --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*.
+
+#include "file_viewer.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "document.h"
+
+namespace {
+
+constexpr std::size_t kInputBytes = std::size_t{1} << 30;
+constexpr int kLineLength = 80;
+// Lines on the first screen.
+constexpr int kScreenLines = 60;
+
+// Writes a file of kInputBytes of lines once and returns its path.
+const std::filesystem::path& GetPath() {
+  static const std::filesystem::path path = [] {
+    std::wstring text(kInputBytes / sizeof(wchar_t), L'x');
+    for (std::size_t i = kLineLength; i < text.size(); i += kLineLength + 2) {
+      text[i] = L'\r';
+      if (i + 1 < text.size()) text[i + 1] = L'\n';
+    }
+    auto path = std::filesystem::temp_directory_path() / "wiese_viewer.txt";
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(text.data()),
+               text.size() * sizeof(wchar_t));
+    return path;
+  }();
+  return path;
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void Record(const char* name, double seconds) {
+  std::cout << name << ": " << seconds * 1000 << " ms" << std::endl;
+  ::testing::Test::RecordProperty(name, std::to_string(seconds * 1000));
+}
+
+}  // namespace
+
+TEST(FileViewerBenchmark, DISABLED_FirstScreen) {
+  const std::filesystem::path& path = GetPath();
+  const auto start = std::chrono::steady_clock::now();
+  wiese::FileViewer viewer(path);
+  viewer.StartIndexing();
+  std::size_t size = 0;
+  for (int line = 0; line < kScreenLines; ++line) {
+    size += viewer.GetLine(line).size();
+  }
+  Record("FileViewer first screen", SecondsSince(start));
+  while (!viewer.IsIndexed()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  Record("FileViewer line count", SecondsSince(start));
+  std::cout << viewer.GetLineCount() << " lines (" << size << ")"
+            << std::endl;
+}
+
+TEST(FileViewerBenchmark, DISABLED_Document) {
+  const std::filesystem::path& path = GetPath();
+  const auto start = std::chrono::steady_clock::now();
+  wiese::Document document(path);
+  std::size_t size = 0;
+  for (int line = 0; line < kScreenLines; ++line) {
+    size += static_cast<std::size_t>(document.GetCharCountOfLine(line));
+  }
+  Record("Document first screen", SecondsSince(start));
+  std::cout << document.GetLineCount() << " lines (" << size << ")"
+            << std::endl;
+}
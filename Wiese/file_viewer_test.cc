@@ -0,0 +1,127 @@
+#include "file_viewer.h"
+
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace {
+
+class FileViewerTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = std::filesystem::temp_directory_path() /
+            (std::string("wiese_") +
+             testing::UnitTest::GetInstance()->current_test_info()->name() +
+             ".txt");
+  }
+  void TearDown() override { std::filesystem::remove(path_); }
+
+  void WriteFile(std::wstring_view text) {
+    std::ofstream file(path_, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(text.data()),
+               text.size() * sizeof(wchar_t));
+  }
+
+  std::filesystem::path path_;
+};
+
+// Returns the offsets of the line starts of |text|, counted one by one.
+std::vector<std::int64_t> GetLineStarts(const std::wstring& text) {
+  std::vector<std::int64_t> starts = {0};
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    if (text[i] == L'\n' ||
+        (text[i] == L'\r' && (i + 1 == text.size() || text[i + 1] != L'\n'))) {
+      starts.push_back(i + 1);
+    }
+  }
+  return starts;
+}
+
+}  // namespace
+
+TEST_F(FileViewerTest, Lines) {
+  WriteFile(L"\xfeff" L"ab\r\ncd\ref\n\ng");
+  wiese::FileViewer viewer(path_, 4);
+  EXPECT_EQ(L"ab\r\ncd\ref\n\ng", viewer.GetText());
+  EXPECT_EQ(L"ab", viewer.GetLine(0));
+  EXPECT_EQ(L"cd", viewer.GetLine(1));
+  EXPECT_EQ(L"ef", viewer.GetLine(2));
+  EXPECT_EQ(L"", viewer.GetLine(3));
+  EXPECT_EQ(L"g", viewer.GetLine(4));
+  EXPECT_EQ(-1, viewer.OffsetOfLine(5));
+  EXPECT_EQ(5, viewer.GetLineCount());
+  EXPECT_TRUE(viewer.IsIndexed());
+}
+
+TEST_F(FileViewerTest, MatchesLinesCountedOneByOne) {
+  std::mt19937 random(1);
+  std::wstring text(5000, L'x');
+  for (wchar_t& ch : text) {
+    if (random() % 8 == 0) ch = L"\r\n"[random() % 2];
+  }
+  WriteFile(text);
+  const std::vector<std::int64_t> starts = GetLineStarts(text);
+  for (std::int64_t interval : {1, 2, 3, 64, 100000}) {
+    wiese::FileViewer viewer(path_, interval);
+    for (std::size_t line = 0; line < starts.size(); ++line) {
+      ASSERT_EQ(starts[line], viewer.OffsetOfLine(line)) << interval;
+    }
+    EXPECT_EQ(-1, viewer.OffsetOfLine(starts.size()));
+    std::size_t line = 0;
+    for (std::int64_t offset = 0; offset <= viewer.GetCharCount(); ++offset) {
+      while (line + 1 < starts.size() && starts[line + 1] <= offset) ++line;
+      ASSERT_EQ(static_cast<std::int64_t>(line), viewer.LineOfOffset(offset))
+          << interval << " " << offset;
+    }
+  }
+}
+
+TEST_F(FileViewerTest, TakesCheckpointsOnDemand) {
+  std::wstring text;
+  for (int i = 0; i < 1000; ++i) text += L"line\n";
+  WriteFile(text);
+  wiese::FileViewer viewer(path_, 100);
+  EXPECT_EQ(1, viewer.GetKnownLineCount());
+  EXPECT_FALSE(viewer.IsIndexed());
+  // The first screen only reads the start of the file.
+  EXPECT_EQ(L"line", viewer.GetLine(30));
+  EXPECT_LE(viewer.GetIndexedCharCount(), 300);
+  EXPECT_LT(viewer.GetKnownLineCount(), 100);
+  EXPECT_EQ(1001, viewer.GetLineCount());
+  EXPECT_EQ(1001, viewer.GetKnownLineCount());
+}
+
+TEST_F(FileViewerTest, IndexesInBackground) {
+  std::wstring text;
+  for (int i = 0; i < 100000; ++i) text += L"line\r\n";
+  WriteFile(text);
+  wiese::FileViewer viewer(path_, 64);
+  viewer.StartIndexing();
+  // Lines can be asked for while the thread is taking checkpoints.
+  EXPECT_EQ(6 * 50000, viewer.OffsetOfLine(50000));
+  EXPECT_EQ(99999, viewer.LineOfOffset(6 * 99999 + 2));
+  while (!viewer.IsIndexed()) std::this_thread::yield();
+  EXPECT_EQ(100001, viewer.GetKnownLineCount());
+  EXPECT_EQ(viewer.GetCharCount(), viewer.GetIndexedCharCount());
+}
+
+TEST_F(FileViewerTest, EmptyFile) {
+  WriteFile(L"");
+  wiese::FileViewer viewer(path_);
+  EXPECT_TRUE(viewer.IsIndexed());
+  EXPECT_EQ(1, viewer.GetLineCount());
+  EXPECT_EQ(L"", viewer.GetLine(0));
+  EXPECT_EQ(0, viewer.LineOfOffset(0));
+}
+
+TEST_F(FileViewerTest, ThrowsIfTheFileIsMissing) {
+  EXPECT_THROW(wiese::FileViewer(path_ / "missing"), std::system_error);
+}
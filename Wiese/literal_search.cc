@@ -0,0 +1,546 @@
+#include "literal_search.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "simd.h"
+#include "text_cursor.h"
+
+namespace wiese {
+
+namespace {
+
+constexpr std::size_t npos = std::wstring_view::npos;
+
+// Returns the characters which fold to |folded|, in order.
+std::vector<wchar_t> CaseVariantsOf(wchar_t folded) {
+  // Every character FoldCase changes, after the one it folds to, sorted.
+  // Few characters change, so the table is small; it is built on first use.
+  static const std::vector<std::pair<wchar_t, wchar_t>> kFoldings = [] {
+    std::vector<std::pair<wchar_t, wchar_t>> foldings;
+    for (std::uint32_t ch = 0; ch <= 0xFFFF; ++ch) {
+      const wchar_t folded_ch = FoldCase(static_cast<wchar_t>(ch));
+      if (folded_ch != static_cast<wchar_t>(ch)) {
+        foldings.emplace_back(folded_ch, static_cast<wchar_t>(ch));
+      }
+    }
+    std::sort(foldings.begin(), foldings.end());
+    return foldings;
+  }();
+  std::vector<wchar_t> variants = {folded};
+  auto it = std::lower_bound(kFoldings.begin(), kFoldings.end(),
+                             std::make_pair(folded, wchar_t{0}));
+  for (; it != kFoldings.end() && it->first == folded; ++it) {
+    variants.push_back(it->second);
+  }
+  std::sort(variants.begin(), variants.end());
+  return variants;
+}
+
+bool IsAnyOf(wchar_t ch, const wchar_t* variants, int count) {
+  return std::find(variants, variants + count, ch) != variants + count;
+}
+
+// The functions below return the first (or last) |p| in [first, last) such
+// that p[0] is one of |first_chars| and p[offset] is one of |last_chars|, or
+// nullptr if there is none. Both arrays hold kMaxVariants characters, and
+// p[offset] must be readable for every |p| in the range.
+
+const wchar_t* FindCandidateScalar(const wchar_t* first, const wchar_t* last,
+                                   std::size_t offset,
+                                   const wchar_t* first_chars,
+                                   const wchar_t* last_chars) {
+  for (; first != last; ++first) {
+    if (IsAnyOf(first[0], first_chars, LiteralSearcher::kMaxVariants) &&
+        IsAnyOf(first[offset], last_chars, LiteralSearcher::kMaxVariants)) {
+      return first;
+    }
+  }
+  return nullptr;
+}
+
+const wchar_t* FindLastCandidateScalar(const wchar_t* first,
+                                       const wchar_t* last, std::size_t offset,
+                                       const wchar_t* first_chars,
+                                       const wchar_t* last_chars) {
+  while (last != first) {
+    --last;
+    if (IsAnyOf(last[0], first_chars, LiteralSearcher::kMaxVariants) &&
+        IsAnyOf(last[offset], last_chars, LiteralSearcher::kMaxVariants)) {
+      return last;
+    }
+  }
+  return nullptr;
+}
+
+#ifdef WIESE_HAS_SSE2
+
+__m128i Broadcast(wchar_t ch) {
+  if constexpr (sizeof(wchar_t) == 2) {
+    return _mm_set1_epi16(static_cast<short>(ch));
+  } else {
+    return _mm_set1_epi32(static_cast<int>(ch));
+  }
+}
+
+__m128i Equal(__m128i lhs, __m128i rhs) {
+  if constexpr (sizeof(wchar_t) == 2) {
+    return _mm_cmpeq_epi16(lhs, rhs);
+  } else {
+    return _mm_cmpeq_epi32(lhs, rhs);
+  }
+}
+
+// Compares the vector of characters at |p| and the one at |p| + |offset|.
+// The lanes of the characters which may start a match are all ones.
+__m128i MatchCandidates(const wchar_t* p, std::size_t offset,
+                        const __m128i* first_chars,
+                        const __m128i* last_chars) {
+  const __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  const __m128i tail =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + offset));
+  const __m128i head_matches =
+      _mm_or_si128(_mm_or_si128(Equal(head, first_chars[0]),
+                                Equal(head, first_chars[1])),
+                   Equal(head, first_chars[2]));
+  const __m128i tail_matches =
+      _mm_or_si128(_mm_or_si128(Equal(tail, last_chars[0]),
+                                Equal(tail, last_chars[1])),
+                   Equal(tail, last_chars[2]));
+  return _mm_and_si128(head_matches, tail_matches);
+}
+
+const wchar_t* FindCandidateSse2(const wchar_t* first, const wchar_t* last,
+                                 std::size_t offset,
+                                 const wchar_t* first_chars,
+                                 const wchar_t* last_chars) {
+  constexpr int kCharsPerVector = sizeof(__m128i) / sizeof(wchar_t);
+  const __m128i first_vectors[] = {Broadcast(first_chars[0]),
+                                   Broadcast(first_chars[1]),
+                                   Broadcast(first_chars[2])};
+  const __m128i last_vectors[] = {Broadcast(last_chars[0]),
+                                  Broadcast(last_chars[1]),
+                                  Broadcast(last_chars[2])};
+  while (last - first >= kCharsPerVector) {
+    const int mask = _mm_movemask_epi8(
+        MatchCandidates(first, offset, first_vectors, last_vectors));
+    if (mask) return first + CountTrailingZeros(mask) / sizeof(wchar_t);
+    first += kCharsPerVector;
+  }
+  return FindCandidateScalar(first, last, offset, first_chars, last_chars);
+}
+
+const wchar_t* FindLastCandidateSse2(const wchar_t* first, const wchar_t* last,
+                                     std::size_t offset,
+                                     const wchar_t* first_chars,
+                                     const wchar_t* last_chars) {
+  constexpr int kCharsPerVector = sizeof(__m128i) / sizeof(wchar_t);
+  const __m128i first_vectors[] = {Broadcast(first_chars[0]),
+                                   Broadcast(first_chars[1]),
+                                   Broadcast(first_chars[2])};
+  const __m128i last_vectors[] = {Broadcast(last_chars[0]),
+                                  Broadcast(last_chars[1]),
+                                  Broadcast(last_chars[2])};
+  while (last - first >= kCharsPerVector) {
+    last -= kCharsPerVector;
+    const int mask = _mm_movemask_epi8(
+        MatchCandidates(last, offset, first_vectors, last_vectors));
+    if (mask) return last + FindLastSetBit(mask) / sizeof(wchar_t);
+  }
+  return FindLastCandidateScalar(first, last, offset, first_chars, last_chars);
+}
+
+WIESE_TARGET_AVX2 __m256i Broadcast256(wchar_t ch) {
+  if constexpr (sizeof(wchar_t) == 2) {
+    return _mm256_set1_epi16(static_cast<short>(ch));
+  } else {
+    return _mm256_set1_epi32(static_cast<int>(ch));
+  }
+}
+
+WIESE_TARGET_AVX2 __m256i Equal256(__m256i lhs, __m256i rhs) {
+  if constexpr (sizeof(wchar_t) == 2) {
+    return _mm256_cmpeq_epi16(lhs, rhs);
+  } else {
+    return _mm256_cmpeq_epi32(lhs, rhs);
+  }
+}
+
+WIESE_TARGET_AVX2 std::uint32_t MatchCandidates256(const wchar_t* p,
+                                                   std::size_t offset,
+                                                   const __m256i* first_chars,
+                                                   const __m256i* last_chars) {
+  const __m256i head =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  const __m256i tail =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + offset));
+  const __m256i head_matches =
+      _mm256_or_si256(_mm256_or_si256(Equal256(head, first_chars[0]),
+                                      Equal256(head, first_chars[1])),
+                      Equal256(head, first_chars[2]));
+  const __m256i tail_matches =
+      _mm256_or_si256(_mm256_or_si256(Equal256(tail, last_chars[0]),
+                                      Equal256(tail, last_chars[1])),
+                      Equal256(tail, last_chars[2]));
+  return static_cast<std::uint32_t>(
+      _mm256_movemask_epi8(_mm256_and_si256(head_matches, tail_matches)));
+}
+
+WIESE_TARGET_AVX2 const wchar_t* FindCandidateAvx2(const wchar_t* first,
+                                                   const wchar_t* last,
+                                                   std::size_t offset,
+                                                   const wchar_t* first_chars,
+                                                   const wchar_t* last_chars) {
+  constexpr int kCharsPerVector = sizeof(__m256i) / sizeof(wchar_t);
+  const __m256i first_vectors[] = {Broadcast256(first_chars[0]),
+                                   Broadcast256(first_chars[1]),
+                                   Broadcast256(first_chars[2])};
+  const __m256i last_vectors[] = {Broadcast256(last_chars[0]),
+                                  Broadcast256(last_chars[1]),
+                                  Broadcast256(last_chars[2])};
+  while (last - first >= kCharsPerVector) {
+    const std::uint32_t mask =
+        MatchCandidates256(first, offset, first_vectors, last_vectors);
+    if (mask) return first + CountTrailingZeros(mask) / sizeof(wchar_t);
+    first += kCharsPerVector;
+  }
+  // Mixing SSE and AVX instructions is slow while the upper halves of the
+  // YMM registers are in use, and GCC does not clear them on a tail call.
+  _mm256_zeroupper();
+  return FindCandidateSse2(first, last, offset, first_chars, last_chars);
+}
+
+WIESE_TARGET_AVX2 const wchar_t* FindLastCandidateAvx2(
+    const wchar_t* first, const wchar_t* last, std::size_t offset,
+    const wchar_t* first_chars, const wchar_t* last_chars) {
+  constexpr int kCharsPerVector = sizeof(__m256i) / sizeof(wchar_t);
+  const __m256i first_vectors[] = {Broadcast256(first_chars[0]),
+                                   Broadcast256(first_chars[1]),
+                                   Broadcast256(first_chars[2])};
+  const __m256i last_vectors[] = {Broadcast256(last_chars[0]),
+                                  Broadcast256(last_chars[1]),
+                                  Broadcast256(last_chars[2])};
+  while (last - first >= kCharsPerVector) {
+    last -= kCharsPerVector;
+    const std::uint32_t mask =
+        MatchCandidates256(last, offset, first_vectors, last_vectors);
+    if (mask) return last + FindLastSetBit(mask) / sizeof(wchar_t);
+  }
+  _mm256_zeroupper();
+  return FindLastCandidateSse2(first, last, offset, first_chars, last_chars);
+}
+
+#endif
+
+const wchar_t* FindCandidate(const wchar_t* first, const wchar_t* last,
+                             std::size_t offset, const wchar_t* first_chars,
+                             const wchar_t* last_chars) {
+#ifdef WIESE_HAS_SSE2
+  static const auto find_candidate =
+      HasAvx2() ? FindCandidateAvx2 : FindCandidateSse2;
+  return find_candidate(first, last, offset, first_chars, last_chars);
+#else
+  return FindCandidateScalar(first, last, offset, first_chars, last_chars);
+#endif
+}
+
+const wchar_t* FindLastCandidate(const wchar_t* first, const wchar_t* last,
+                                 std::size_t offset,
+                                 const wchar_t* first_chars,
+                                 const wchar_t* last_chars) {
+#ifdef WIESE_HAS_SSE2
+  static const auto find_last_candidate =
+      HasAvx2() ? FindLastCandidateAvx2 : FindLastCandidateSse2;
+  return find_last_candidate(first, last, offset, first_chars, last_chars);
+#else
+  return FindLastCandidateScalar(first, last, offset, first_chars,
+                                 last_chars);
+#endif
+}
+
+}  // namespace
+
+wchar_t FoldCase(wchar_t ch) {
+  const auto shift = [ch](int delta) {
+    return static_cast<wchar_t>(ch + delta);
+  };
+  if (ch < 0x80) return L'A' <= ch && ch <= L'Z' ? shift(0x20) : ch;
+  if (ch < 0x100) {
+    // MICRO SIGN is GREEK SMALL LETTER MU.
+    if (ch == 0xB5) return 0x3BC;
+    if (0xC0 <= ch && ch <= 0xDE && ch != 0xD7) return shift(0x20);
+    return ch;
+  }
+  if (ch < 0x180) {
+    // Latin Extended-A mostly pairs each capital letter with the small one
+    // right after it.
+    if (ch == 0x178) return 0xFF;
+    if (ch == 0x17F) return L's';
+    const bool even_is_capital = ch < 0x130 || (0x132 <= ch && ch < 0x138) ||
+                                 (0x14A <= ch && ch < 0x178);
+    const bool odd_is_capital =
+        (0x139 <= ch && ch < 0x149) || (0x179 <= ch && ch < 0x17F);
+    if ((even_is_capital && ch % 2 == 0) || (odd_is_capital && ch % 2 == 1)) {
+      return shift(1);
+    }
+    return ch;
+  }
+  if (0x386 <= ch && ch < 0x3D0) {
+    if (ch == 0x386) return 0x3AC;
+    if (0x388 <= ch && ch <= 0x38A) return shift(37);
+    if (ch == 0x38C) return 0x3CC;
+    if (ch == 0x38E || ch == 0x38F) return shift(63);
+    if (0x391 <= ch && ch <= 0x3AB && ch != 0x3A2) return shift(0x20);
+    // Final sigma.
+    if (ch == 0x3C2) return 0x3C3;
+    return ch;
+  }
+  if (0x400 <= ch && ch < 0x410) return shift(0x50);
+  if (0x410 <= ch && ch < 0x430) return shift(0x20);
+  if (0xFF21 <= ch && ch <= 0xFF3A) return shift(0x20);
+  return ch;
+}
+
+LiteralSearcher::LiteralSearcher(std::wstring_view pattern, bool ignore_case)
+    : pattern_(pattern), ignore_case_(ignore_case), use_vector_filter_(true) {
+  if (pattern_.empty()) return;
+  if (ignore_case_) {
+    for (wchar_t& ch : pattern_) ch = FoldCase(ch);
+  }
+  const auto set_variants = [this](wchar_t ch,
+                                   std::array<wchar_t, kMaxVariants>& array) {
+    std::vector<wchar_t> variants = ignore_case_
+                                        ? CaseVariantsOf(ch)
+                                        : std::vector<wchar_t>{ch};
+    if (variants.size() > kMaxVariants) {
+      use_vector_filter_ = false;
+      variants.resize(kMaxVariants);
+    }
+    for (int i = 0; i < kMaxVariants; ++i) {
+      array[i] = variants[std::min<std::size_t>(i, variants.size() - 1)];
+    }
+  };
+  set_variants(pattern_.front(), first_variants_);
+  set_variants(pattern_.back(), last_variants_);
+}
+
+bool LiteralSearcher::MayStartMatch(std::wstring_view chars) const {
+  if (!use_vector_filter_) return true;
+  return std::any_of(chars.begin(), chars.end(), [this](wchar_t ch) {
+    return IsAnyOf(ch, first_variants_.data(), kMaxVariants);
+  });
+}
+
+bool LiteralSearcher::MayEndMatch(std::wstring_view chars) const {
+  if (!use_vector_filter_) return true;
+  return std::any_of(chars.begin(), chars.end(), [this](wchar_t ch) {
+    return IsAnyOf(ch, last_variants_.data(), kMaxVariants);
+  });
+}
+
+bool LiteralSearcher::MatchesAt(const wchar_t* chars) const {
+  if (!ignore_case_) {
+    return std::equal(pattern_.begin(), pattern_.end(), chars);
+  }
+  for (std::size_t i = 0; i < pattern_.size(); ++i) {
+    if (FoldCase(chars[i]) != pattern_[i]) return false;
+  }
+  return true;
+}
+
+std::size_t LiteralSearcher::FindIn(std::wstring_view text, std::size_t begin,
+                                    std::size_t end) const {
+  const std::size_t size = pattern_.size();
+  if (text.size() < size) return npos;
+  end = std::min(end, text.size() - size + 1);
+  const wchar_t* const chars = text.data();
+  if (!use_vector_filter_) {
+    for (std::size_t i = begin; i < end; ++i) {
+      if (MatchesAt(chars + i)) return i;
+    }
+    return npos;
+  }
+  const wchar_t* p = chars + begin;
+  const wchar_t* const last = chars + end;
+  while (p < last) {
+    p = FindCandidate(p, last, size - 1, first_variants_.data(),
+                      last_variants_.data());
+    if (!p) return npos;
+    if (MatchesAt(p)) return p - chars;
+    ++p;
+  }
+  return npos;
+}
+
+std::size_t LiteralSearcher::FindLastIn(std::wstring_view text,
+                                        std::size_t begin,
+                                        std::size_t end) const {
+  const std::size_t size = pattern_.size();
+  if (text.size() < size) return npos;
+  end = std::min(end, text.size() - size + 1);
+  const wchar_t* const chars = text.data();
+  if (!use_vector_filter_) {
+    for (std::size_t i = end; i > begin; --i) {
+      if (MatchesAt(chars + i - 1)) return i - 1;
+    }
+    return npos;
+  }
+  const wchar_t* const first = chars + begin;
+  const wchar_t* last = chars + end;
+  while (first < last) {
+    const wchar_t* p = FindLastCandidate(first, last, size - 1,
+                                         first_variants_.data(),
+                                         last_variants_.data());
+    if (!p) return npos;
+    if (MatchesAt(p)) return p - chars;
+    last = p;
+  }
+  return npos;
+}
+
+std::int64_t LiteralSearcher::FindForward(std::wstring_view text,
+                                          std::int64_t from) const {
+  assert(0 <= from && from <= static_cast<std::int64_t>(text.size()));
+  if (pattern_.empty()) return -1;
+  const std::size_t found =
+      FindIn(text, static_cast<std::size_t>(from), text.size());
+  return found == npos ? -1 : static_cast<std::int64_t>(found);
+}
+
+std::int64_t LiteralSearcher::FindBackward(std::wstring_view text,
+                                           std::int64_t to) const {
+  assert(0 <= to && to <= static_cast<std::int64_t>(text.size()));
+  if (pattern_.empty()) return -1;
+  const auto end = static_cast<std::size_t>(to);
+  const std::size_t found = FindLastIn(text.substr(0, end), 0, end);
+  return found == npos ? -1 : static_cast<std::int64_t>(found);
+}
+
+std::int64_t LiteralSearcher::FindForward(
+    const std::shared_ptr<const DocumentSnapshot>& snapshot,
+    std::int64_t from) const {
+  const std::size_t size = pattern_.size();
+  if (size == 0) return -1;
+  TextCursor cursor(snapshot, from);
+  // The text is read in runs of pieces which are contiguous in memory, and
+  // every run is searched on its own. |seam| holds the last |size| - 1
+  // characters in front of the current run; matches starting there are
+  // searched for after appending the start of the run to it.
+  std::wstring seam;
+  seam.reserve(2 * (size - 1));
+  std::int64_t seam_start = from;
+  while (!cursor.AtEnd()) {
+    const std::int64_t run_start = cursor.position();
+    const std::wstring_view run = cursor.NextRun();
+    const std::size_t carried = seam.size();
+    if (carried > 0 && MayStartMatch(seam)) {
+      seam.append(run.substr(0, size - 1));
+      const std::size_t found = FindIn(seam, 0, carried);
+      if (found != npos) return seam_start + static_cast<std::int64_t>(found);
+      seam.resize(carried);
+    }
+    const std::size_t found = FindIn(run, 0, run.size());
+    if (found != npos) return run_start + static_cast<std::int64_t>(found);
+
+    if (run.size() >= size - 1) {
+      seam.assign(run.substr(run.size() - (size - 1)));
+    } else {
+      seam.append(run);
+      seam.erase(0, seam.size() - std::min(seam.size(), size - 1));
+    }
+    seam_start =
+        run_start + static_cast<std::int64_t>(run.size() - seam.size());
+  }
+  return -1;
+}
+
+void LiteralSearcher::FindAll(
+    const std::shared_ptr<const DocumentSnapshot>& snapshot,
+    std::int64_t from, std::int64_t to,
+    const std::function<void(std::int64_t)>& found) const {
+  const std::size_t size = pattern_.size();
+  if (size == 0) return;
+  TextCursor cursor(snapshot, from);
+  // Same as FindForward, but goes on after a match.
+  std::wstring seam;
+  seam.reserve(2 * (size - 1));
+  std::int64_t seam_start = from;
+  while (!cursor.AtEnd() && seam_start < to) {
+    const std::int64_t run_start = cursor.position();
+    const std::wstring_view run = cursor.NextRun();
+    const std::size_t carried = seam.size();
+    if (carried > 0 && MayStartMatch(seam)) {
+      seam.append(run.substr(0, size - 1));
+      const std::size_t end = std::min(
+          carried, static_cast<std::size_t>(to - seam_start));
+      for (std::size_t i = FindIn(seam, 0, end); i != npos;
+           i = FindIn(seam, i + 1, end)) {
+        found(seam_start + static_cast<std::int64_t>(i));
+      }
+      seam.resize(carried);
+    }
+    if (run_start < to) {
+      const std::size_t end = std::min(
+          run.size(), static_cast<std::size_t>(to - run_start));
+      for (std::size_t i = FindIn(run, 0, end); i != npos;
+           i = FindIn(run, i + 1, end)) {
+        found(run_start + static_cast<std::int64_t>(i));
+      }
+    }
+
+    if (run.size() >= size - 1) {
+      seam.assign(run.substr(run.size() - (size - 1)));
+    } else {
+      seam.append(run);
+      seam.erase(0, seam.size() - std::min(seam.size(), size - 1));
+    }
+    seam_start =
+        run_start + static_cast<std::int64_t>(run.size() - seam.size());
+  }
+}
+
+std::int64_t LiteralSearcher::FindBackward(
+    const std::shared_ptr<const DocumentSnapshot>& snapshot,
+    std::int64_t to) const {
+  const std::size_t size = pattern_.size();
+  if (size == 0) return -1;
+  TextCursor cursor(snapshot, to);
+  // Mirrors FindForward: |seam| holds the first |size| - 1 characters after
+  // the current run, and the end of the run is prepended to it.
+  std::wstring seam;
+  seam.reserve(2 * (size - 1));
+  while (!cursor.AtStart()) {
+    const std::wstring_view run = cursor.PreviousRun();
+    const std::int64_t run_start = cursor.position();
+    if (!seam.empty() && MayEndMatch(seam)) {
+      const std::size_t prefix = std::min(run.size(), size - 1);
+      const std::size_t prefix_start = run.size() - prefix;
+      seam.insert(0, run.substr(prefix_start));
+      const std::size_t found = FindLastIn(seam, 0, prefix);
+      if (found != npos) {
+        return run_start + static_cast<std::int64_t>(prefix_start + found);
+      }
+      seam.erase(0, prefix);
+    }
+    const std::size_t found = FindLastIn(run, 0, run.size());
+    if (found != npos) return run_start + static_cast<std::int64_t>(found);
+
+    if (run.size() >= size - 1) {
+      seam.assign(run.substr(0, size - 1));
+    } else {
+      seam.insert(0, run);
+      seam.resize(std::min(seam.size(), size - 1));
+    }
+  }
+  return -1;
+}
+
+}  // namespace wiese
@@ -0,0 +1,89 @@
+#ifndef WIESE_LITERAL_SEARCH_H_
+#define WIESE_LITERAL_SEARCH_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "document_snapshot.h"
+
+namespace wiese {
+
+// Maps |ch| to the character it is compared as when case is ignored. Covers
+// ASCII, Latin-1, Latin Extended-A, the basic Greek and Cyrillic letters and
+// fullwidth Latin letters; other characters fold to themselves.
+wchar_t FoldCase(wchar_t ch);
+
+// Searches the text of a snapshot for a literal string, reading the pieces in
+// place instead of copying the text. Candidates are found by comparing the
+// first and the last character of the pattern with AVX2 or SSE2 when the CPU
+// has them, and only those are compared in full, so a search runs at close to
+// memory speed for most patterns. Matches may span any number of pieces.
+//
+// A searcher holds no state between calls and may be used on several threads
+// at once.
+class LiteralSearcher {
+ public:
+  // Characters which fold to the same one are all candidates, so every
+  // pattern character has up to this many variants.
+  static constexpr int kMaxVariants = 3;
+
+  LiteralSearcher(std::wstring_view pattern, bool ignore_case);
+
+  // Number of characters in a match.
+  int length() const { return static_cast<int>(pattern_.size()); }
+
+  // Returns the start of the first match which starts at or after |from|, or
+  // -1 if there is none. An empty pattern matches nowhere.
+  std::int64_t FindForward(
+      const std::shared_ptr<const DocumentSnapshot>& snapshot,
+      std::int64_t from) const;
+  // Returns the start of the last match which ends at or before |to|, or -1
+  // if there is none.
+  std::int64_t FindBackward(
+      const std::shared_ptr<const DocumentSnapshot>& snapshot,
+      std::int64_t to) const;
+
+  // Calls |found| with the start of every match which starts in [from, to),
+  // overlapping ones included, in order. Reads the text once, so this is
+  // much faster than calling FindForward for each match when there are many.
+  void FindAll(const std::shared_ptr<const DocumentSnapshot>& snapshot,
+               std::int64_t from, std::int64_t to,
+               const std::function<void(std::int64_t)>& found) const;
+
+  // Same as above on a contiguous text. Exposed for tests and benchmarks.
+  std::int64_t FindForward(std::wstring_view text, std::int64_t from) const;
+  std::int64_t FindBackward(std::wstring_view text, std::int64_t to) const;
+
+ private:
+  // Returns the first start in [begin, end) of a match in |text|, or npos.
+  // Every match must lie within |text|.
+  std::size_t FindIn(std::wstring_view text, std::size_t begin,
+                     std::size_t end) const;
+  // Returns the last start in [begin, end) of a match in |text|, or npos.
+  std::size_t FindLastIn(std::wstring_view text, std::size_t begin,
+                         std::size_t end) const;
+  // Return false if none of |chars| can be the first (last) character of a
+  // match, which saves looking at the characters around them.
+  bool MayStartMatch(std::wstring_view chars) const;
+  bool MayEndMatch(std::wstring_view chars) const;
+  bool MatchesAt(const wchar_t* chars) const;
+
+  // Folded if case is ignored.
+  std::wstring pattern_;
+  bool ignore_case_;
+  // The characters a match may start and end with, padded with repeats.
+  std::array<wchar_t, kMaxVariants> first_variants_;
+  std::array<wchar_t, kMaxVariants> last_variants_;
+  // False if a pattern character has more variants than fit above, in which
+  // case candidates are found without vector instructions.
+  bool use_vector_filter_;
+};
+
+}  // namespace wiese
+
+#endif
@@ -0,0 +1,88 @@
+// Benchmarks for the literal search. They are disabled by default; run them
+// with --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*.
+
+#include "literal_search.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "document.h"
+
+namespace {
+
+constexpr std::size_t kInputBytes = std::size_t{1} << 30;
+constexpr int kLineLength = 80;
+// Distance between the characters inserted to break the text into pieces.
+constexpr int kPieceLength = 4096;
+// Does not occur in the text, so every search reads all of it.
+constexpr const wchar_t* kPattern = L"wiese";
+
+// Returns a document of kInputBytes whose text is split into pieces of about
+// kPieceLength characters from both buffers, plus the line breaks.
+const wiese::Document& GetDocument() {
+  static const std::unique_ptr<wiese::Document> document = [] {
+    std::wstring text(kInputBytes / sizeof(wchar_t), L'x');
+    for (std::size_t i = kLineLength; i < text.size(); i += kLineLength + 1) {
+      text[i] = L'\n';
+    }
+    auto document = std::make_unique<wiese::Document>(text.c_str());
+    std::vector<wiese::Edit> edits;
+    for (std::size_t i = 0; i < text.size(); i += kPieceLength) {
+      const int position = static_cast<int>(i);
+      edits.push_back({position, position + 1, L"y"});
+    }
+    document->ApplyEdits(std::move(edits));
+    return document;
+  }();
+  return *document;
+}
+
+template <typename Function>
+void Measure(const char* name, Function function) {
+  const auto start = std::chrono::steady_clock::now();
+  const int result = function();
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  const double gigabytes_per_second =
+      kInputBytes / elapsed.count() / (1 << 30);
+  std::cout << name << ": " << gigabytes_per_second << " GB/s (" << result
+            << ")" << std::endl;
+  ::testing::Test::RecordProperty(name, std::to_string(gigabytes_per_second));
+}
+
+}  // namespace
+
+TEST(LiteralSearchBenchmark, DISABLED_CopyAndFind) {
+  auto snapshot = GetDocument().Snapshot();
+  Measure("GetText + std::wstring::find", [&] {
+    const std::wstring text = snapshot->GetText();
+    return static_cast<int>(text.find(kPattern));
+  });
+}
+
+TEST(LiteralSearchBenchmark, DISABLED_FindForward) {
+  auto snapshot = GetDocument().Snapshot();
+  wiese::LiteralSearcher searcher(kPattern, false);
+  Measure("FindForward", [&] { return searcher.FindForward(snapshot, 0); });
+}
+
+TEST(LiteralSearchBenchmark, DISABLED_FindBackward) {
+  auto snapshot = GetDocument().Snapshot();
+  wiese::LiteralSearcher searcher(kPattern, false);
+  Measure("FindBackward", [&] {
+    return searcher.FindBackward(snapshot, snapshot->GetCharCount());
+  });
+}
+
+TEST(LiteralSearchBenchmark, DISABLED_FindForwardIgnoringCase) {
+  auto snapshot = GetDocument().Snapshot();
+  wiese::LiteralSearcher searcher(kPattern, true);
+  Measure("FindForward(ignore case)",
+          [&] { return searcher.FindForward(snapshot, 0); });
+}
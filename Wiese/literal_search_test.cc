@@ -0,0 +1,219 @@
+#include "literal_search.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "document.h"
+
+namespace {
+
+// Returns a document with |text| in which every character is a piece of its
+// own, so that every match spans pieces.
+std::unique_ptr<wiese::Document> MakeFragmentedDocument(
+    const std::wstring& text) {
+  auto doc = std::make_unique<wiese::Document>(L"");
+  // Inserting from the back adds the characters to the buffer in reverse
+  // order, so no two pieces can be merged.
+  for (auto it = text.rbegin(); it != text.rend(); ++it) {
+    doc->InsertStringBefore(std::wstring(1, *it).c_str(), 0);
+  }
+  return doc;
+}
+
+int ExpectedForward(const std::wstring& text, const std::wstring& pattern,
+                    int from) {
+  const std::size_t found = text.find(pattern, from);
+  return found == std::wstring::npos ? -1 : static_cast<int>(found);
+}
+
+int ExpectedBackward(const std::wstring& text, const std::wstring& pattern,
+                     int to) {
+  if (to < static_cast<int>(pattern.size())) return -1;
+  const std::size_t found = text.rfind(pattern, to - pattern.size());
+  return found == std::wstring::npos ? -1 : static_cast<int>(found);
+}
+
+}  // namespace
+
+TEST(FoldCase, FoldsCapitalLetters) {
+  EXPECT_EQ(L'a', wiese::FoldCase(L'A'));
+  EXPECT_EQ(L'z', wiese::FoldCase(L'z'));
+  EXPECT_EQ(L'[', wiese::FoldCase(L'['));
+  EXPECT_EQ(L'\u00E9', wiese::FoldCase(L'\u00C9'));
+  EXPECT_EQ(L'\u00D7', wiese::FoldCase(L'\u00D7'));
+  EXPECT_EQ(L'\u0101', wiese::FoldCase(L'\u0100'));
+  EXPECT_EQ(L'\u013A', wiese::FoldCase(L'\u0139'));
+  EXPECT_EQ(L's', wiese::FoldCase(L'\u017F'));
+  EXPECT_EQ(L'\u03C3', wiese::FoldCase(L'\u03A3'));
+  EXPECT_EQ(L'\u03C3', wiese::FoldCase(L'\u03C2'));
+  EXPECT_EQ(L'\u0436', wiese::FoldCase(L'\u0416'));
+  EXPECT_EQ(L'\u0451', wiese::FoldCase(L'\u0401'));
+  EXPECT_EQ(L'\uFF41', wiese::FoldCase(L'\uFF21'));
+  EXPECT_EQ(L'\u3042', wiese::FoldCase(L'\u3042'));
+}
+
+TEST(FoldCase, IsIdempotent) {
+  for (int ch = 0; ch <= 0xFFFF; ++ch) {
+    const wchar_t folded = wiese::FoldCase(static_cast<wchar_t>(ch));
+    EXPECT_EQ(folded, wiese::FoldCase(folded)) << ch;
+  }
+}
+
+TEST(LiteralSearcher, FindsAtAnyOffsetAndAlignment) {
+  std::wstring text(200, L'x');
+  const std::wstring pattern = L"abcab";
+  wiese::LiteralSearcher searcher(pattern, false);
+  for (int i = 0; i + pattern.size() <= text.size(); ++i) {
+    text.replace(i, pattern.size(), pattern);
+    EXPECT_EQ(i, searcher.FindForward(text, 0));
+    EXPECT_EQ(i, searcher.FindBackward(text, static_cast<int>(text.size())));
+    EXPECT_EQ(-1, searcher.FindForward(text, i + 1));
+    EXPECT_EQ(-1, searcher.FindBackward(text, i + 4));
+    text.replace(i, pattern.size(), pattern.size(), L'x');
+  }
+}
+
+TEST(LiteralSearcher, SkipsPartialMatches) {
+  const std::wstring text = L"aXXa aXa aXXXa aXXa";
+  wiese::LiteralSearcher searcher(L"aXXa", false);
+  EXPECT_EQ(0, searcher.FindForward(text, 0));
+  EXPECT_EQ(15, searcher.FindForward(text, 1));
+  EXPECT_EQ(0, searcher.FindBackward(text, 18));
+}
+
+TEST(LiteralSearcher, EmptyPatternMatchesNowhere) {
+  wiese::LiteralSearcher searcher(L"", false);
+  EXPECT_EQ(-1, searcher.FindForward(std::wstring_view(L"abc"), 0));
+  EXPECT_EQ(-1, searcher.FindBackward(std::wstring_view(L"abc"), 3));
+}
+
+TEST(LiteralSearcher, IgnoreCase) {
+  const std::wstring text =
+      L"The QUICK brown fox, \u0395\u039B\u039B\u0391\u03A3 and "
+      L"\uFF37\uFF49\uFF45\uFF53\uFF45";
+  wiese::LiteralSearcher quick(L"quick", true);
+  EXPECT_EQ(4, quick.FindForward(text, 0));
+  wiese::LiteralSearcher greek(L"\u03B5\u03BB\u03BB\u03B1\u03C2", true);
+  EXPECT_EQ(21, greek.FindForward(text, 0));
+  wiese::LiteralSearcher fullwidth(L"\uFF57\uFF49\uFF45\uFF53\uFF45", true);
+  EXPECT_EQ(31, fullwidth.FindBackward(text, static_cast<int>(text.size())));
+  wiese::LiteralSearcher long_s(L"\u017Fox", true);
+  EXPECT_EQ(-1, long_s.FindForward(text, 0));
+  EXPECT_EQ(16, wiese::LiteralSearcher(L"FOX", true).FindForward(text, 0));
+  EXPECT_EQ(-1, wiese::LiteralSearcher(L"FOX", false).FindForward(text, 0));
+}
+
+TEST(LiteralSearcher, FindsMatchesSpanningPieces) {
+  const std::wstring text = L"ab\nabc\nbcab\nc\nabcabc";
+  auto doc = MakeFragmentedDocument(text);
+  ASSERT_EQ(text, doc->GetText());
+  auto snapshot = doc->Snapshot();
+  for (const wchar_t* pattern : {L"a", L"abc", L"c\na", L"bcab\nc\nab"}) {
+    wiese::LiteralSearcher searcher(pattern, false);
+    for (int i = 0; i <= static_cast<int>(text.size()); ++i) {
+      EXPECT_EQ(ExpectedForward(text, pattern, i),
+                searcher.FindForward(snapshot, i))
+          << pattern << " " << i;
+      EXPECT_EQ(ExpectedBackward(text, pattern, i),
+                searcher.FindBackward(snapshot, i))
+          << pattern << " " << i;
+    }
+  }
+}
+
+TEST(LiteralSearcher, FindAllFindsOverlappingMatches) {
+  const std::wstring text = L"aaa\naa\naaaa";
+  auto doc = MakeFragmentedDocument(text);
+  auto snapshot = doc->Snapshot();
+  wiese::LiteralSearcher searcher(L"aa", false);
+  std::vector<std::int64_t> found;
+  const auto add = [&](std::int64_t start) { found.push_back(start); };
+  searcher.FindAll(snapshot, 0, static_cast<int>(text.size()), add);
+  EXPECT_EQ((std::vector<std::int64_t>{0, 1, 4, 7, 8, 9}), found);
+  found.clear();
+  searcher.FindAll(snapshot, 1, 8, add);
+  EXPECT_EQ((std::vector<std::int64_t>{1, 4, 7}), found);
+}
+
+TEST(LiteralSearcher, RandomEditsAgreeWithStringFind) {
+  std::mt19937 random(1);
+  std::wstring text(5000, L'a');
+  for (wchar_t& ch : text) ch = L"abAB\n"[random() % 5];
+  wiese::Document doc(text.c_str());
+  // Splits the text into pieces of random sizes from both buffers.
+  for (int i = 0; i < 300; ++i) {
+    const int start = random() % static_cast<int>(text.size());
+    const int end = std::min<int>(start + random() % 20, text.size());
+    std::wstring inserted(random() % 40, L'a');
+    for (wchar_t& ch : inserted) ch = L"abAB\n"[random() % 5];
+    doc.ApplyEdits({{start, end, inserted}});
+    text.replace(start, end - start, inserted);
+  }
+  ASSERT_EQ(text, doc.GetText());
+  auto snapshot = doc.Snapshot();
+  std::wstring folded = text;
+  for (wchar_t& ch : folded) ch = wiese::FoldCase(ch);
+  for (int i = 0; i < 200; ++i) {
+    std::wstring pattern(1 + random() % 6, L'a');
+    for (wchar_t& ch : pattern) ch = L"ab\n"[random() % 3];
+    const int from = random() % static_cast<int>(text.size());
+    wiese::LiteralSearcher searcher(pattern, false);
+    EXPECT_EQ(ExpectedForward(text, pattern, from),
+              searcher.FindForward(snapshot, from));
+    EXPECT_EQ(ExpectedBackward(text, pattern, from),
+              searcher.FindBackward(snapshot, from));
+
+    std::vector<std::int64_t> found;
+    searcher.FindAll(snapshot, from, static_cast<int>(text.size()),
+                     [&](std::int64_t start) { found.push_back(start); });
+    std::vector<std::int64_t> expected;
+    for (int start = ExpectedForward(text, pattern, from); start >= 0;
+         start = ExpectedForward(text, pattern, start + 1)) {
+      expected.push_back(start);
+    }
+    EXPECT_EQ(expected, found);
+
+    wiese::LiteralSearcher ignoring_case(pattern, true);
+    EXPECT_EQ(ExpectedForward(folded, pattern, from),
+              ignoring_case.FindForward(snapshot, from));
+    EXPECT_EQ(ExpectedBackward(folded, pattern, from),
+              ignoring_case.FindBackward(snapshot, from));
+  }
+}
+
+TEST(LiteralSearcher, FindsMatchesInCompactText) {
+  // Several blocks of CompactText in different encodings, so that matches
+  // span blocks as well as pieces.
+  std::mt19937 random(2);
+  std::wstring text(5 * wiese::CompactText::kBlockSize, L'a');
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    const bool wide = i / wiese::CompactText::kBlockSize % 2 == 1;
+    const wchar_t* const chars = wide ? L"ab\u3042\n" : L"ab\xE9\n";
+    text[i] = chars[random() % 4];
+  }
+  wiese::Document doc(text.c_str(), wiese::TextStorage::kCompact);
+  for (int i = 0; i < 100; ++i) {
+    const int start = random() % static_cast<int>(text.size());
+    const int end = std::min<int>(start + random() % 20, text.size());
+    doc.ApplyEdits({{start, end, L"ab"}});
+    text.replace(start, end - start, L"ab");
+  }
+  ASSERT_EQ(text, doc.GetText());
+  auto snapshot = doc.Snapshot();
+  for (int i = 0; i < 200; ++i) {
+    std::wstring pattern(1 + random() % 6, L'a');
+    for (wchar_t& ch : pattern) ch = L"ab\xE9\u3042\n"[random() % 5];
+    const int from = random() % static_cast<int>(text.size());
+    wiese::LiteralSearcher searcher(pattern, false);
+    EXPECT_EQ(ExpectedForward(text, pattern, from),
+              searcher.FindForward(snapshot, from));
+    EXPECT_EQ(ExpectedBackward(text, pattern, from),
+              searcher.FindBackward(snapshot, from));
+  }
+}
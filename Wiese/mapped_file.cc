@@ -0,0 +1,102 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstddef>
+#include <filesystem>
+#include <system_error>
+
+namespace wiese {
+
+#ifdef _WIN32
+
+namespace {
+
+[[noreturn]] void ThrowLastError(const char* what) {
+  throw std::system_error(static_cast<int>(GetLastError()),
+                          std::system_category(), what);
+}
+
+}  // namespace
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+    : file_(INVALID_HANDLE_VALUE),
+      mapping_(nullptr),
+      data_(nullptr),
+      size_(0) {
+  file_ = CreateFileW(path.c_str(), GENERIC_READ,
+                      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                      nullptr,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) ThrowLastError("CreateFileW");
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size)) {
+    CloseHandle(file_);
+    ThrowLastError("GetFileSizeEx");
+  }
+  size_ = static_cast<std::size_t>(size.QuadPart);
+  // Mapping an empty file fails, and there is nothing to map anyway.
+  if (size_ == 0) return;
+
+  mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping_) {
+    CloseHandle(file_);
+    ThrowLastError("CreateFileMappingW");
+  }
+  data_ = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+  if (!data_) {
+    CloseHandle(mapping_);
+    CloseHandle(file_);
+    ThrowLastError("MapViewOfFile");
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_) UnmapViewOfFile(data_);
+  if (mapping_) CloseHandle(mapping_);
+  CloseHandle(file_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+    : data_(nullptr), size_(0) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) throw std::system_error(errno, std::generic_category(), "open");
+
+  struct stat status;
+  if (fstat(fd, &status) < 0) {
+    const int error = errno;
+    close(fd);
+    throw std::system_error(error, std::generic_category(), "fstat");
+  }
+  size_ = static_cast<std::size_t>(status.st_size);
+  if (size_ > 0) {
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      const int error = errno;
+      close(fd);
+      throw std::system_error(error, std::generic_category(), "mmap");
+    }
+    data_ = data;
+  }
+  // The mapping stays valid after the descriptor is closed.
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) munmap(data_, size_);
+}
+
+#endif
+
+}  // namespace wiese
@@ -0,0 +1,33 @@
+#ifndef WIESE_MAPPED_FILE_H_
+#define WIESE_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <filesystem>
+
+namespace wiese {
+
+// Read-only view of a whole file mapped into memory. Pages are loaded by the
+// OS as they are touched. Throws std::system_error if the file cannot be
+// opened or mapped.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::filesystem::path& path);
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  const void* data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+ private:
+#ifdef _WIN32
+  void* file_;
+  void* mapping_;
+#endif
+  void* data_;
+  std::size_t size_;
+};
+
+}  // namespace wiese
+
+#endif
@@ -0,0 +1,121 @@
+#include "match_index.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "document_snapshot.h"
+
+namespace wiese {
+
+namespace {
+
+// Adds the pieces for |char_count| characters with no match starting among
+// them.
+void AddGap(std::vector<Piece>& pieces, std::int64_t char_count) {
+  if (char_count > 0) Piece::AppendPlain(0, char_count, pieces);
+}
+
+}  // namespace
+
+MatchIndex::MatchIndex(Document& document, std::wstring_view pattern,
+                       bool ignore_case)
+    : document_(document), searcher_(pattern, ignore_case) {
+  std::shared_ptr<const DocumentSnapshot> snapshot = document_.Snapshot();
+  std::vector<Piece> pieces;
+  std::int64_t position = 0;
+  searcher_.FindAll(snapshot, 0, snapshot->GetCharCount(),
+                    [&](std::int64_t found) {
+                      AddGap(pieces, found - position);
+                      pieces.push_back(Piece::MakeLineBreak());
+                      position = found + 1;
+                    });
+  AddGap(pieces, snapshot->GetCharCount() - position);
+  starts_ = PieceTree(pieces);
+  document_.AddObserver(this);
+}
+
+MatchIndex::~MatchIndex() { document_.RemoveObserver(this); }
+
+std::int64_t MatchIndex::FindNext(std::int64_t position) const {
+  const std::int64_t index = starts_.CountLineBreaksBefore(position);
+  return index < GetMatchCount() ? StartOfMatch(index + 1) : -1;
+}
+
+std::int64_t MatchIndex::FindPrevious(std::int64_t position) const {
+  const std::int64_t index = starts_.CountLineBreaksBefore(position);
+  return index > 0 ? StartOfMatch(index) : -1;
+}
+
+std::vector<std::int64_t> MatchIndex::FindInRange(std::int64_t start,
+                                                  std::int64_t end) const {
+  std::vector<std::int64_t> found;
+  for (auto it = starts_.FindPosition(start);
+       it != starts_.end() && it.offset() < end; ++it) {
+    if (it->IsLineBreak() && it.offset() >= start) found.push_back(it.offset());
+  }
+  return found;
+}
+
+void MatchIndex::OnDocumentChanged(
+    const Document& document, const std::vector<DocumentChange>& changes) {
+  // A match starting this far in front of a change may overlap it, and one
+  // starting in the changed text may reach this far beyond it. Matches
+  // starting at or after the end of a change are not affected. Changes
+  // whose windows touch are rescanned as one.
+  const int reach = std::max(length() - 1, 0);
+  struct Window {
+    std::int64_t old_start;
+    std::int64_t old_end;
+    std::int64_t new_start;
+    std::int64_t new_end;
+  };
+  std::vector<Window> windows;
+  std::int64_t char_delta = 0;
+  for (const DocumentChange& change : changes) {
+    const std::int64_t old_start =
+        std::max<std::int64_t>(change.start - reach, 0);
+    const std::int64_t new_end = change.new_end + char_delta;
+    if (!windows.empty() && old_start <= windows.back().old_end) {
+      windows.back().old_end = change.old_end;
+      windows.back().new_end = new_end;
+    } else {
+      windows.push_back(
+          {old_start, change.old_end, old_start + char_delta, new_end});
+    }
+    char_delta += change.new_end - change.old_end;
+  }
+  // The windows are read in place.
+  std::shared_ptr<const DocumentSnapshot> snapshot = document.Snapshot();
+  std::vector<PieceTree::Replacement> replacements;
+  replacements.reserve(windows.size());
+  for (const Window& window : windows) {
+    std::vector<Piece> pieces;
+    std::int64_t position = window.new_start;
+    searcher_.FindAll(snapshot, window.new_start, window.new_end,
+                      [&](std::int64_t found) {
+                        AddGap(pieces, found - position);
+                        pieces.push_back(Piece::MakeLineBreak());
+                        position = found + 1;
+                      });
+    AddGap(pieces, window.new_end - position);
+    replacements.push_back(
+        {window.old_start, window.old_end, std::move(pieces)});
+  }
+  starts_.ReplaceGaps(replacements);
+}
+
+void MatchIndex::OnDocumentCompacted(const Document&) {
+  PieceTree::MergeGaps({&starts_});
+}
+
+std::int64_t MatchIndex::StartOfMatch(std::int64_t index) const {
+  // The piece after the line break is at the end of the tree if the match
+  // starts at the last character; end() is at the end too.
+  return starts_.FindLine(index).offset() - 1;
+}
+
+}  // namespace wiese
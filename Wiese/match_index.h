@@ -0,0 +1,62 @@
+#ifndef WIESE_MATCH_INDEX_H_
+#define WIESE_MATCH_INDEX_H_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "literal_search.h"
+#include "piece_tree.h"
+
+namespace wiese {
+
+// The starts of all the occurrences of a literal pattern in a document,
+// overlapping ones included, kept up to date as the document is edited.
+//
+// The starts are kept in a PieceTree as long as the text, in which every
+// start is a line break piece and the characters in between are plain
+// pieces. An edit replaces only the part of that tree around the edited
+// range, rescanning the edited text and |length() - 1| characters on both
+// sides, and the starts after it move along for free. So an edit costs
+// O(m + log n) for m characters changed, and the count of matches and the
+// next and the previous match are O(log n).
+class MatchIndex : public DocumentObserver {
+ public:
+  // Scans |document| and observes it until destroyed. |document| must
+  // outlive the index.
+  MatchIndex(Document& document, std::wstring_view pattern, bool ignore_case);
+  MatchIndex(const MatchIndex&) = delete;
+  MatchIndex& operator=(const MatchIndex&) = delete;
+  ~MatchIndex() override;
+
+  // Number of characters in a match.
+  int length() const { return searcher_.length(); }
+  std::int64_t GetMatchCount() const { return starts_.GetLineBreakCount(); }
+  // Returns the start of the first match which starts at or after
+  // |position|, or -1 if there is none.
+  std::int64_t FindNext(std::int64_t position) const;
+  // Returns the start of the last match which starts before |position|, or
+  // -1 if there is none.
+  std::int64_t FindPrevious(std::int64_t position) const;
+  // Returns the starts of the matches which start in [start, end), e.g. to
+  // highlight the visible lines.
+  std::vector<std::int64_t> FindInRange(std::int64_t start,
+                                        std::int64_t end) const;
+
+  void OnDocumentChanged(const Document& document,
+                         const std::vector<DocumentChange>& changes) override;
+  void OnDocumentCompacted(const Document& document) override;
+
+ private:
+  // Returns the start of the |index|-th match, counting from 1.
+  std::int64_t StartOfMatch(std::int64_t index) const;
+
+  Document& document_;
+  LiteralSearcher searcher_;
+  PieceTree starts_;
+};
+
+}  // namespace wiese
+
+#endif
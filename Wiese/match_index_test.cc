@@ -0,0 +1,137 @@
+#include "match_index.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "document.h"
+
+namespace {
+
+std::vector<std::int64_t> ExpectedStarts(const std::wstring& text,
+                                const std::wstring& pattern) {
+  std::vector<std::int64_t> starts;
+  if (pattern.empty()) return starts;
+  for (std::size_t found = text.find(pattern); found != std::wstring::npos;
+       found = text.find(pattern, found + 1)) {
+    starts.push_back(static_cast<std::int64_t>(found));
+  }
+  return starts;
+}
+
+void ExpectIndexMatches(const wiese::MatchIndex& index,
+                        const std::wstring& text,
+                        const std::wstring& pattern) {
+  const std::vector<std::int64_t> expected = ExpectedStarts(text, pattern);
+  const int char_count = static_cast<int>(text.size());
+  ASSERT_EQ(static_cast<int>(expected.size()), index.GetMatchCount());
+  EXPECT_EQ(expected, index.FindInRange(0, char_count));
+  for (int position = 0; position <= char_count; ++position) {
+    auto next = std::lower_bound(expected.begin(), expected.end(), position);
+    EXPECT_EQ(next == expected.end() ? -1 : *next, index.FindNext(position))
+        << position;
+    EXPECT_EQ(next == expected.begin() ? -1 : *(next - 1),
+              index.FindPrevious(position))
+        << position;
+  }
+}
+
+}  // namespace
+
+TEST(MatchIndex, FindsMatches) {
+  wiese::Document doc(L"abcab\nabab");
+  wiese::MatchIndex index(doc, L"ab", false);
+  EXPECT_EQ(2, index.length());
+  EXPECT_EQ(4, index.GetMatchCount());
+  EXPECT_EQ(3, index.FindNext(1));
+  EXPECT_EQ(3, index.FindNext(3));
+  EXPECT_EQ(-1, index.FindNext(9));
+  EXPECT_EQ(0, index.FindPrevious(3));
+  EXPECT_EQ(-1, index.FindPrevious(0));
+  EXPECT_EQ((std::vector<std::int64_t>{3, 6}), index.FindInRange(1, 7));
+}
+
+TEST(MatchIndex, CountsOverlappingMatches) {
+  wiese::Document doc(L"aaaa");
+  wiese::MatchIndex index(doc, L"AA", true);
+  EXPECT_EQ(3, index.GetMatchCount());
+  EXPECT_EQ(2, index.FindPrevious(4));
+}
+
+TEST(MatchIndex, EmptyPatternMatchesNowhere) {
+  wiese::Document doc(L"abc");
+  wiese::MatchIndex index(doc, L"", false);
+  EXPECT_EQ(0, index.GetMatchCount());
+  doc.InsertStringBefore(L"x", 1);
+  EXPECT_EQ(0, index.GetMatchCount());
+  EXPECT_EQ(-1, index.FindNext(0));
+}
+
+TEST(MatchIndex, FollowsEdits) {
+  wiese::Document doc(L"abcab\nabab");
+  wiese::MatchIndex index(doc, L"bab", false);
+  doc.InsertStringBefore(L"ba", 2);
+  ExpectIndexMatches(index, doc.GetText(), L"bab");
+  doc.EraseCharsInRange(3, 5);
+  ExpectIndexMatches(index, doc.GetText(), L"bab");
+  doc.Undo();
+  ExpectIndexMatches(index, doc.GetText(), L"bab");
+  doc.Redo();
+  ExpectIndexMatches(index, doc.GetText(), L"bab");
+}
+
+TEST(MatchIndex, FollowsCompaction) {
+  wiese::Document doc(L"abcab\nabab");
+  wiese::MatchIndex index(doc, L"bab", false);
+  for (int i = 0; i < 10; ++i) {
+    doc.InsertStringBefore(L"ba", 2 + i);
+    doc.EraseCharsInRange(3 + i, 4 + i);
+  }
+  doc.Compact(0);
+  ExpectIndexMatches(index, doc.GetText(), L"bab");
+  doc.InsertStringBefore(L"b", 0);
+  ExpectIndexMatches(index, doc.GetText(), L"bab");
+}
+
+TEST(MatchIndex, RandomEditsAgreeWithStringFind) {
+  std::mt19937 random(1);
+  std::wstring text(500, L'a');
+  for (wchar_t& ch : text) ch = L"ab\n"[random() % 3];
+  wiese::Document doc(text.c_str());
+  const std::wstring pattern = L"aba";
+  wiese::MatchIndex index(doc, pattern, false);
+  for (int i = 0; i < 300; ++i) {
+    const int char_count = doc.GetCharCount();
+    const int start = random() % (char_count + 1);
+    const int end = std::min<int>(start + random() % 8, char_count);
+    std::wstring inserted(random() % 8, L'a');
+    for (wchar_t& ch : inserted) ch = L"ab\n"[random() % 3];
+    switch (random() % 6) {
+      case 0:
+        doc.InsertStringBefore(inserted.c_str(), start);
+        break;
+      case 1:
+        doc.EraseCharsInRange(start, end);
+        break;
+      case 2:
+        doc.ApplyEdits({{start, end, inserted}});
+        break;
+      case 3:
+        if (doc.CanUndo()) doc.Undo();
+        break;
+      case 4:
+        if (doc.CanRedo()) doc.Redo();
+        break;
+      case 5:
+        // Two ranges far apart, as typed with two carets.
+        if (start > 0) doc.ApplyEdits({{start, end, inserted}, {0, 1, L"b"}});
+        break;
+    }
+    ExpectIndexMatches(index, doc.GetText(), pattern);
+    if (HasFatalFailure()) return;
+  }
+}
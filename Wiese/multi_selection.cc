@@ -0,0 +1,127 @@
+#include "multi_selection.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace wiese {
+
+MultiSelection::MultiSelection() : ranges_{{0, 0}}, primary_(0) {}
+
+void MultiSelection::SetPrimary(const Range& range) {
+  ranges_[primary_] = range;
+  Normalize();
+}
+
+void MultiSelection::Add(const Range& range) {
+  // Adding carets one by one is common (e.g. one per line), so insert in
+  // place and only merge when the new range touches a neighbour.
+  auto it = std::lower_bound(ranges_.begin(), ranges_.end(), range.start(),
+                             [](const Range& range, std::int64_t start) {
+                               return range.start() < start;
+                             });
+  it = ranges_.insert(it, range);
+  primary_ = static_cast<int>(it - ranges_.begin());
+  const bool touches_previous =
+      it != ranges_.begin() && range.start() <= (it - 1)->end();
+  const bool touches_next =
+      it + 1 != ranges_.end() && (it + 1)->start() <= range.end();
+  if (touches_previous || touches_next) Normalize();
+}
+
+void MultiSelection::RemoveSecondary() {
+  ranges_ = {primary()};
+  primary_ = 0;
+}
+
+void MultiSelection::InsertText(Document& document, std::wstring_view text) {
+  std::vector<Edit> edits;
+  edits.reserve(ranges_.size());
+  for (const Range& range : ranges_) {
+    edits.push_back({range.start(), range.end(), std::wstring(text)});
+  }
+  Apply(document, std::move(edits));
+}
+
+void MultiSelection::EraseBackward(Document& document) {
+  std::vector<Edit> edits;
+  edits.reserve(ranges_.size());
+  for (const Range& range : ranges_) {
+    const std::int64_t start = range.IsEmpty()
+                                   ? std::max<std::int64_t>(range.caret - 1, 0)
+                                   : range.start();
+    edits.push_back({start, range.end(), std::wstring()});
+  }
+  Apply(document, std::move(edits));
+}
+
+void MultiSelection::EraseForward(Document& document) {
+  const std::int64_t char_count = document.GetCharCount();
+  std::vector<Edit> edits;
+  edits.reserve(ranges_.size());
+  for (const Range& range : ranges_) {
+    const std::int64_t end = range.IsEmpty()
+                                 ? std::min(range.caret + 1, char_count)
+                                 : range.end();
+    edits.push_back({range.start(), end, std::wstring()});
+  }
+  Apply(document, std::move(edits));
+}
+
+void MultiSelection::EraseSelectedText(Document& document) {
+  std::vector<Edit> edits;
+  edits.reserve(ranges_.size());
+  for (const Range& range : ranges_) {
+    edits.push_back({range.start(), range.end(), std::wstring()});
+  }
+  Apply(document, std::move(edits));
+}
+
+void MultiSelection::Apply(Document& document, std::vector<Edit> edits) {
+  assert(edits.size() == ranges_.size());
+  // The ranges are sorted and do not touch, so neither do the edits, and
+  // each range only moves by the edits in front of it.
+  std::int64_t delta = 0;
+  for (std::size_t i = 0; i < edits.size(); ++i) {
+    const Edit& edit = edits[i];
+    const std::int64_t text_size = Document::GetInsertedCharCount(edit.text);
+    const std::int64_t caret = edit.start + delta + text_size;
+    ranges_[i] = {caret, caret};
+    delta += text_size - (edit.end - edit.start);
+  }
+  document.ApplyEdits(std::move(edits));
+  Normalize();
+}
+
+void MultiSelection::Normalize() {
+  std::vector<int> order(ranges_.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [this](int lhs, int rhs) {
+    return ranges_[lhs].start() < ranges_[rhs].start();
+  });
+  std::vector<Range> ranges;
+  ranges.reserve(ranges_.size());
+  int primary = 0;
+  for (int index : order) {
+    const Range& range = ranges_[index];
+    if (!ranges.empty() && range.start() <= ranges.back().end()) {
+      // Merge into the previous range, keeping its direction.
+      Range& last = ranges.back();
+      const std::int64_t start = last.start();
+      const std::int64_t end = std::max(last.end(), range.end());
+      last = last.anchor <= last.caret ? Range{start, end} : Range{end, start};
+    } else {
+      ranges.push_back(range);
+    }
+    if (index == primary_) primary = static_cast<int>(ranges.size()) - 1;
+  }
+  ranges_ = std::move(ranges);
+  primary_ = primary;
+}
+
+}  // namespace wiese
@@ -0,0 +1,68 @@
+#ifndef WIESE_MULTI_SELECTION_H_
+#define WIESE_MULTI_SELECTION_H_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+
+namespace wiese {
+
+// Any number of selections which are edited together, e.g. a caret on each
+// of many lines. The selections are kept sorted and are merged when they
+// touch. One of them is the primary selection, the one the window shows the
+// system caret for.
+//
+// Every edit function below turns the selections into one list of edits,
+// applies it with Document::ApplyEdits and moves all the selections in one
+// sweep over the list, so a keystroke is O(k log n) for k selections.
+class MultiSelection {
+ public:
+  // Positions are character offsets in the document.
+  struct Range {
+    std::int64_t anchor;
+    std::int64_t caret;
+
+    std::int64_t start() const { return anchor < caret ? anchor : caret; }
+    std::int64_t end() const { return anchor < caret ? caret : anchor; }
+    bool IsEmpty() const { return anchor == caret; }
+  };
+
+  // Starts with a single caret at the start of the document.
+  MultiSelection();
+
+  const std::vector<Range>& ranges() const { return ranges_; }
+  const Range& primary() const { return ranges_[primary_]; }
+
+  void SetPrimary(const Range& range);
+  // Adds |range| and makes it the primary selection.
+  void Add(const Range& range);
+  // Removes all selections but the primary one.
+  void RemoveSecondary();
+
+  // Replaces every selection with |text| and puts the carets after it.
+  void InsertText(Document& document, std::wstring_view text);
+  // Erases the text in every selection; empty selections erase the
+  // character in front of the caret.
+  void EraseBackward(Document& document);
+  // Erases the text in every selection; empty selections erase the
+  // character after the caret.
+  void EraseForward(Document& document);
+  // Erases the text in every selection, leaving empty ones alone.
+  void EraseSelectedText(Document& document);
+
+ private:
+  // Applies |edits|, one for each range in the same order, and collapses
+  // every range to a caret after the text its edit inserted.
+  void Apply(Document& document, std::vector<Edit> edits);
+  // Sorts the ranges and merges the ones which touch.
+  void Normalize();
+
+  std::vector<Range> ranges_;
+  int primary_;
+};
+
+}  // namespace wiese
+
+#endif
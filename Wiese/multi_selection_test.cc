@@ -0,0 +1,129 @@
+#include "multi_selection.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+#include "document.h"
+
+namespace {
+
+constexpr const wchar_t* kText = L"abc\ndef\nghi";
+
+// Puts a caret at the start of every line of |doc|.
+wiese::MultiSelection CaretAtEveryLine(const wiese::Document& doc) {
+  wiese::MultiSelection selection;
+  for (int line = 1; line < doc.GetLineCount(); ++line) {
+    const int offset = doc.OffsetOfLine(line);
+    selection.Add({offset, offset});
+  }
+  return selection;
+}
+
+}  // namespace
+
+TEST(MultiSelection, InsertText) {
+  wiese::Document doc(kText);
+  auto selection = CaretAtEveryLine(doc);
+  selection.InsertText(doc, L"> ");
+  EXPECT_EQ(L"> abc\n> def\n> ghi", doc.GetText());
+  ASSERT_EQ(3u, selection.ranges().size());
+  EXPECT_EQ(2, selection.ranges()[0].caret);
+  EXPECT_EQ(8, selection.ranges()[1].caret);
+  EXPECT_EQ(14, selection.primary().caret);
+}
+
+TEST(MultiSelection, InsertText_ReplacesRanges) {
+  wiese::Document doc(kText);
+  wiese::MultiSelection selection;
+  selection.SetPrimary({0, 2});
+  selection.Add({9, 5});
+  selection.InsertText(doc, L"\n");
+  EXPECT_EQ(L"\nc\nd\nhi", doc.GetText());
+  EXPECT_EQ(1, selection.ranges()[0].caret);
+  EXPECT_EQ(5, selection.ranges()[1].caret);
+}
+
+TEST(MultiSelection, InsertText_CrLf) {
+  wiese::Document doc(kText);
+  auto selection = CaretAtEveryLine(doc);
+  selection.InsertText(doc, L"\r\n");
+  EXPECT_EQ(L"\nabc\n\ndef\n\nghi", doc.GetText());
+  ASSERT_EQ(3u, selection.ranges().size());
+  EXPECT_EQ(1, selection.ranges()[0].caret);
+  EXPECT_EQ(6, selection.ranges()[1].caret);
+  EXPECT_EQ(11, selection.primary().caret);
+}
+
+TEST(MultiSelection, EraseBackward) {
+  wiese::Document doc(kText);
+  auto selection = CaretAtEveryLine(doc);
+  selection.EraseBackward(doc);
+  EXPECT_EQ(L"abcdefghi", doc.GetText());
+  ASSERT_EQ(3u, selection.ranges().size());
+  EXPECT_EQ(0, selection.ranges()[0].caret);
+  EXPECT_EQ(3, selection.ranges()[1].caret);
+  EXPECT_EQ(6, selection.ranges()[2].caret);
+  // The carets on the first two lines run into each other.
+  selection.EraseBackward(doc);
+  selection.EraseBackward(doc);
+  selection.EraseBackward(doc);
+  EXPECT_EQ(L"ghi", doc.GetText());
+  EXPECT_EQ(1u, selection.ranges().size());
+}
+
+TEST(MultiSelection, EraseForward) {
+  wiese::Document doc(kText);
+  wiese::MultiSelection selection;
+  selection.SetPrimary({3, 3});
+  selection.Add({7, 7});
+  selection.Add({11, 11});
+  selection.EraseForward(doc);
+  EXPECT_EQ(L"abcdefghi", doc.GetText());
+  EXPECT_EQ(3u, selection.ranges().size());
+}
+
+TEST(MultiSelection, EraseSelectedText) {
+  wiese::Document doc(kText);
+  wiese::MultiSelection selection;
+  selection.SetPrimary({1, 1});
+  selection.Add({4, 6});
+  selection.EraseSelectedText(doc);
+  EXPECT_EQ(L"abc\nf\nghi", doc.GetText());
+  EXPECT_EQ(1, selection.ranges()[0].caret);
+  EXPECT_EQ(4, selection.primary().caret);
+}
+
+TEST(MultiSelection, MergesTouchingRanges) {
+  wiese::MultiSelection selection;
+  selection.SetPrimary({2, 4});
+  selection.Add({6, 4});
+  selection.Add({9, 9});
+  ASSERT_EQ(2u, selection.ranges().size());
+  EXPECT_EQ(2, selection.ranges()[0].anchor);
+  EXPECT_EQ(6, selection.ranges()[0].caret);
+  EXPECT_EQ(9, selection.primary().caret);
+}
+
+TEST(MultiSelection, OneUndoStepPerKeystroke) {
+  wiese::Document doc(kText);
+  auto selection = CaretAtEveryLine(doc);
+  selection.InsertText(doc, L"x");
+  selection.InsertText(doc, L"y");
+  doc.Undo();
+  EXPECT_EQ(L"xabc\nxdef\nxghi", doc.GetText());
+}
+
+TEST(MultiSelection, ManyCarets) {
+  std::wstring text;
+  for (int i = 0; i < 10000; ++i) text += L"a,b\n";
+  wiese::Document doc(text.c_str());
+  auto selection = CaretAtEveryLine(doc);
+  for (auto ch : std::wstring(L"xyz")) {
+    selection.InsertText(doc, std::wstring(1, ch));
+  }
+  selection.EraseBackward(doc);
+  EXPECT_EQ(10001u, selection.ranges().size());
+  EXPECT_EQ(L"xya,b\nxya,b\n", doc.GetText().substr(0, 12));
+  EXPECT_EQ(10000 * 6 + 2, doc.GetCharCount());
+}
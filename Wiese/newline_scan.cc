@@ -0,0 +1,233 @@
+#include "newline_scan.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "simd.h"
+
+namespace wiese {
+
+namespace {
+
+// Texts shorter than this are not worth starting threads for.
+constexpr std::int64_t kMinCharsPerThread = 4 << 20;
+
+// Returns the first L'\n' in [first, last), or the first L'\n' or L'\r' if
+// |kWithCarriageReturn|.
+template <bool kWithCarriageReturn>
+const wchar_t* FindScalar(const wchar_t* first, const wchar_t* last) {
+  if constexpr (kWithCarriageReturn) {
+    return std::find_if(first, last,
+                        [](wchar_t ch) { return ch == L'\n' || ch == L'\r'; });
+  } else {
+    return std::find(first, last, L'\n');
+  }
+}
+
+#ifdef WIESE_HAS_SSE2
+
+template <bool kWithCarriageReturn>
+__m128i CompareLineBreak(__m128i chars) {
+  if constexpr (sizeof(wchar_t) == 2) {
+    __m128i eq = _mm_cmpeq_epi16(chars, _mm_set1_epi16(L'\n'));
+    if constexpr (kWithCarriageReturn) {
+      eq = _mm_or_si128(eq, _mm_cmpeq_epi16(chars, _mm_set1_epi16(L'\r')));
+    }
+    return eq;
+  } else {
+    __m128i eq = _mm_cmpeq_epi32(chars, _mm_set1_epi32(L'\n'));
+    if constexpr (kWithCarriageReturn) {
+      eq = _mm_or_si128(eq, _mm_cmpeq_epi32(chars, _mm_set1_epi32(L'\r')));
+    }
+    return eq;
+  }
+}
+
+template <bool kWithCarriageReturn>
+const wchar_t* FindSse2(const wchar_t* first, const wchar_t* last) {
+  constexpr int kCharsPerVector = sizeof(__m128i) / sizeof(wchar_t);
+  const auto compare = [](__m128i chars) {
+    return CompareLineBreak<kWithCarriageReturn>(chars);
+  };
+  while (last - first >= kCharsPerVector * 4) {
+    const __m128i* p = reinterpret_cast<const __m128i*>(first);
+    const __m128i eq0 = compare(_mm_loadu_si128(p));
+    const __m128i eq1 = compare(_mm_loadu_si128(p + 1));
+    const __m128i eq2 = compare(_mm_loadu_si128(p + 2));
+    const __m128i eq3 = compare(_mm_loadu_si128(p + 3));
+    const __m128i any =
+        _mm_or_si128(_mm_or_si128(eq0, eq1), _mm_or_si128(eq2, eq3));
+    if (_mm_movemask_epi8(any)) break;
+    first += kCharsPerVector * 4;
+  }
+  while (last - first >= kCharsPerVector) {
+    const __m128i chars =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+    const int mask = _mm_movemask_epi8(compare(chars));
+    if (mask) return first + CountTrailingZeros(mask) / sizeof(wchar_t);
+    first += kCharsPerVector;
+  }
+  return FindScalar<kWithCarriageReturn>(first, last);
+}
+
+template <bool kWithCarriageReturn>
+WIESE_TARGET_AVX2 __m256i CompareLineBreak256(__m256i chars) {
+  if constexpr (sizeof(wchar_t) == 2) {
+    __m256i eq = _mm256_cmpeq_epi16(chars, _mm256_set1_epi16(L'\n'));
+    if constexpr (kWithCarriageReturn) {
+      eq = _mm256_or_si256(
+          eq, _mm256_cmpeq_epi16(chars, _mm256_set1_epi16(L'\r')));
+    }
+    return eq;
+  } else {
+    __m256i eq = _mm256_cmpeq_epi32(chars, _mm256_set1_epi32(L'\n'));
+    if constexpr (kWithCarriageReturn) {
+      eq = _mm256_or_si256(
+          eq, _mm256_cmpeq_epi32(chars, _mm256_set1_epi32(L'\r')));
+    }
+    return eq;
+  }
+}
+
+template <bool kWithCarriageReturn>
+WIESE_TARGET_AVX2 const wchar_t* FindAvx2(const wchar_t* first,
+                                          const wchar_t* last) {
+  constexpr int kCharsPerVector = sizeof(__m256i) / sizeof(wchar_t);
+  while (last - first >= kCharsPerVector * 4) {
+    const __m256i* p = reinterpret_cast<const __m256i*>(first);
+    const __m256i eq0 =
+        CompareLineBreak256<kWithCarriageReturn>(_mm256_loadu_si256(p));
+    const __m256i eq1 =
+        CompareLineBreak256<kWithCarriageReturn>(_mm256_loadu_si256(p + 1));
+    const __m256i eq2 =
+        CompareLineBreak256<kWithCarriageReturn>(_mm256_loadu_si256(p + 2));
+    const __m256i eq3 =
+        CompareLineBreak256<kWithCarriageReturn>(_mm256_loadu_si256(p + 3));
+    const __m256i any = _mm256_or_si256(_mm256_or_si256(eq0, eq1),
+                                        _mm256_or_si256(eq2, eq3));
+    if (_mm256_movemask_epi8(any)) break;
+    first += kCharsPerVector * 4;
+  }
+  while (last - first >= kCharsPerVector) {
+    const __m256i chars =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+    const std::uint32_t mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(
+        CompareLineBreak256<kWithCarriageReturn>(chars)));
+    if (mask) return first + CountTrailingZeros(mask) / sizeof(wchar_t);
+    first += kCharsPerVector;
+  }
+  // Mixing SSE and AVX instructions is slow while the upper halves of the
+  // YMM registers are in use, and GCC does not clear them on a tail call.
+  _mm256_zeroupper();
+  return FindSse2<kWithCarriageReturn>(first, last);
+}
+
+#endif
+
+template <bool kWithCarriageReturn>
+const wchar_t* Find(const wchar_t* first, const wchar_t* last) {
+#ifdef WIESE_HAS_SSE2
+  static const auto find = HasAvx2() ? FindAvx2<kWithCarriageReturn>
+                                     : FindSse2<kWithCarriageReturn>;
+  return find(first, last);
+#else
+  return FindScalar<kWithCarriageReturn>(first, last);
+#endif
+}
+
+// Appends the positions of the L'\n' and L'\r' in [begin, end) of |text|.
+void CollectLineEnds(std::wstring_view text, std::int64_t begin,
+                     std::int64_t end, std::vector<std::int64_t>& positions) {
+  const wchar_t* const first = text.data();
+  const wchar_t* p = first + begin;
+  const wchar_t* const last = first + end;
+  while ((p = FindLineEnd(p, last)) != last) {
+    positions.push_back(p - first);
+    ++p;
+  }
+}
+
+}  // namespace
+
+const wchar_t* FindLineBreakScalar(const wchar_t* first, const wchar_t* last) {
+  return FindScalar<false>(first, last);
+}
+
+const wchar_t* FindLineBreak(const wchar_t* first, const wchar_t* last) {
+  return Find<false>(first, last);
+}
+
+const wchar_t* FindLineEnd(const wchar_t* first, const wchar_t* last) {
+  return Find<true>(first, last);
+}
+
+LineEnding GetLineEndingAt(const wchar_t* line_end, const wchar_t* last) {
+  if (*line_end == L'\n') return LineEnding::kLf;
+  assert(*line_end == L'\r');
+  return line_end + 1 != last && line_end[1] == L'\n' ? LineEnding::kCrLf
+                                                       : LineEnding::kCr;
+}
+
+LineEnding FindDominantLineEnding(const std::vector<Piece>& pieces) {
+  std::array<std::size_t, 3> counts = {};
+  for (const Piece& piece : pieces) {
+    if (piece.IsLineBreak()) ++counts[static_cast<int>(piece.line_ending())];
+  }
+  return static_cast<LineEnding>(
+      std::max_element(counts.begin(), counts.end()) - counts.begin());
+}
+
+std::vector<Piece> SplitIntoLines(std::wstring_view text, std::int64_t start,
+                                  int thread_count) {
+  const std::int64_t size = static_cast<std::int64_t>(text.size());
+  if (thread_count <= 0) {
+    const int cores = static_cast<int>(std::thread::hardware_concurrency());
+    thread_count = static_cast<int>(
+        std::clamp<std::int64_t>((size - start) / kMinCharsPerThread, 1,
+                                 std::max(cores, 1)));
+  }
+
+  // Every thread scans its own slice. The slices are stitched together in
+  // order below, so the result does not depend on the number of threads.
+  std::vector<std::vector<std::int64_t>> line_breaks(thread_count);
+  const std::int64_t slice_size = (size - start) / thread_count;
+  auto scan_slice = [&](int i) {
+    const std::int64_t begin = start + slice_size * i;
+    const std::int64_t end = i == thread_count - 1 ? size : begin + slice_size;
+    CollectLineEnds(text, begin, end, line_breaks[i]);
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < thread_count; ++i) threads.emplace_back(scan_slice, i);
+  scan_slice(0);
+  for (auto& thread : threads) thread.join();
+
+  std::size_t line_break_count = 0;
+  for (const auto& positions : line_breaks) {
+    line_break_count += positions.size();
+  }
+  std::vector<Piece> pieces;
+  pieces.reserve(line_break_count * 2 + 1);
+  for (const auto& positions : line_breaks) {
+    for (std::int64_t position : positions) {
+      // The L'\n' of a CRLF, taken together with the L'\r' in front of it,
+      // which may have been found by the previous slice.
+      if (position < start) continue;
+      const LineEnding ending =
+          GetLineEndingAt(text.data() + position, text.data() + size);
+      Piece::AppendOriginal(start, position, pieces);
+      pieces.push_back(Piece::MakeLineBreak(ending));
+      start = position + static_cast<std::int64_t>(
+                             GetLineEndingChars(ending).size());
+    }
+  }
+  if (size - start > 0) Piece::AppendOriginal(start, size, pieces);
+  return pieces;
+}
+
+}  // namespace wiese
@@ -0,0 +1,46 @@
+#ifndef WIESE_NEWLINE_SCAN_H_
+#define WIESE_NEWLINE_SCAN_H_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "piece_tree.h"
+
+namespace wiese {
+
+// Returns the first L'\n' in [first, last), or |last| if there is none. Uses
+// AVX2 or SSE2 when the CPU has them.
+const wchar_t* FindLineBreak(const wchar_t* first, const wchar_t* last);
+
+// Same as FindLineBreak but never uses vector instructions. Exposed for tests
+// and benchmarks.
+const wchar_t* FindLineBreakScalar(const wchar_t* first, const wchar_t* last);
+
+// Returns the first L'\n' or L'\r' in [first, last), or |last| if there is
+// none. Uses AVX2 or SSE2 when the CPU has them.
+const wchar_t* FindLineEnd(const wchar_t* first, const wchar_t* last);
+
+// Returns the line ending starting at |line_end|, which FindLineEnd returned
+// for [first, last).
+LineEnding GetLineEndingAt(const wchar_t* line_end, const wchar_t* last);
+
+// Returns the line ending most of the line breaks in |pieces| have, or
+// LineEnding::kLf if there are none. Ties go to LF, then CRLF.
+LineEnding FindDominantLineEnding(const std::vector<Piece>& pieces);
+
+// Splits text[start:] into original pieces separated by line breaks: every
+// line ending (L"\n", L"\r\n" or a lone L'\r') becomes a line break piece
+// with that ending, preceded by the (possibly empty) original piece in front
+// of it, and the text after the last one becomes the last piece if it is not
+// empty. A line longer than Piece::kMaxLength takes more than one piece.
+//
+// Large texts are scanned in slices on |thread_count| threads and the slices
+// are stitched together afterwards; 0 picks the number of threads from the
+// text size and the number of cores.
+std::vector<Piece> SplitIntoLines(std::wstring_view text, std::int64_t start,
+                                  int thread_count = 0);
+
+}  // namespace wiese
+
+#endif
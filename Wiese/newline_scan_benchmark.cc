@@ -0,0 +1,79 @@
+// Benchmarks for the newline scan. They are disabled by default; run them
+// with --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*.
+
+#include "newline_scan.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+namespace {
+
+constexpr std::size_t kInputBytes = std::size_t{1} << 30;
+constexpr int kLineLength = 80;
+
+const std::wstring& GetInput() {
+  static const std::wstring text = [] {
+    std::wstring text(kInputBytes / sizeof(wchar_t), L'x');
+    for (std::size_t i = kLineLength; i < text.size(); i += kLineLength + 1) {
+      text[i] = L'\n';
+    }
+    return text;
+  }();
+  return text;
+}
+
+template <typename Function>
+void Measure(const char* name, Function function) {
+  const auto start = std::chrono::steady_clock::now();
+  const std::size_t result = function();
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  const double gigabytes_per_second =
+      kInputBytes / elapsed.count() / (1 << 30);
+  std::cout << name << ": " << gigabytes_per_second << " GB/s (" << result
+            << ")" << std::endl;
+  ::testing::Test::RecordProperty(name, std::to_string(gigabytes_per_second));
+}
+
+std::size_t CountLineBreaks(const wchar_t* (*find)(const wchar_t*,
+                                                   const wchar_t*)) {
+  const std::wstring& text = GetInput();
+  const wchar_t* p = text.data();
+  const wchar_t* const last = p + text.size();
+  std::size_t count = 0;
+  while ((p = find(p, last)) != last) {
+    ++count;
+    ++p;
+  }
+  return count;
+}
+
+}  // namespace
+
+TEST(NewlineScanBenchmark, DISABLED_FindLineBreakScalar) {
+  GetInput();
+  Measure("FindLineBreakScalar",
+          [] { return CountLineBreaks(wiese::FindLineBreakScalar); });
+}
+
+TEST(NewlineScanBenchmark, DISABLED_FindLineBreak) {
+  GetInput();
+  Measure("FindLineBreak",
+          [] { return CountLineBreaks(wiese::FindLineBreak); });
+}
+
+TEST(NewlineScanBenchmark, DISABLED_SplitIntoLinesSingleThread) {
+  GetInput();
+  Measure("SplitIntoLines(1 thread)",
+          [] { return wiese::SplitIntoLines(GetInput(), 0, 1).size(); });
+}
+
+TEST(NewlineScanBenchmark, DISABLED_SplitIntoLines) {
+  GetInput();
+  Measure("SplitIntoLines",
+          [] { return wiese::SplitIntoLines(GetInput(), 0).size(); });
+}
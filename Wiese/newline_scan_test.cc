@@ -0,0 +1,121 @@
+#include "newline_scan.h"
+
+#include "gtest/gtest.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+TEST(FindLineBreak, ReturnsLastIfNotFound) {
+  std::wstring text(100, L'x');
+  const wchar_t* last = text.data() + text.size();
+  EXPECT_EQ(last, wiese::FindLineBreak(text.data(), last));
+}
+
+TEST(FindLineBreak, FindsLineBreakAtAnyOffsetAndAlignment) {
+  std::wstring text(300, L'x');
+  for (int begin = 0; begin < 16; ++begin) {
+    for (int i = begin; i < static_cast<int>(text.size()); ++i) {
+      text[i] = L'\n';
+      const wchar_t* first = text.data() + begin;
+      const wchar_t* last = text.data() + text.size();
+      EXPECT_EQ(text.data() + i, wiese::FindLineBreak(first, last));
+      text[i] = L'x';
+    }
+  }
+}
+
+TEST(FindLineBreak, FindsFirstOfMany) {
+  std::wstring text(100, L'\n');
+  EXPECT_EQ(text.data() + 3,
+            wiese::FindLineBreak(text.data() + 3, text.data() + 100));
+}
+
+TEST(FindLineEnd, FindsCarriageReturnAndLineFeed) {
+  std::wstring text(300, L'x');
+  for (int i = 0; i < static_cast<int>(text.size()); ++i) {
+    for (wchar_t ch : {L'\r', L'\n'}) {
+      text[i] = ch;
+      const wchar_t* last = text.data() + text.size();
+      EXPECT_EQ(text.data() + i, wiese::FindLineEnd(text.data(), last));
+      EXPECT_EQ(ch == L'\n' ? text.data() + i : last,
+                wiese::FindLineBreak(text.data(), last));
+    }
+    text[i] = L'x';
+  }
+}
+
+TEST(SplitIntoLines, Layout) {
+  auto pieces = wiese::SplitIntoLines(L"01234\n6789a", 0);
+  ASSERT_EQ(3u, pieces.size());
+  EXPECT_EQ(wiese::Piece::MakeOriginal(0, 5), pieces[0]);
+  EXPECT_EQ(wiese::Piece::MakeLineBreak(), pieces[1]);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(6, 11), pieces[2]);
+}
+
+TEST(SplitIntoLines, ConsecutiveLineBreaks) {
+  auto pieces = wiese::SplitIntoLines(L"\n\nab\n", 0);
+  ASSERT_EQ(6u, pieces.size());
+  EXPECT_EQ(wiese::Piece::MakeOriginal(0, 0), pieces[0]);
+  EXPECT_EQ(wiese::Piece::MakeLineBreak(), pieces[1]);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(1, 1), pieces[2]);
+  EXPECT_EQ(wiese::Piece::MakeLineBreak(), pieces[3]);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(2, 4), pieces[4]);
+  EXPECT_EQ(wiese::Piece::MakeLineBreak(), pieces[5]);
+}
+
+TEST(SplitIntoLines, LineEndings) {
+  auto pieces = wiese::SplitIntoLines(L"a\r\nb\rc\r\r\n", 0);
+  ASSERT_EQ(8u, pieces.size());
+  EXPECT_EQ(wiese::Piece::MakeOriginal(0, 1), pieces[0]);
+  EXPECT_EQ(wiese::Piece::MakeLineBreak(wiese::LineEnding::kCrLf), pieces[1]);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(3, 4), pieces[2]);
+  EXPECT_EQ(wiese::Piece::MakeLineBreak(wiese::LineEnding::kCr), pieces[3]);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(5, 6), pieces[4]);
+  EXPECT_EQ(wiese::Piece::MakeLineBreak(wiese::LineEnding::kCr), pieces[5]);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(7, 7), pieces[6]);
+  EXPECT_EQ(wiese::Piece::MakeLineBreak(wiese::LineEnding::kCrLf), pieces[7]);
+  // Ties go to CRLF before CR.
+  EXPECT_EQ(wiese::LineEnding::kCrLf, wiese::FindDominantLineEnding(pieces));
+}
+
+TEST(SplitIntoLines, StartsAtGivenOffset) {
+  auto pieces = wiese::SplitIntoLines(L"xab", 1);
+  ASSERT_EQ(1u, pieces.size());
+  EXPECT_EQ(wiese::Piece::MakeOriginal(1, 3), pieces[0]);
+}
+
+TEST(SplitIntoLines, ThreadsDoNotChangeLayout) {
+  std::mt19937 random(1);
+  std::wstring text(100000, L'x');
+  for (auto& ch : text) {
+    if (random() % 20 == 0) ch = L"\n\r"[random() % 2];
+  }
+  const auto expected = wiese::SplitIntoLines(text, 0, 1);
+  for (int thread_count : {2, 3, 8}) {
+    EXPECT_EQ(expected, wiese::SplitIntoLines(text, 0, thread_count));
+  }
+}
+
+TEST(SplitIntoLines, CRLFSplitBetweenThreads) {
+  // Every slice but the last ends with the L'\r' of a CRLF when there are two
+  // or four threads.
+  std::wstring text(40, L'x');
+  for (int i = 9; i < 40; i += 10) text.replace(i, 2, L"\r\n");
+  for (int thread_count : {1, 2, 4}) {
+    const auto pieces = wiese::SplitIntoLines(text, 0, thread_count);
+    ASSERT_EQ(8u, pieces.size()) << thread_count;
+    EXPECT_EQ(wiese::Piece::MakeOriginal(11, 19), pieces[2]);
+    for (int i = 1; i < 8; i += 2) {
+      EXPECT_EQ(wiese::Piece::MakeLineBreak(wiese::LineEnding::kCrLf),
+                pieces[i]);
+    }
+  }
+}
+
+TEST(FindDominantLineEnding, DefaultsToLF) {
+  EXPECT_EQ(wiese::LineEnding::kLf, wiese::FindDominantLineEnding({}));
+  EXPECT_EQ(wiese::LineEnding::kLf,
+            wiese::FindDominantLineEnding(
+                wiese::SplitIntoLines(L"a\nb\r\n", 0)));
+}
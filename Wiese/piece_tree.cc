@@ -0,0 +1,779 @@
+#include "piece_tree.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace wiese {
+
+Piece Piece::Make(Kind kind, std::int64_t start, std::int64_t end) {
+  assert(start <= end && end - start <= kMaxLength);
+  Piece piece(kind);
+  piece.SetStart(start);
+  piece.length_ = static_cast<std::uint32_t>(end - start);
+  return piece;
+}
+
+Piece Piece::MakeOriginal(std::int64_t start, std::int64_t end) {
+  return Make(Kind::kOriginal, start, end);
+}
+
+Piece Piece::MakePlain(std::int64_t start, std::int64_t end) {
+  return Make(Kind::kPlain, start, end);
+}
+
+Piece Piece::MakeLineBreak(LineEnding ending) {
+  Piece piece(Kind::kLineBreak);
+  piece.line_ending_ = ending;
+  return piece;
+}
+
+void Piece::AppendOriginal(std::int64_t start, std::int64_t end,
+                           std::vector<Piece>& pieces) {
+  for (; end - start > kMaxLength; start += kMaxLength) {
+    pieces.push_back(MakeOriginal(start, start + kMaxLength));
+  }
+  pieces.push_back(MakeOriginal(start, end));
+}
+
+void Piece::AppendPlain(std::int64_t start, std::int64_t end,
+                        std::vector<Piece>& pieces) {
+  for (; end - start > kMaxLength; start += kMaxLength) {
+    pieces.push_back(MakePlain(start, start + kMaxLength));
+  }
+  pieces.push_back(MakePlain(start, end));
+}
+
+// Nodes are shared between trees, so every node counts the trees and parent
+// nodes referring to it. A node referred to more than once is never modified;
+// the functions below copy it first (see Mutable), so an edit copies only the
+// nodes on the paths it touches and the rest stays shared. The count is
+// atomic because copies of a tree may be released on other threads.
+struct PieceTree::Node {
+  Node* left = nullptr;
+  Node* right = nullptr;
+  std::atomic<int> ref_count{1};
+  int height = 1;
+  // Summary of the whole subtree rooted at this node.
+  Summary summary;
+  int count = 0;
+  Piece pieces[kMaxPiecesPerNode];
+};
+
+namespace {
+
+using Node = PieceTree::Node;
+using Summary = PieceTree::Summary;
+constexpr int kMaxPiecesPerNode = PieceTree::kMaxPiecesPerNode;
+
+int Height(const Node* node) { return node ? node->height : 0; }
+
+Summary SummaryOf(const Node* node) { return node ? node->summary : Summary(); }
+
+Summary SummaryOf(const Piece& piece) {
+  Summary summary;
+  summary.char_count = piece.GetCharCount();
+  summary.line_break_count = piece.IsLineBreak() ? 1 : 0;
+  return summary;
+}
+
+void Update(Node* node) {
+  node->height = std::max(Height(node->left), Height(node->right)) + 1;
+  Summary summary = SummaryOf(node->left);
+  for (int i = 0; i < node->count; ++i) {
+    summary += SummaryOf(node->pieces[i]);
+  }
+  summary += SummaryOf(node->right);
+  node->summary = summary;
+}
+
+Node* NewNode(const Piece* pieces, int count) {
+  assert(0 < count && count <= kMaxPiecesPerNode);
+  Node* node = new Node;
+  std::copy(pieces, pieces + count, node->pieces);
+  node->count = count;
+  Update(node);
+  return node;
+}
+
+Node* Retain(Node* node) {
+  if (node) node->ref_count.fetch_add(1, std::memory_order_relaxed);
+  return node;
+}
+
+void Release(Node* node) {
+  if (!node || node->ref_count.fetch_sub(1, std::memory_order_acq_rel) > 1) {
+    return;
+  }
+  Release(node->left);
+  Release(node->right);
+  delete node;
+}
+
+// Returns a node with the contents of |node| which the caller may modify.
+// Takes over the caller's reference to |node|: if it is the only one, |node|
+// itself is returned, otherwise a copy sharing its children.
+Node* Mutable(Node* node) {
+  assert(node);
+  if (node->ref_count.load(std::memory_order_acquire) == 1) return node;
+  Node* copy = new Node;
+  copy->left = Retain(node->left);
+  copy->right = Retain(node->right);
+  copy->height = node->height;
+  copy->summary = node->summary;
+  copy->count = node->count;
+  std::copy(node->pieces, node->pieces + node->count, copy->pieces);
+  Release(node);
+  return copy;
+}
+
+// The functions below take over the caller's references to the trees passed
+// to them and return a new reference. A node passed as |middle| or rotated
+// must already be mutable.
+
+Node* RotateLeft(Node* node) {
+  Node* right = Mutable(node->right);
+  node->right = right->left;
+  Update(node);
+  right->left = node;
+  Update(right);
+  return right;
+}
+
+Node* RotateRight(Node* node) {
+  Node* left = Mutable(node->left);
+  node->left = left->right;
+  Update(node);
+  left->right = node;
+  Update(left);
+  return left;
+}
+
+Node* JoinRight(Node* left, Node* middle, Node* right) {
+  left = Mutable(left);
+  Node* child = left->right;
+  if (Height(child) <= Height(right) + 1) {
+    middle->left = child;
+    middle->right = right;
+    Update(middle);
+    if (Height(middle) <= Height(left->left) + 1) {
+      left->right = middle;
+      Update(left);
+      return left;
+    }
+    left->right = RotateRight(middle);
+    Update(left);
+    return RotateLeft(left);
+  }
+  left->right = JoinRight(child, middle, right);
+  Update(left);
+  if (Height(left->right) <= Height(left->left) + 1) return left;
+  return RotateLeft(left);
+}
+
+Node* JoinLeft(Node* left, Node* middle, Node* right) {
+  right = Mutable(right);
+  Node* child = right->left;
+  if (Height(child) <= Height(left) + 1) {
+    middle->left = left;
+    middle->right = child;
+    Update(middle);
+    if (Height(middle) <= Height(right->right) + 1) {
+      right->left = middle;
+      Update(right);
+      return right;
+    }
+    right->left = RotateLeft(middle);
+    Update(right);
+    return RotateRight(right);
+  }
+  right->left = JoinLeft(left, middle, child);
+  Update(right);
+  if (Height(right->left) <= Height(right->right) + 1) return right;
+  return RotateRight(right);
+}
+
+// Concatenates |left|, the detached node |middle| and |right|, rebalancing as
+// needed. Runs in O(|height(left) - height(right)|).
+Node* Join(Node* left, Node* middle, Node* right) {
+  if (Height(left) > Height(right) + 1) return JoinRight(left, middle, right);
+  if (Height(right) > Height(left) + 1) return JoinLeft(left, middle, right);
+  middle->left = left;
+  middle->right = right;
+  Update(middle);
+  return middle;
+}
+
+// Detaches the last node of |tree|. Returns the rest of the tree and the node.
+std::pair<Node*, Node*> SplitLast(Node* tree) {
+  assert(tree);
+  tree = Mutable(tree);
+  if (!tree->right) {
+    Node* rest = tree->left;
+    tree->left = nullptr;
+    Update(tree);
+    return {rest, tree};
+  }
+  auto [rest, last] = SplitLast(tree->right);
+  return {Join(tree->left, tree, rest), last};
+}
+
+Node* Concat(Node* left, Node* right) {
+  if (!left) return right;
+  if (!right) return left;
+  auto [rest, last] = SplitLast(left);
+  return Join(rest, last, right);
+}
+
+const Node* FirstNode(const Node* tree) {
+  while (tree->left) tree = tree->left;
+  return tree;
+}
+
+// Copies the pieces held by |source| in front of the first piece of |tree|.
+Node* PrependPieces(Node* tree, const Node* source) {
+  tree = Mutable(tree);
+  if (tree->left) {
+    tree->left = PrependPieces(tree->left, source);
+  } else {
+    assert(tree->count + source->count <= kMaxPiecesPerNode);
+    std::copy_backward(tree->pieces, tree->pieces + tree->count,
+                       tree->pieces + tree->count + source->count);
+    std::copy(source->pieces, source->pieces + source->count, tree->pieces);
+    tree->count += source->count;
+  }
+  Update(tree);
+  return tree;
+}
+
+// Concatenates two trees. The nodes on the seam are combined into one if
+// their pieces fit in a node, so that repeated splits do not leave the tree
+// full of nearly empty nodes.
+Node* Merge(Node* left, Node* right) {
+  if (!left) return right;
+  if (!right) return left;
+  auto [rest, last] = SplitLast(left);
+  if (last->count + FirstNode(right)->count <= kMaxPiecesPerNode) {
+    right = PrependPieces(right, last);
+    Release(last);
+    return Concat(rest, right);
+  }
+  return Join(rest, last, right);
+}
+
+// Splits |tree| into the pieces before |position| and the rest. A piece
+// which straddles |position| is split in two.
+std::pair<Node*, Node*> Split(Node* tree, std::int64_t position) {
+  if (!tree) return {nullptr, nullptr};
+  tree = Mutable(tree);
+  const std::int64_t left_count = SummaryOf(tree->left).char_count;
+  if (position <= left_count) {
+    auto [left, right] = Split(tree->left, position);
+    return {left, Join(right, tree, tree->right)};
+  }
+  position -= left_count;
+  for (int i = 0; i < tree->count; ++i) {
+    const std::int64_t piece_size = tree->pieces[i].GetCharCount();
+    if (position < piece_size) {
+      Node* rest = new Node;
+      if (position == 0) {
+        std::copy(tree->pieces + i, tree->pieces + tree->count, rest->pieces);
+        rest->count = tree->count - i;
+        tree->count = i;
+      } else {
+        rest->pieces[0] = tree->pieces[i].SplitAt(position);
+        std::copy(tree->pieces + i + 1, tree->pieces + tree->count,
+                  rest->pieces + 1);
+        rest->count = tree->count - i;
+        tree->count = i + 1;
+      }
+      Node* left = tree->left;
+      Node* right = tree->right;
+      return {Join(left, tree, nullptr), Join(nullptr, rest, right)};
+    }
+    position -= piece_size;
+  }
+  auto [left, right] = Split(tree->right, position);
+  return {Join(tree->left, tree, left), right};
+}
+
+const Piece& LastPiece(const Node* tree) {
+  while (tree->right) tree = tree->right;
+  return tree->pieces[tree->count - 1];
+}
+
+// Moves the end of the last piece of |tree| to |end|.
+Node* ExtendLast(Node* tree, std::int64_t end) {
+  tree = Mutable(tree);
+  if (tree->right) {
+    tree->right = ExtendLast(tree->right, end);
+  } else {
+    tree->pieces[tree->count - 1].set_end(end);
+  }
+  Update(tree);
+  return tree;
+}
+
+Node* Build(std::vector<Node*>& nodes, int begin, int end) {
+  if (begin == end) return nullptr;
+  const int middle = begin + (end - begin) / 2;
+  Node* node = nodes[middle];
+  node->left = Build(nodes, begin, middle);
+  node->right = Build(nodes, middle + 1, end);
+  Update(node);
+  return node;
+}
+
+// Builds a balanced tree of full nodes holding |count| pieces in O(count).
+Node* BuildFromPieces(const Piece* pieces, std::size_t count) {
+  if (count == 0) return nullptr;
+  if (count <= kMaxPiecesPerNode) {
+    return NewNode(pieces, static_cast<int>(count));
+  }
+  std::vector<Node*> nodes;
+  nodes.reserve((count + kMaxPiecesPerNode - 1) / kMaxPiecesPerNode);
+  for (std::size_t i = 0; i < count; i += kMaxPiecesPerNode) {
+    const int node_count =
+        static_cast<int>(std::min<std::size_t>(kMaxPiecesPerNode, count - i));
+    nodes.push_back(NewNode(pieces + i, node_count));
+  }
+  return Build(nodes, 0, static_cast<int>(nodes.size()));
+}
+
+// Appends |pieces| to |tree|, elongating the last piece of |tree| instead of
+// adding the first one if possible.
+Node* AppendPieces(Node* tree, const std::vector<Piece>& pieces) {
+  const Piece* first = pieces.data();
+  std::size_t count = pieces.size();
+  if (tree && count > 0 && LastPiece(tree).IsFollowedBy(first[0])) {
+    tree = ExtendLast(tree, first[0].end());
+    ++first;
+    --count;
+  }
+  return Merge(tree, BuildFromPieces(first, count));
+}
+
+// Applies the replacements in [first, last) to |tree|, whose first character
+// is at |offset| in the coordinates of the replacements. The middle
+// replacement is applied by splitting the tree around it, and the ones on
+// either side recursively to the parts, so every split walks down a subtree
+// only as tall as the part it splits. Applying k replacements to a tree of n
+// pieces this way is O(k log(n / k)) rather than O(k log n), and every node
+// on the way is copied at most once.
+Node* ReplaceRanges(Node* tree, std::int64_t offset,
+                    const PieceTree::Replacement* first,
+                    const PieceTree::Replacement* last) {
+  if (first == last) return tree;
+  const PieceTree::Replacement* middle = first + (last - first) / 2;
+  assert(offset <= middle->start && middle->start <= middle->end);
+  auto [left, after] = Split(tree, middle->start - offset);
+  auto [removed, right] = Split(after, middle->end - middle->start);
+  Release(removed);
+  left = ReplaceRanges(left, offset, first, middle);
+  right = ReplaceRanges(right, middle->end, middle + 1, last);
+  return Merge(AppendPieces(left, middle->pieces), right);
+}
+
+// Appends |count| characters to |pieces| as plain pieces whose starts do not
+// matter, elongating the last piece if it is plain.
+void AppendGap(std::int64_t count, std::vector<Piece>& pieces) {
+  if (count == 0) return;
+  if (!pieces.empty() && pieces.back().IsPlain()) {
+    Piece& last = pieces.back();
+    const std::int64_t added =
+        std::min(count, Piece::kMaxLength - last.GetCharCount());
+    last.set_end(last.end() + added);
+    count -= added;
+    if (count == 0) return;
+  }
+  Piece::AppendPlain(0, count, pieces);
+}
+
+void VisitDistinctNodes(const Node* node,
+                        std::unordered_set<const Node*>& visited,
+                        const std::function<void(const Piece&)>& visit) {
+  if (!node || !visited.insert(node).second) return;
+  VisitDistinctNodes(node->left, visited, visit);
+  std::for_each(node->pieces, node->pieces + node->count, visit);
+  VisitDistinctNodes(node->right, visited, visit);
+}
+
+// Returns a new reference to |node| with its pieces rewritten. |rewritten|
+// maps the nodes rewritten so far to their results.
+Node* RewriteNode(Node* node,
+                  const std::function<int(Piece* pieces, int count)>& rewrite,
+                  std::unordered_map<const Node*, Node*>& rewritten) {
+  if (!node) return nullptr;
+  if (auto it = rewritten.find(node); it != rewritten.end()) {
+    return Retain(it->second);
+  }
+  Node* left = RewriteNode(node->left, rewrite, rewritten);
+  Node* right = RewriteNode(node->right, rewrite, rewritten);
+  Node* result = new Node;
+  std::copy(node->pieces, node->pieces + node->count, result->pieces);
+  result->count = rewrite(result->pieces, node->count);
+  assert(0 < result->count && result->count <= node->count);
+  if (left == node->left && right == node->right &&
+      std::equal(result->pieces, result->pieces + result->count, node->pieces,
+                 node->pieces + node->count)) {
+    delete result;
+    Release(left);
+    Release(right);
+    result = Retain(node);
+  } else {
+    result->left = left;
+    result->right = right;
+    Update(result);
+    assert(result->summary.char_count == node->summary.char_count);
+  }
+  rewritten.emplace(node, result);
+  return result;
+}
+
+}  // namespace
+
+PieceTree::PieceTree(const std::vector<Piece>& pieces)
+    : root_(BuildFromPieces(pieces.data(), pieces.size())) {}
+
+PieceTree::PieceTree(const PieceTree& other) : root_(Retain(other.root_)) {}
+
+PieceTree& PieceTree::operator=(const PieceTree& other) {
+  Node* old_root = root_;
+  root_ = Retain(other.root_);
+  Release(old_root);
+  return *this;
+}
+
+PieceTree& PieceTree::operator=(PieceTree&& other) noexcept {
+  if (this != &other) {
+    Release(root_);
+    root_ = other.root_;
+    other.root_ = nullptr;
+  }
+  return *this;
+}
+
+PieceTree::~PieceTree() { Release(root_); }
+
+std::int64_t PieceTree::GetCharCount() const {
+  return SummaryOf(root_).char_count;
+}
+
+std::int64_t PieceTree::GetLineBreakCount() const {
+  return SummaryOf(root_).line_break_count;
+}
+
+PieceTree::const_iterator PieceTree::begin() const {
+  const_iterator it(root_);
+  for (const Node* node = root_; node; node = node->left) {
+    it.path_.push_back(node);
+  }
+  return it;
+}
+
+PieceTree::const_iterator PieceTree::end() const {
+  const_iterator it(root_);
+  it.offset_ = GetCharCount();
+  return it;
+}
+
+PieceTree::const_iterator PieceTree::FindPosition(
+    std::int64_t position) const {
+  assert(0 <= position && position <= GetCharCount());
+  const_iterator it(root_);
+  std::int64_t offset = 0;
+  const Node* node = root_;
+  while (node) {
+    it.path_.push_back(node);
+    const std::int64_t left_count = SummaryOf(node->left).char_count;
+    if (position < offset + left_count) {
+      node = node->left;
+      continue;
+    }
+    offset += left_count;
+    for (int i = 0; i < node->count; ++i) {
+      const std::int64_t piece_size = node->pieces[i].GetCharCount();
+      if (position < offset + piece_size) {
+        it.index_ = i;
+        it.offset_ = offset;
+        return it;
+      }
+      offset += piece_size;
+    }
+    node = node->right;
+  }
+  return end();
+}
+
+PieceTree::const_iterator PieceTree::FindLine(std::int64_t line) const {
+  assert(0 <= line);
+  if (line == 0) return begin();
+  if (line > GetLineBreakCount()) return end();
+  const_iterator it(root_);
+  std::int64_t offset = 0;
+  const Node* node = root_;
+  while (node) {
+    it.path_.push_back(node);
+    const Summary left = SummaryOf(node->left);
+    if (line <= left.line_break_count) {
+      node = node->left;
+      continue;
+    }
+    line -= left.line_break_count;
+    offset += left.char_count;
+    for (int i = 0; i < node->count; ++i) {
+      const Piece& piece = node->pieces[i];
+      if (piece.IsLineBreak() && --line == 0) {
+        it.index_ = i;
+        it.offset_ = offset;
+        return ++it;
+      }
+      offset += piece.GetCharCount();
+    }
+    node = node->right;
+  }
+  assert(false);
+  return end();
+}
+
+std::int64_t PieceTree::CountLineBreaksBefore(std::int64_t position) const {
+  assert(0 <= position && position <= GetCharCount());
+  std::int64_t count = 0;
+  const Node* node = root_;
+  while (node) {
+    const Summary left = SummaryOf(node->left);
+    if (position <= left.char_count) {
+      node = node->left;
+      continue;
+    }
+    count += left.line_break_count;
+    position -= left.char_count;
+    for (int i = 0; i < node->count; ++i) {
+      const Piece& piece = node->pieces[i];
+      if (position < piece.GetCharCount()) return count;
+      if (piece.IsLineBreak()) ++count;
+      position -= piece.GetCharCount();
+    }
+    node = node->right;
+  }
+  return count;
+}
+
+std::int64_t PieceTree::FindWeightedOffset(std::int64_t offset,
+                                           int line_break_weight) const {
+  assert(0 <= line_break_weight);
+  const auto weight_of = [line_break_weight](const Summary& summary) {
+    return summary.char_count +
+           (line_break_weight - 1) * summary.line_break_count;
+  };
+  std::int64_t position = 0;
+  const Node* node = root_;
+  while (node) {
+    const Summary left = SummaryOf(node->left);
+    if (offset <= weight_of(left)) {
+      node = node->left;
+      continue;
+    }
+    // |offset| stays positive from here, so it never ends in front of a
+    // piece which weighs nothing.
+    offset -= weight_of(left);
+    position += left.char_count;
+    for (int i = 0; i < node->count; ++i) {
+      const Piece& piece = node->pieces[i];
+      const std::int64_t weight = piece.IsLineBreak() ? line_break_weight
+                                                      : piece.GetCharCount();
+      if (offset <= weight) {
+        return position + (piece.IsLineBreak() ? 1 : offset);
+      }
+      offset -= weight;
+      position += piece.GetCharCount();
+    }
+    node = node->right;
+  }
+  return position;
+}
+
+void PieceTree::Insert(std::int64_t position, const Piece& piece) {
+  assert(0 <= position && position <= GetCharCount());
+  auto [left, right] = Split(root_, position);
+  if (left && LastPiece(left).IsFollowedBy(piece)) {
+    root_ = Merge(ExtendLast(left, piece.end()), right);
+    return;
+  }
+  root_ = Merge(Merge(left, NewNode(&piece, 1)), right);
+}
+
+void PieceTree::Insert(std::int64_t position,
+                       const std::vector<Piece>& pieces) {
+  assert(0 <= position && position <= GetCharCount());
+  if (pieces.empty()) return;
+  auto [left, right] = Split(root_, position);
+  root_ =
+      Merge(Merge(left, BuildFromPieces(pieces.data(), pieces.size())), right);
+}
+
+void PieceTree::Erase(std::int64_t start, std::int64_t end) {
+  assert(0 <= start && start <= end && end <= GetCharCount());
+  auto [left, rest] = Split(root_, start);
+  auto [middle, right] = Split(rest, end - start);
+  Release(middle);
+  root_ = Merge(left, right);
+}
+
+void PieceTree::Replace(const std::vector<Replacement>& replacements) {
+  root_ = ReplaceRanges(root_, 0, replacements.data(),
+                        replacements.data() + replacements.size());
+}
+
+void PieceTree::ReplaceGaps(const std::vector<Replacement>& replacements) {
+  std::vector<Replacement> widened;
+  // The characters between the end of the last replacement and the end of
+  // the plain piece it ends in, to be added once it is known whether the
+  // next replacement starts in the same piece.
+  std::int64_t trail = 0;
+  std::int64_t last_end = 0;
+  for (const Replacement& replacement : replacements) {
+    std::int64_t start = replacement.start;
+    if (start > 0) {
+      const const_iterator before = FindPosition(start - 1);
+      if (before->IsPlain()) start = before.offset();
+    }
+    if (!widened.empty() && start < widened.back().end) {
+      // Both ranges are next to the same plain piece.
+      AppendGap(replacement.start - last_end, widened.back().pieces);
+    } else {
+      if (!widened.empty()) AppendGap(trail, widened.back().pieces);
+      widened.push_back({start, start, {}});
+      AppendGap(replacement.start - start, widened.back().pieces);
+    }
+    Replacement& current = widened.back();
+    for (const Piece& piece : replacement.pieces) {
+      if (piece.IsPlain()) {
+        AppendGap(piece.GetCharCount(), current.pieces);
+      } else {
+        current.pieces.push_back(piece);
+      }
+    }
+    current.end = replacement.end;
+    trail = 0;
+    const const_iterator after = FindPosition(replacement.end);
+    if (after != end() && after->IsPlain()) {
+      current.end = after.offset() + after->GetCharCount();
+      trail = current.end - replacement.end;
+    }
+    last_end = replacement.end;
+  }
+  if (!widened.empty()) AppendGap(trail, widened.back().pieces);
+  Replace(widened);
+}
+
+void PieceTree::MergeGaps(const std::vector<PieceTree*>& trees) {
+  RewritePieces(trees, [](Piece* pieces, int count) {
+    int merged = 0;
+    for (int i = 0; i < count; ++i) {
+      if (merged > 0 && pieces[merged - 1].IsPlain() && pieces[i].IsPlain() &&
+          pieces[merged - 1].GetCharCount() + pieces[i].GetCharCount() <=
+              Piece::kMaxLength) {
+        Piece& last = pieces[merged - 1];
+        last.set_end(last.end() + pieces[i].GetCharCount());
+      } else {
+        pieces[merged++] = pieces[i];
+      }
+    }
+    return merged;
+  });
+}
+
+std::int64_t PieceTree::GetPieceCount() const {
+  return std::distance(begin(), end());
+}
+
+void PieceTree::VisitDistinctPieces(
+    const std::vector<const PieceTree*>& trees,
+    const std::function<void(const Piece&)>& visit) {
+  std::unordered_set<const Node*> visited;
+  for (const PieceTree* tree : trees) {
+    VisitDistinctNodes(tree->root_, visited, visit);
+  }
+}
+
+void PieceTree::RewritePieces(
+    const std::vector<PieceTree*>& trees,
+    const std::function<int(Piece* pieces, int count)>& rewrite) {
+  // The results are kept alive by |roots| until all the trees are done, so
+  // the nodes in |rewritten| stay valid.
+  std::unordered_map<const Node*, Node*> rewritten;
+  std::vector<Node*> roots;
+  roots.reserve(trees.size());
+  for (PieceTree* tree : trees) {
+    roots.push_back(RewriteNode(tree->root_, rewrite, rewritten));
+  }
+  for (std::size_t i = 0; i < trees.size(); ++i) {
+    Release(trees[i]->root_);
+    trees[i]->root_ = roots[i];
+  }
+}
+
+const Piece& PieceTree::const_iterator::operator*() const {
+  assert(!path_.empty());
+  return path_.back()->pieces[index_];
+}
+
+PieceTree::const_iterator& PieceTree::const_iterator::operator++() {
+  assert(!path_.empty());
+  offset_ += (**this).GetCharCount();
+  const Node* node = path_.back();
+  if (++index_ < node->count) return *this;
+  index_ = 0;
+  if (node->right) {
+    for (node = node->right; node; node = node->left) path_.push_back(node);
+    return *this;
+  }
+  // Climb up until we leave a left subtree. The path becomes empty, which
+  // means the end iterator, if there is no such node.
+  while (true) {
+    const Node* child = path_.back();
+    path_.pop_back();
+    if (path_.empty() || path_.back()->left == child) return *this;
+  }
+}
+
+PieceTree::const_iterator& PieceTree::const_iterator::operator--() {
+  if (path_.empty()) {
+    assert(root_);
+    for (const Node* node = root_; node; node = node->right) {
+      path_.push_back(node);
+    }
+    index_ = path_.back()->count - 1;
+  } else if (index_ > 0) {
+    --index_;
+  } else if (const Node* node = path_.back(); node->left) {
+    for (node = node->left; node; node = node->right) path_.push_back(node);
+    index_ = path_.back()->count - 1;
+  } else {
+    while (true) {
+      const Node* child = path_.back();
+      path_.pop_back();
+      assert(!path_.empty());
+      if (path_.back()->right == child) break;
+    }
+    index_ = path_.back()->count - 1;
+  }
+  offset_ -= (**this).GetCharCount();
+  return *this;
+}
+
+bool PieceTree::const_iterator::operator==(const const_iterator& rhs) const {
+  if (path_.empty() || rhs.path_.empty()) {
+    return path_.empty() && rhs.path_.empty();
+  }
+  return path_.back() == rhs.path_.back() && index_ == rhs.index_;
+}
+
+}  // namespace wiese
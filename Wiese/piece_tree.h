@@ -0,0 +1,316 @@
+#ifndef WIESE_PIECE_TREE_H_
+#define WIESE_PIECE_TREE_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <string_view>
+#include <vector>
+
+namespace wiese {
+
+// The characters a line break stands for in a file. Every line break is
+// L'\n' in the text of a document, but line break pieces keep their ending,
+// so that files with CRLF or mixed line endings are saved as they were read.
+enum class LineEnding : std::uint8_t { kLf, kCrLf, kCr };
+
+inline std::wstring_view GetLineEndingChars(LineEnding ending) {
+  switch (ending) {
+    case LineEnding::kLf:
+      return L"\n";
+    case LineEnding::kCrLf:
+      return L"\r\n";
+    case LineEnding::kCr:
+      return L"\r";
+  }
+  assert(false);
+  return {};
+}
+
+// A run of characters in one of the buffers of a document, or a line break.
+// Positions are 64-bit, but a piece keeps its start in 48 bits and its
+// length in 32 bits, so that it is still 12 bytes. A run longer than
+// kMaxLength takes more than one piece (see AppendOriginal and AppendPlain).
+class Piece {
+ private:
+  enum class Kind : std::uint8_t { kOriginal, kPlain, kLineBreak };
+
+ public:
+  static constexpr std::int64_t kMaxOffset = (std::int64_t{1} << 48) - 1;
+  static constexpr std::int64_t kMaxLength = 0xffffffff;
+
+  static Piece MakeOriginal(std::int64_t start, std::int64_t end);
+  static Piece MakePlain(std::int64_t start, std::int64_t end);
+  static Piece MakeLineBreak(LineEnding ending = LineEnding::kLf);
+  // Appends to |pieces| the pieces for [start, end): one, which may be
+  // empty, unless the run is longer than kMaxLength.
+  static void AppendOriginal(std::int64_t start, std::int64_t end,
+                             std::vector<Piece>& pieces);
+  static void AppendPlain(std::int64_t start, std::int64_t end,
+                          std::vector<Piece>& pieces);
+  bool IsOriginal() const { return kind_ == Kind::kOriginal; }
+  bool IsPlain() const { return kind_ == Kind::kPlain; }
+  bool IsLineBreak() const { return kind_ == Kind::kLineBreak; }
+  LineEnding line_ending() const {
+    assert(IsLineBreak());
+    return line_ending_;
+  }
+  std::int64_t GetCharCount() const {
+    switch (kind_) {
+      case Kind::kOriginal:
+      case Kind::kPlain:
+        return length_;
+      case Kind::kLineBreak:
+        return 1;
+    }
+    assert(false);
+    return 0;
+  }
+  Piece SplitAt(std::int64_t index) {
+    assert(0 <= index && index <= length_);
+    Piece rest(*this);
+    rest.SetStart(GetStart() + index);
+    rest.length_ = static_cast<std::uint32_t>(length_ - index);
+    length_ = static_cast<std::uint32_t>(index);
+    return rest;
+  }
+  Piece Slice(std::int64_t start, std::int64_t end) const {
+    assert(0 <= start && start <= end && end <= length_);
+    Piece sub_piece(*this);
+    sub_piece.SetStart(GetStart() + start);
+    sub_piece.length_ = static_cast<std::uint32_t>(end - start);
+    return sub_piece;
+  }
+  // Returns true if |next| refers to the characters right after this piece in
+  // the same buffer, so that the two can be represented by one piece.
+  bool IsFollowedBy(const Piece& next) const {
+    return kind_ == next.kind_ && !IsLineBreak() && end() == next.start() &&
+           std::int64_t{length_} + next.length_ <= kMaxLength;
+  }
+  std::int64_t start() const {
+    assert(IsOriginal() || IsPlain());
+    return GetStart();
+  }
+  void set_start(std::int64_t value) {
+    assert(IsOriginal() || IsPlain());
+    assert(value <= end() && end() - value <= kMaxLength);
+    const std::int64_t end = this->end();
+    SetStart(value);
+    length_ = static_cast<std::uint32_t>(end - value);
+  }
+  std::int64_t end() const {
+    assert(IsOriginal() || IsPlain());
+    return GetStart() + length_;
+  }
+  void set_end(std::int64_t value) {
+    assert(IsOriginal() || IsPlain());
+    assert(GetStart() <= value && value - GetStart() <= kMaxLength);
+    length_ = static_cast<std::uint32_t>(value - GetStart());
+  }
+  bool operator==(const Piece& rhs) const {
+    return kind_ == rhs.kind_ && line_ending_ == rhs.line_ending_ &&
+           start_low_ == rhs.start_low_ && start_high_ == rhs.start_high_ &&
+           length_ == rhs.length_;
+  }
+
+ private:
+  friend class PieceTree;
+  Piece() : Piece(Kind::kLineBreak) {}
+  Piece(Kind kind)
+      : start_low_(0),
+        start_high_(0),
+        kind_(kind),
+        line_ending_(LineEnding::kLf),
+        length_(0) {}
+  static Piece Make(Kind kind, std::int64_t start, std::int64_t end);
+  std::int64_t GetStart() const {
+    return static_cast<std::int64_t>(start_high_) << 32 | start_low_;
+  }
+  void SetStart(std::int64_t value) {
+    assert(0 <= value && value <= kMaxOffset);
+    start_low_ = static_cast<std::uint32_t>(value);
+    start_high_ = static_cast<std::uint16_t>(value >> 32);
+  }
+  // The start is split in two, so that the fields need no padding.
+  std::uint32_t start_low_;
+  std::uint16_t start_high_;
+  Kind kind_;
+  // Only used by line breaks.
+  LineEnding line_ending_;
+  std::uint32_t length_;
+};
+
+static_assert(sizeof(Piece) == 12, "pieces should stay small");
+
+// Sequence of pieces stored in a height balanced (AVL) tree. Every node holds
+// a short run of pieces and caches the number of characters and line breaks
+// in its subtree, so that finding a position or a line, inserting and erasing
+// are O(log n), and the totals are O(1).
+//
+// The tree is persistent: copying it is O(1) and the copies share all their
+// nodes. An edit copies only the O(log n) nodes it modifies that are still
+// shared, so keeping old copies around (e.g. for undo) costs memory in
+// proportion to the edits made since, not to the size of the text. Iterators
+// stay valid as long as the tree they come from is not modified. Different
+// copies may be read, modified and destroyed on different threads.
+class PieceTree {
+ public:
+  // Defined in piece_tree.cc.
+  struct Node;
+
+  static constexpr int kMaxPiecesPerNode = 16;
+
+  struct Summary {
+    std::int64_t char_count;
+    std::int64_t line_break_count;
+
+    Summary() : char_count(0), line_break_count(0) {}
+    Summary& operator+=(const Summary& rhs) {
+      char_count += rhs.char_count;
+      line_break_count += rhs.line_break_count;
+      return *this;
+    }
+    Summary& operator-=(const Summary& rhs) {
+      char_count -= rhs.char_count;
+      line_break_count -= rhs.line_break_count;
+      return *this;
+    }
+  };
+
+  class const_iterator {
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Piece;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Piece*;
+    using reference = const Piece&;
+
+    const_iterator() : root_(nullptr), index_(0), offset_(0) {}
+    reference operator*() const;
+    pointer operator->() const { return &**this; }
+    const_iterator& operator++();
+    const_iterator& operator--();
+    const_iterator operator++(int) {
+      const_iterator old(*this);
+      ++*this;
+      return old;
+    }
+    const_iterator operator--(int) {
+      const_iterator old(*this);
+      --*this;
+      return old;
+    }
+    bool operator==(const const_iterator& rhs) const;
+    bool operator!=(const const_iterator& rhs) const {
+      return !operator==(rhs);
+    }
+    // Position of the first character of the current piece. For the end
+    // iterator this is the number of characters in the tree.
+    std::int64_t offset() const { return offset_; }
+
+   private:
+    friend class PieceTree;
+    explicit const_iterator(const Node* root)
+        : root_(root), index_(0), offset_(0) {}
+
+    const Node* root_;
+    // Nodes from the root down to the node holding the current piece. Empty
+    // for the end iterator.
+    std::vector<const Node*> path_;
+    int index_;
+    std::int64_t offset_;
+  };
+
+  PieceTree() : root_(nullptr) {}
+  explicit PieceTree(const std::vector<Piece>& pieces);
+  PieceTree(PieceTree&& other) noexcept : root_(other.root_) {
+    other.root_ = nullptr;
+  }
+  PieceTree& operator=(PieceTree&& other) noexcept;
+  PieceTree(const PieceTree& other);
+  PieceTree& operator=(const PieceTree& other);
+  ~PieceTree();
+
+  bool IsEmpty() const { return root_ == nullptr; }
+  std::int64_t GetCharCount() const;
+  std::int64_t GetLineBreakCount() const;
+
+  const_iterator begin() const;
+  const_iterator end() const;
+  // Returns the piece that contains the character at |position|, or end() if
+  // |position| is the end of the text.
+  const_iterator FindPosition(std::int64_t position) const;
+  // Returns the first piece after the |line|-th line break, or end() if the
+  // tree does not have as many line breaks.
+  const_iterator FindLine(std::int64_t line) const;
+  // Returns the number of line breaks in front of |position|.
+  std::int64_t CountLineBreaksBefore(std::int64_t position) const;
+  // Returns the first position whose offset is at least |offset| if every
+  // line break counted |line_break_weight| characters instead of one, or the
+  // end of the text if there is none. O(log n).
+  std::int64_t FindWeightedOffset(std::int64_t offset,
+                                  int line_break_weight) const;
+
+  // Inserts |piece| in front of the character at |position|. If the piece
+  // before |position| is followed by |piece| in the buffer, that piece is
+  // elongated instead of adding a new one.
+  void Insert(std::int64_t position, const Piece& piece);
+  // Inserts |pieces| in front of the character at |position|. The pieces are
+  // built into a subtree first and spliced in with one split and two joins,
+  // so this is O(k + log n) for k pieces.
+  void Insert(std::int64_t position, const std::vector<Piece>& pieces);
+  // Erases characters in [start, end), splitting the pieces on the boundaries.
+  // Runs in O(log n) plus the number of pieces removed.
+  void Erase(std::int64_t start, std::int64_t end);
+
+  struct Replacement {
+    std::int64_t start;
+    std::int64_t end;
+    std::vector<Piece> pieces;
+  };
+  // Replaces every range [start, end) with its pieces. The ranges must be
+  // sorted and must not overlap, and their positions refer to the tree before
+  // any of them is replaced. O(k log(n / k)) for k replacements, plus the
+  // number of pieces added and removed.
+  void Replace(const std::vector<Replacement>& replacements);
+  // Like Replace, for a tree whose plain pieces only count characters, like
+  // those of UnitIndex and MatchIndex: their starts do not matter. The plain
+  // pieces next to every range are replaced too, and merged with the plain
+  // pieces at the ends of its own, so that no two plain pieces follow each
+  // other however many edits there are (unless the run is longer than
+  // kMaxLength).
+  void ReplaceGaps(const std::vector<Replacement>& replacements);
+  // Merges the plain pieces next to each other within every node of |trees|,
+  // whose plain pieces only count characters as for ReplaceGaps. Nodes are
+  // rewritten as by RewritePieces.
+  static void MergeGaps(const std::vector<PieceTree*>& trees);
+
+  // Number of pieces in the tree. O(n).
+  std::int64_t GetPieceCount() const;
+
+  // Calls |visit| for the pieces of |trees|, once for every node: the pieces
+  // of a node shared by several trees (or by a tree and its copies) are
+  // visited only once.
+  static void VisitDistinctPieces(
+      const std::vector<const PieceTree*>& trees,
+      const std::function<void(const Piece&)>& visit);
+  // Gets the pieces of every node of |trees| rewritten by |rewrite|, which is
+  // given the pieces of a node and returns how many of them are left. It may
+  // merge pieces and change the buffer ranges they refer to, but not the
+  // characters they stand for. A node shared by several trees is rewritten
+  // once and the result is shared in turn, so the trees take no more memory
+  // than before. Nodes are never modified: other copies of the trees, like
+  // those of snapshots, keep their pieces.
+  static void RewritePieces(
+      const std::vector<PieceTree*>& trees,
+      const std::function<int(Piece* pieces, int count)>& rewrite);
+
+ private:
+  Node* root_;
+};
+
+}  // namespace wiese
+
+#endif
@@ -0,0 +1,346 @@
+#include "piece_tree.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace {
+
+std::vector<wiese::Piece> MakeLines(int line_count, int line_length) {
+  std::vector<wiese::Piece> pieces;
+  for (int i = 0; i < line_count; ++i) {
+    const int start = i * (line_length + 1);
+    pieces.push_back(wiese::Piece::MakeOriginal(start, start + line_length));
+    pieces.push_back(wiese::Piece::MakeLineBreak());
+  }
+  return pieces;
+}
+
+}  // namespace
+
+TEST(PieceTree, Constructor_Empty) {
+  wiese::PieceTree tree;
+  EXPECT_TRUE(tree.IsEmpty());
+  EXPECT_EQ(0, tree.GetCharCount());
+  EXPECT_EQ(0, tree.GetLineBreakCount());
+  EXPECT_EQ(tree.begin(), tree.end());
+}
+
+TEST(PieceTree, Constructor_KeepsOrderOfPieces) {
+  auto pieces = MakeLines(100, 3);
+  wiese::PieceTree tree(pieces);
+  EXPECT_EQ(400, tree.GetCharCount());
+  EXPECT_EQ(100, tree.GetLineBreakCount());
+  EXPECT_TRUE(std::equal(pieces.begin(), pieces.end(), tree.begin(),
+                         tree.end()));
+}
+
+TEST(PieceTree, Iterator_Decrement) {
+  auto pieces = MakeLines(100, 3);
+  wiese::PieceTree tree(pieces);
+  auto it = tree.end();
+  for (auto expected = pieces.rbegin(); expected != pieces.rend();
+       ++expected) {
+    --it;
+    EXPECT_EQ(*expected, *it);
+  }
+  EXPECT_EQ(tree.begin(), it);
+}
+
+TEST(PieceTree, Iterator_offset) {
+  wiese::PieceTree tree(MakeLines(100, 3));
+  std::int64_t offset = 0;
+  for (auto it = tree.begin(); it != tree.end(); ++it) {
+    EXPECT_EQ(offset, it.offset());
+    offset += it->GetCharCount();
+  }
+  EXPECT_EQ(offset, tree.end().offset());
+}
+
+TEST(PieceTree, FindPosition) {
+  wiese::PieceTree tree(MakeLines(100, 3));
+  auto it = tree.FindPosition(42);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(40, 43), *it);
+  EXPECT_EQ(40, it.offset());
+  EXPECT_TRUE(tree.FindPosition(43)->IsLineBreak());
+  EXPECT_EQ(tree.end(), tree.FindPosition(400));
+}
+
+TEST(PieceTree, FindLine) {
+  wiese::PieceTree tree(MakeLines(100, 3));
+  EXPECT_EQ(tree.begin(), tree.FindLine(0));
+  auto it = tree.FindLine(10);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(40, 43), *it);
+  EXPECT_EQ(40, it.offset());
+  EXPECT_EQ(tree.end(), tree.FindLine(100));
+  EXPECT_EQ(tree.end(), tree.FindLine(101));
+}
+
+TEST(PieceTree, FindWeightedOffset) {
+  wiese::PieceTree tree(MakeLines(100, 3));
+  EXPECT_EQ(0, tree.FindWeightedOffset(0, 0));
+  // Line breaks weighing nothing: every line is 3 characters.
+  EXPECT_EQ(39, tree.FindWeightedOffset(30, 0));
+  EXPECT_EQ(41, tree.FindWeightedOffset(31, 0));
+  // Line breaks weighing two: every line is 5 characters, and an offset
+  // in the middle of a line break ends after it.
+  EXPECT_EQ(39, tree.FindWeightedOffset(48, 2));
+  EXPECT_EQ(40, tree.FindWeightedOffset(49, 2));
+  EXPECT_EQ(40, tree.FindWeightedOffset(50, 2));
+  EXPECT_EQ(400, tree.FindWeightedOffset(1000, 2));
+  for (int weight : {0, 1, 2, 3}) {
+    // The first position whose weighted offset is at least |offset|.
+    int position = 0;
+    int weighted = 0;
+    for (int offset = 0; offset <= 100 * (3 + weight); ++offset) {
+      while (weighted < offset) {
+        weighted += tree.FindPosition(position)->IsLineBreak() ? weight : 1;
+        ++position;
+      }
+      ASSERT_EQ(position, tree.FindWeightedOffset(offset, weight))
+          << offset << " " << weight;
+    }
+  }
+}
+
+TEST(PieceTree, Insert_SplitsPiece) {
+  wiese::PieceTree tree(MakeLines(1, 10));
+  tree.Insert(4, wiese::Piece::MakePlain(0, 2));
+  auto it = tree.begin();
+  EXPECT_EQ(wiese::Piece::MakeOriginal(0, 4), *it);
+  EXPECT_EQ(wiese::Piece::MakePlain(0, 2), *++it);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(4, 10), *++it);
+  EXPECT_TRUE((++it)->IsLineBreak());
+  EXPECT_EQ(13, tree.GetCharCount());
+}
+
+TEST(PieceTree, Insert_ElongatesPreviousPiece) {
+  wiese::PieceTree tree;
+  tree.Insert(0, wiese::Piece::MakePlain(0, 1));
+  tree.Insert(1, wiese::Piece::MakePlain(1, 2));
+  ASSERT_EQ(1, std::distance(tree.begin(), tree.end()));
+  EXPECT_EQ(wiese::Piece::MakePlain(0, 2), *tree.begin());
+}
+
+TEST(PieceTree, Insert_ManyPieces) {
+  wiese::PieceTree tree;
+  for (int i = 0; i < 1000; ++i) {
+    tree.Insert(0, wiese::Piece::MakeLineBreak());
+    tree.Insert(tree.GetCharCount() / 2,
+                wiese::Piece::MakePlain(i * 2, i * 2 + 1));
+  }
+  EXPECT_EQ(2000, tree.GetCharCount());
+  EXPECT_EQ(1000, tree.GetLineBreakCount());
+  EXPECT_EQ(2000, std::distance(tree.begin(), tree.end()));
+}
+
+TEST(PieceTree, Insert_Pieces) {
+  wiese::PieceTree tree(MakeLines(100, 3));
+  const auto pieces = MakeLines(1000, 1);
+  tree.Insert(42, pieces);
+  EXPECT_EQ(2400, tree.GetCharCount());
+  EXPECT_EQ(1100, tree.GetLineBreakCount());
+  auto it = tree.FindPosition(40);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(40, 42), *it);
+  for (const auto& piece : pieces) EXPECT_EQ(piece, *++it);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(42, 43), *++it);
+}
+
+TEST(PieceTree, Replace) {
+  wiese::PieceTree tree(MakeLines(100, 3));
+  tree.Replace({{1, 2, {wiese::Piece::MakePlain(0, 2)}},
+                {4, 4, {wiese::Piece::MakeLineBreak()}},
+                {8, 396, {}}});
+  auto it = tree.begin();
+  EXPECT_EQ(wiese::Piece::MakeOriginal(0, 1), *it);
+  EXPECT_EQ(wiese::Piece::MakePlain(0, 2), *++it);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(2, 3), *++it);
+  EXPECT_TRUE((++it)->IsLineBreak());
+  EXPECT_TRUE((++it)->IsLineBreak());
+  EXPECT_EQ(wiese::Piece::MakeOriginal(4, 7), *++it);
+  EXPECT_TRUE((++it)->IsLineBreak());
+  EXPECT_EQ(wiese::Piece::MakeOriginal(396, 399), *++it);
+  EXPECT_TRUE((++it)->IsLineBreak());
+  EXPECT_EQ(tree.end(), ++it);
+  EXPECT_EQ(14, tree.GetCharCount());
+  EXPECT_EQ(4, tree.GetLineBreakCount());
+}
+
+TEST(PieceTree, ReplaceGaps_MergesGaps) {
+  // Gaps of 3, 5 and 2 characters between two line breaks.
+  wiese::PieceTree tree({wiese::Piece::MakePlain(0, 3),
+                         wiese::Piece::MakeLineBreak(),
+                         wiese::Piece::MakePlain(0, 5),
+                         wiese::Piece::MakeLineBreak(),
+                         wiese::Piece::MakePlain(0, 2)});
+  tree.ReplaceGaps({{1, 2, {wiese::Piece::MakePlain(0, 4)}},
+                    {5, 6, {wiese::Piece::MakePlain(0, 1)}},
+                    {7, 7, {wiese::Piece::MakeLineBreak()}},
+                    {9, 10, {}}});
+  auto it = tree.begin();
+  EXPECT_EQ(wiese::Piece::MakePlain(0, 6), *it);
+  EXPECT_TRUE((++it)->IsLineBreak());
+  EXPECT_EQ(wiese::Piece::MakePlain(0, 3), *++it);
+  EXPECT_TRUE((++it)->IsLineBreak());
+  EXPECT_EQ(wiese::Piece::MakePlain(0, 4), *++it);
+  EXPECT_EQ(tree.end(), ++it);
+  EXPECT_EQ(15, tree.GetCharCount());
+  EXPECT_EQ(2, tree.GetLineBreakCount());
+}
+
+TEST(PieceTree, ReplaceGaps_DoesNotGrowWithEdits) {
+  wiese::PieceTree tree({wiese::Piece::MakePlain(0, 100),
+                         wiese::Piece::MakeLineBreak(),
+                         wiese::Piece::MakePlain(0, 100)});
+  // Typing a character at a time, each one replacing the range it is typed
+  // at.
+  for (int i = 0; i < 1000; ++i) {
+    const std::int64_t position = i % 2 == 0 ? 50 + i : 150 + i;
+    tree.ReplaceGaps({{position, position, {wiese::Piece::MakePlain(0, 1)}}});
+  }
+  EXPECT_EQ(3, tree.GetPieceCount());
+  EXPECT_EQ(1201, tree.GetCharCount());
+  EXPECT_EQ(1, tree.GetLineBreakCount());
+}
+
+TEST(PieceTree, Erase_WithinPiece) {
+  wiese::PieceTree tree(MakeLines(1, 10));
+  tree.Erase(3, 5);
+  auto it = tree.begin();
+  EXPECT_EQ(wiese::Piece::MakeOriginal(0, 3), *it);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(5, 10), *++it);
+  EXPECT_EQ(9, tree.GetCharCount());
+}
+
+TEST(PieceTree, Erase_AcrossPieces) {
+  wiese::PieceTree tree(MakeLines(100, 3));
+  tree.Erase(2, 398);
+  auto it = tree.begin();
+  EXPECT_EQ(wiese::Piece::MakeOriginal(0, 2), *it);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(398, 399), *++it);
+  EXPECT_TRUE((++it)->IsLineBreak());
+  EXPECT_EQ(tree.end(), ++it);
+  EXPECT_EQ(1, tree.GetLineBreakCount());
+}
+
+TEST(PieceTree, Erase_Everything) {
+  wiese::PieceTree tree(MakeLines(100, 3));
+  tree.Erase(0, 400);
+  EXPECT_TRUE(tree.IsEmpty());
+}
+
+TEST(PieceTree, Copy_IsNotAffectedByEdits) {
+  const auto pieces = MakeLines(1000, 3);
+  wiese::PieceTree tree(pieces);
+  wiese::PieceTree copy(tree);
+  tree.Insert(42, wiese::Piece::MakePlain(0, 2));
+  tree.Erase(100, 3000);
+  EXPECT_EQ(1102, tree.GetCharCount());
+  EXPECT_EQ(4000, copy.GetCharCount());
+  EXPECT_EQ(1000, copy.GetLineBreakCount());
+  EXPECT_TRUE(std::equal(pieces.begin(), pieces.end(), copy.begin(),
+                         copy.end()));
+}
+
+TEST(PieceTree, Copy_KeepsEveryVersion) {
+  wiese::PieceTree tree(MakeLines(1000, 3));
+  std::vector<wiese::PieceTree> versions;
+  for (int i = 0; i < 100; ++i) {
+    versions.push_back(tree);
+    tree.Insert(i * 7, wiese::Piece::MakeLineBreak());
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(4000 + i, versions[i].GetCharCount());
+    EXPECT_EQ(1000 + i, versions[i].GetLineBreakCount());
+  }
+  versions.clear();
+  EXPECT_EQ(4100, tree.GetCharCount());
+}
+
+TEST(Piece, KeepsOffsetsBeyond32Bits) {
+  constexpr std::int64_t kStart = std::int64_t{5} << 32;
+  wiese::Piece piece = wiese::Piece::MakeOriginal(kStart + 1, kStart + 10);
+  EXPECT_EQ(kStart + 1, piece.start());
+  EXPECT_EQ(kStart + 10, piece.end());
+  wiese::Piece rest = piece.SplitAt(4);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(kStart + 1, kStart + 5), piece);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(kStart + 5, kStart + 10), rest);
+  EXPECT_TRUE(piece.IsFollowedBy(rest));
+}
+
+TEST(Piece, AppendOriginal_SplitsLongRuns) {
+  constexpr std::int64_t kMax = wiese::Piece::kMaxLength;
+  std::vector<wiese::Piece> pieces;
+  wiese::Piece::AppendOriginal(1, 2 * kMax + 11, pieces);
+  ASSERT_EQ(3u, pieces.size());
+  EXPECT_EQ(wiese::Piece::MakeOriginal(1, kMax + 1), pieces[0]);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(kMax + 1, 2 * kMax + 1), pieces[1]);
+  EXPECT_EQ(wiese::Piece::MakeOriginal(2 * kMax + 1, 2 * kMax + 11),
+            pieces[2]);
+  // Merging them again would overflow the length.
+  EXPECT_FALSE(pieces[0].IsFollowedBy(pieces[1]));
+  EXPECT_TRUE(pieces[1].Slice(10, 20).IsFollowedBy(pieces[1].Slice(20, 30)));
+}
+
+TEST(PieceTree, PositionsBeyond32Bits) {
+  constexpr std::int64_t kMax = wiese::Piece::kMaxLength;
+  std::vector<wiese::Piece> pieces;
+  wiese::Piece::AppendOriginal(0, 3 * kMax, pieces);
+  pieces.push_back(wiese::Piece::MakeLineBreak());
+  wiese::Piece::AppendOriginal(3 * kMax, 3 * kMax + 5, pieces);
+  wiese::PieceTree tree(pieces);
+  EXPECT_EQ(3 * kMax + 6, tree.GetCharCount());
+  EXPECT_EQ(1, tree.GetLineBreakCount());
+  EXPECT_EQ(2 * kMax, tree.FindPosition(2 * kMax + 7).offset());
+  EXPECT_EQ(3 * kMax + 1, tree.FindLine(1).offset());
+  EXPECT_EQ(1, tree.CountLineBreaksBefore(3 * kMax + 2));
+  tree.Erase(kMax / 2, 3 * kMax);
+  EXPECT_EQ(kMax / 2 + 6, tree.GetCharCount());
+  EXPECT_EQ(kMax / 2 + 1, tree.FindLine(1).offset());
+}
+
+TEST(PieceTree, VisitDistinctPieces_VisitsSharedNodesOnce) {
+  wiese::PieceTree tree(MakeLines(1000, 3));
+  wiese::PieceTree copy(tree);
+  copy.Insert(42, wiese::Piece::MakePlain(0, 2));
+  int count = 0;
+  wiese::PieceTree::VisitDistinctPieces(
+      {&tree, &copy, &tree}, [&count](const wiese::Piece&) { ++count; });
+  EXPECT_LT(count, 2 * 2000);
+  EXPECT_GE(count, 2001);
+}
+
+TEST(PieceTree, RewritePieces) {
+  wiese::PieceTree tree(MakeLines(1000, 3));
+  tree.Erase(0, 4000);
+  for (int i = 0; i < 100; ++i) {
+    tree.Insert(i * 2, wiese::Piece::MakePlain(i * 10, i * 10 + 2));
+  }
+  wiese::PieceTree copy(tree);
+  const std::vector<wiese::Piece> pieces(copy.begin(), copy.end());
+  // Moves the pieces next to each other and merges them.
+  wiese::PieceTree::RewritePieces({&tree}, [](wiese::Piece* pieces,
+                                              int count) {
+    int merged = 0;
+    for (int i = 0; i < count; ++i) {
+      const std::int64_t start = pieces[i].start() / 10 * 2;
+      const wiese::Piece piece = wiese::Piece::MakePlain(start, start + 2);
+      if (merged > 0 && pieces[merged - 1].IsFollowedBy(piece)) {
+        pieces[merged - 1].set_end(piece.end());
+      } else {
+        pieces[merged++] = piece;
+      }
+    }
+    return merged;
+  });
+  EXPECT_EQ(200, tree.GetCharCount());
+  EXPECT_LT(tree.GetPieceCount(), 100);
+  EXPECT_EQ(0, tree.begin()->start());
+  EXPECT_GT(tree.begin()->GetCharCount(), 2);
+  EXPECT_EQ(100, copy.GetPieceCount());
+  EXPECT_TRUE(std::equal(pieces.begin(), pieces.end(), copy.begin(),
+                         copy.end()));
+}
@@ -0,0 +1,195 @@
+#include "regex_search.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "newline_scan.h"
+#include "text_cursor.h"
+
+namespace wiese {
+
+namespace {
+
+std::wregex MakeRegex(const std::wstring& pattern, bool ignore_case) {
+  auto flags = std::regex_constants::ECMAScript;
+  if (ignore_case) flags |= std::regex_constants::icase;
+  return std::wregex(pattern, flags);
+}
+
+// Splits the text into ranges of about |chars_per_range| characters which
+// start at the start of a line, and returns the starts followed by the end
+// of the text.
+std::vector<std::int64_t> SplitIntoRanges(const DocumentSnapshot& snapshot,
+                                          int chars_per_range) {
+  const std::int64_t char_count = snapshot.GetCharCount();
+  std::vector<std::int64_t> starts = {0};
+  for (std::int64_t position = chars_per_range; position < char_count;) {
+    const std::int64_t line = snapshot.LineOfOffset(position);
+    if (line + 1 >= snapshot.GetLineCount()) break;
+    const std::int64_t start = snapshot.OffsetOfLine(line + 1);
+    starts.push_back(start);
+    position = std::max(start, position) + chars_per_range;
+  }
+  starts.push_back(char_count);
+  return starts;
+}
+
+void SearchLine(const std::wregex& regex, std::wstring_view line,
+                std::int64_t offset, std::vector<RegexSearch::Match>& matches) {
+  const wchar_t* const first = line.data();
+  for (std::wcregex_iterator it(first, first + line.size(), regex), end;
+       it != end; ++it) {
+    const std::int64_t start = offset + it->position();
+    matches.push_back({start, start + it->length()});
+  }
+}
+
+}  // namespace
+
+RegexSearch::RegexSearch(std::shared_ptr<const DocumentSnapshot> snapshot,
+                         const std::wstring& pattern, bool ignore_case,
+                         MatchesCallback callback, int thread_count,
+                         int chars_per_range)
+    : snapshot_(std::move(snapshot)),
+      regex_(MakeRegex(pattern, ignore_case)),
+      callback_(std::move(callback)),
+      range_starts_(SplitIntoRanges(*snapshot_, chars_per_range)),
+      next_range_(0),
+      cancelled_(false),
+      finished_(range_starts_.size() - 1),
+      next_to_deliver_(0),
+      delivering_(false) {
+  const int range_count = static_cast<int>(finished_.size());
+  if (thread_count <= 0) {
+    thread_count =
+        std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+  }
+  thread_count = std::min(thread_count, range_count);
+  for (int i = 0; i < thread_count; ++i) {
+    threads_.emplace_back(&RegexSearch::Work, this);
+  }
+}
+
+RegexSearch::~RegexSearch() {
+  Cancel();
+  JoinThreads();
+}
+
+void RegexSearch::Cancel() {
+  // Deliver checks the flag with the lock held right before every call.
+  std::lock_guard<std::mutex> lock(mutex_);
+  cancelled_ = true;
+}
+
+void RegexSearch::Wait() {
+  JoinThreads();
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (error_) std::rethrow_exception(error_);
+}
+
+void RegexSearch::JoinThreads() {
+  for (std::thread& thread : threads_) {
+    if (thread.joinable()) thread.join();
+  }
+}
+
+bool RegexSearch::IsDone() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return next_to_deliver_ == static_cast<int>(finished_.size());
+}
+
+void RegexSearch::Work() {
+  // Every thread makes its own copy, since std::regex does not promise that
+  // matching on several threads with one object is safe.
+  const std::wregex regex = regex_;
+  const int range_count = static_cast<int>(finished_.size());
+  while (!cancelled_) {
+    const int index = next_range_.fetch_add(1);
+    if (index >= range_count) return;
+    try {
+      std::vector<Match> matches =
+          SearchRange(regex, range_starts_[index], range_starts_[index + 1]);
+      Deliver(index, std::move(matches));
+    } catch (...) {
+      // Letting it escape the thread would terminate the program.
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_) error_ = std::current_exception();
+      cancelled_ = true;
+      return;
+    }
+  }
+}
+
+std::vector<RegexSearch::Match> RegexSearch::SearchRange(
+    const std::wregex& regex, std::int64_t start, std::int64_t end) {
+  std::vector<Match> matches;
+  TextCursor cursor(snapshot_, start);
+  // The part of the current line read so far if the line spans runs;
+  // otherwise the line is matched in place.
+  std::wstring line;
+  std::int64_t line_start = start;
+  while (cursor.position() < end && !cancelled_) {
+    const std::int64_t run_start = cursor.position();
+    std::wstring_view run = cursor.NextRun();
+    run = run.substr(0, static_cast<std::size_t>(end - run_start));
+    const wchar_t* p = run.data();
+    const wchar_t* const last = p + run.size();
+    while (true) {
+      const wchar_t* const line_break = FindLineBreak(p, last);
+      if (line_break == last) {
+        line.append(p, last);
+        break;
+      }
+      if (line.empty()) {
+        SearchLine(regex, {p, static_cast<std::size_t>(line_break - p)},
+                   line_start, matches);
+      } else {
+        line.append(p, line_break);
+        SearchLine(regex, line, line_start, matches);
+        line.clear();
+      }
+      p = line_break + 1;
+      line_start = run_start + (p - run.data());
+    }
+  }
+  // The last line of the text has no line break. An empty text has just
+  // that line.
+  if ((line_start < end || snapshot_->GetCharCount() == 0) && !cancelled_) {
+    SearchLine(regex, line, line_start, matches);
+  }
+  return matches;
+}
+
+void RegexSearch::Deliver(int index, std::vector<Match> matches) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  finished_[index] = std::move(matches);
+  // Only one thread calls back at a time, which keeps the calls in order; it
+  // also passes on the ranges finished by others meanwhile.
+  if (delivering_) return;
+  delivering_ = true;
+  const int range_count = static_cast<int>(finished_.size());
+  while (!cancelled_ && next_to_deliver_ < range_count &&
+         finished_[next_to_deliver_]) {
+    std::optional<std::vector<Match>>& next = finished_[next_to_deliver_];
+    std::vector<Match> delivered = std::move(*next);
+    next.reset();
+    lock.unlock();
+    callback_(std::move(delivered));
+    lock.lock();
+    ++next_to_deliver_;
+  }
+  delivering_ = false;
+}
+
+}  // namespace wiese
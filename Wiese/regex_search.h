@@ -0,0 +1,103 @@
+#ifndef WIESE_REGEX_SEARCH_H_
+#define WIESE_REGEX_SEARCH_H_
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "document_snapshot.h"
+
+namespace wiese {
+
+// Finds all the matches of a regular expression in a snapshot on worker
+// threads. The text is split into ranges of whole lines which the workers
+// take in order; every range is read in place through a TextCursor, so the
+// text is never copied except for lines which span pieces.
+//
+// Matching is line by line, as in grep: a match never spans a line break,
+// and ^ and $ match at the start and the end of every line. An empty text is
+// one empty line.
+//
+// The matches are passed to the callback range by range in the order of the
+// text as soon as all the ranges in front are done, so the first ones show up
+// long before the whole text is searched.
+class RegexSearch {
+ public:
+  struct Match {
+    std::int64_t start;
+    std::int64_t end;
+
+    bool operator==(const Match& rhs) const {
+      return start == rhs.start && end == rhs.end;
+    }
+  };
+  // Called on one of the worker threads, one call at a time, with the
+  // matches in the next range of the text; often with none.
+  using MatchesCallback = std::function<void(std::vector<Match> matches)>;
+
+  static constexpr int kDefaultCharsPerRange = 1 << 20;
+
+  // Starts the search. Throws std::regex_error if |pattern| is not a valid
+  // ECMAScript regular expression. |thread_count| 0 uses one thread per core.
+  RegexSearch(std::shared_ptr<const DocumentSnapshot> snapshot,
+              const std::wstring& pattern, bool ignore_case,
+              MatchesCallback callback, int thread_count = 0,
+              int chars_per_range = kDefaultCharsPerRange);
+  RegexSearch(const RegexSearch&) = delete;
+  RegexSearch& operator=(const RegexSearch&) = delete;
+  // Cancels the search and waits for the workers.
+  ~RegexSearch();
+
+  // Makes the workers stop as soon as possible. The callback is not called
+  // again once this returns, except for a call already running. May be
+  // called from the callback.
+  void Cancel();
+  // Waits until the whole text is searched or the search is cancelled. Must
+  // not be called from the callback. If matching threw on a worker (like
+  // std::regex_error with error_complexity or error_stack) or the callback
+  // did, the search was cancelled then, and this rethrows the first
+  // exception.
+  void Wait();
+  // Returns true if the callback has been called for every range.
+  bool IsDone() const;
+
+ private:
+  void Work();
+  void JoinThreads();
+  std::vector<Match> SearchRange(const std::wregex& regex, std::int64_t start,
+                                 std::int64_t end);
+  // Stores the matches of the range |index| and passes on the ones which are
+  // next in order.
+  void Deliver(int index, std::vector<Match> matches);
+
+  const std::shared_ptr<const DocumentSnapshot> snapshot_;
+  const std::wregex regex_;
+  const MatchesCallback callback_;
+  // Range i is [range_starts_[i], range_starts_[i + 1]).
+  std::vector<std::int64_t> range_starts_;
+  std::atomic<int> next_range_;
+  std::atomic<bool> cancelled_;
+
+  mutable std::mutex mutex_;
+  // Matches of the ranges which are done but wait for the ones in front.
+  std::vector<std::optional<std::vector<Match>>> finished_;
+  int next_to_deliver_;
+  // True while a thread is passing matches on, which it does without the
+  // lock so that Cancel never waits for the callback.
+  bool delivering_;
+  std::exception_ptr error_;
+
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace wiese
+
+#endif
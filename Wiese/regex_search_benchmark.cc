@@ -0,0 +1,77 @@
+// Benchmarks for the regex search. They are disabled by default; run them
+// with --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*.
+
+#include "regex_search.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "document.h"
+
+namespace {
+
+constexpr std::size_t kInputBytes = std::size_t{1} << 26;
+constexpr int kLineLength = 80;
+// Distance between the characters inserted to break the text into pieces.
+constexpr int kPieceLength = 4096;
+// Matches the characters inserted above.
+constexpr const wchar_t* kPattern = L"y+x{3}";
+
+// Returns a document of kInputBytes whose text is split into pieces of about
+// kPieceLength characters from both buffers, plus the line breaks.
+const wiese::Document& GetDocument() {
+  static const std::unique_ptr<wiese::Document> document = [] {
+    std::wstring text(kInputBytes / sizeof(wchar_t), L'x');
+    for (std::size_t i = kLineLength; i < text.size(); i += kLineLength + 1) {
+      text[i] = L'\n';
+    }
+    auto document = std::make_unique<wiese::Document>(text.c_str());
+    std::vector<wiese::Edit> edits;
+    for (std::size_t i = 0; i < text.size(); i += kPieceLength) {
+      const int position = static_cast<int>(i);
+      edits.push_back({position, position + 1, L"y"});
+    }
+    document->ApplyEdits(std::move(edits));
+    return document;
+  }();
+  return *document;
+}
+
+void Measure(const char* name, int thread_count) {
+  using Clock = std::chrono::steady_clock;
+  auto snapshot = GetDocument().Snapshot();
+  const auto start = Clock::now();
+  Clock::time_point first_match;
+  std::size_t match_count = 0;
+  wiese::RegexSearch search(snapshot, kPattern, false,
+                            [&](std::vector<wiese::RegexSearch::Match> found) {
+                              if (match_count == 0 && !found.empty()) {
+                                first_match = Clock::now();
+                              }
+                              match_count += found.size();
+                            },
+                            thread_count);
+  search.Wait();
+  const std::chrono::duration<double> elapsed = Clock::now() - start;
+  const std::chrono::duration<double, std::milli> latency = first_match - start;
+  const double megabytes_per_second = kInputBytes / elapsed.count() / (1 << 20);
+  std::cout << name << ": " << megabytes_per_second << " MB/s, first match in "
+            << latency.count() << " ms (" << match_count << ")" << std::endl;
+  ::testing::Test::RecordProperty(name, std::to_string(megabytes_per_second));
+}
+
+}  // namespace
+
+TEST(RegexSearchBenchmark, DISABLED_OneThread) {
+  Measure("RegexSearch(1 thread)", 1);
+}
+
+TEST(RegexSearchBenchmark, DISABLED_AllThreads) {
+  Measure("RegexSearch(all threads)", 0);
+}
@@ -0,0 +1,180 @@
+#include "regex_search.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <random>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "document.h"
+
+namespace {
+
+using Match = wiese::RegexSearch::Match;
+
+// Returns the matches of |pattern| in every line of |text|, searched on one
+// thread without the class under test.
+std::vector<Match> ExpectedMatches(const std::wstring& text,
+                                   const std::wstring& pattern) {
+  const std::wregex regex(pattern);
+  std::vector<Match> matches;
+  std::size_t line_start = 0;
+  while (line_start < text.size()) {
+    std::size_t line_end = text.find(L'\n', line_start);
+    if (line_end == std::wstring::npos) line_end = text.size();
+    const wchar_t* first = text.data() + line_start;
+    for (std::wcregex_iterator it(first, text.data() + line_end, regex), end;
+         it != end; ++it) {
+      const int start = static_cast<int>(line_start + it->position());
+      matches.push_back({start, start + static_cast<int>(it->length())});
+    }
+    line_start = line_end + 1;
+  }
+  return matches;
+}
+
+std::vector<Match> FindAll(
+    const std::shared_ptr<const wiese::DocumentSnapshot>& snapshot,
+    const std::wstring& pattern, bool ignore_case, int thread_count,
+    int chars_per_range) {
+  std::vector<Match> matches;
+  wiese::RegexSearch search(
+      snapshot, pattern, ignore_case,
+      [&](std::vector<Match> found) {
+        matches.insert(matches.end(), found.begin(), found.end());
+      },
+      thread_count, chars_per_range);
+  search.Wait();
+  EXPECT_TRUE(search.IsDone());
+  return matches;
+}
+
+}  // namespace
+
+TEST(RegexSearch, MatchesLineByLine) {
+  wiese::Document doc(L"abc abd\nxabc\n\nab\nabc");
+  auto snapshot = doc.Snapshot();
+  EXPECT_EQ((std::vector<Match>{{0, 3}, {4, 7}, {9, 12}, {17, 20}}),
+            FindAll(snapshot, L"ab[cd]", false, 2, 4));
+  EXPECT_EQ((std::vector<Match>{{0, 3}, {17, 20}}),
+            FindAll(snapshot, L"^abc", false, 2, 4));
+  EXPECT_EQ((std::vector<Match>{{9, 12}, {17, 20}}),
+            FindAll(snapshot, L"abc$", false, 2, 4));
+  EXPECT_EQ((std::vector<Match>{{13, 13}}),
+            FindAll(snapshot, L"^$", false, 2, 4));
+  EXPECT_EQ((std::vector<Match>{}), FindAll(snapshot, L"c\nx", false, 2, 4));
+  EXPECT_EQ((std::vector<Match>{{0, 3}, {17, 20}}),
+            FindAll(snapshot, L"^ABC", true, 2, 4));
+}
+
+TEST(RegexSearch, EmptyDocument) {
+  wiese::Document doc(L"");
+  EXPECT_EQ((std::vector<Match>{{0, 0}}),
+            FindAll(doc.Snapshot(), L"^$", false, 0,
+                    wiese::RegexSearch::kDefaultCharsPerRange));
+  EXPECT_EQ((std::vector<Match>{}),
+            FindAll(doc.Snapshot(), L"a", false, 0,
+                    wiese::RegexSearch::kDefaultCharsPerRange));
+}
+
+TEST(RegexSearch, InvalidPatternThrows) {
+  wiese::Document doc(L"abc");
+  EXPECT_THROW(wiese::RegexSearch(doc.Snapshot(), L"a(", false,
+                                  [](std::vector<Match>) {}),
+               std::regex_error);
+}
+
+TEST(RegexSearch, RandomEditsAgreeWithOneThread) {
+  std::mt19937 random(1);
+  std::wstring text(20000, L'a');
+  for (wchar_t& ch : text) ch = L"abcd\n"[random() % 5];
+  wiese::Document doc(text.c_str());
+  // Splits the text into pieces of random sizes from both buffers, so that
+  // many lines span pieces.
+  for (int i = 0; i < 1000; ++i) {
+    const int start = random() % static_cast<int>(text.size());
+    const int end = std::min<int>(start + random() % 20, text.size());
+    std::wstring inserted(random() % 40, L'a');
+    for (wchar_t& ch : inserted) ch = L"abcd\n"[random() % 5];
+    doc.ApplyEdits({{start, end, inserted}});
+    text.replace(start, end - start, inserted);
+  }
+  ASSERT_EQ(text, doc.GetText());
+  auto snapshot = doc.Snapshot();
+  for (const wchar_t* pattern : {L"ab+c", L"^a", L"d$", L"(a|b)c*d", L"^$"}) {
+    const std::vector<Match> expected = ExpectedMatches(text, pattern);
+    EXPECT_EQ(expected, FindAll(snapshot, pattern, false, 4, 100)) << pattern;
+    EXPECT_EQ(expected, FindAll(snapshot, pattern, false, 1, 1 << 20))
+        << pattern;
+  }
+}
+
+TEST(RegexSearch, CancelStopsTheCallbacks) {
+  std::wstring text;
+  for (int i = 0; i < 10000; ++i) text += L"line\n";
+  wiese::Document doc(text.c_str());
+  std::promise<void> first_call;
+  std::promise<void> cancelled;
+  int call_count = 0;
+  wiese::RegexSearch search(
+      doc.Snapshot(), L"line", false,
+      [&](std::vector<Match> matches) {
+        EXPECT_EQ(0, matches.front().start);
+        if (++call_count > 1) return;
+        // Holds the workers until the search is cancelled.
+        first_call.set_value();
+        cancelled.get_future().wait();
+      },
+      4, 10);
+  first_call.get_future().wait();
+  search.Cancel();
+  cancelled.set_value();
+  search.Wait();
+  EXPECT_EQ(1, call_count);
+  EXPECT_FALSE(search.IsDone());
+}
+
+TEST(RegexSearch, CancelFromTheCallback) {
+  std::wstring text;
+  for (int i = 0; i < 1000; ++i) text += L"line\n";
+  wiese::Document doc(text.c_str());
+  int call_count = 0;
+  wiese::RegexSearch* search_pointer = nullptr;
+  std::promise<void> constructed;
+  std::shared_future<void> ready = constructed.get_future().share();
+  wiese::RegexSearch search(
+      doc.Snapshot(), L"line", false,
+      [&](std::vector<Match>) {
+        ready.wait();
+        ++call_count;
+        search_pointer->Cancel();
+      },
+      4, 10);
+  search_pointer = &search;
+  constructed.set_value();
+  search.Wait();
+  EXPECT_EQ(1, call_count);
+  EXPECT_FALSE(search.IsDone());
+}
+
+TEST(RegexSearch, WaitRethrowsTheCallbackException) {
+  std::wstring text;
+  for (int i = 0; i < 1000; ++i) text += L"line\n";
+  wiese::Document doc(text.c_str());
+  int call_count = 0;
+  wiese::RegexSearch search(
+      doc.Snapshot(), L"line", false,
+      [&](std::vector<Match>) {
+        ++call_count;
+        throw std::runtime_error("callback");
+      },
+      4, 10);
+  EXPECT_THROW(search.Wait(), std::runtime_error);
+  EXPECT_EQ(1, call_count);
+  EXPECT_FALSE(search.IsDone());
+}
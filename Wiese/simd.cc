@@ -0,0 +1,27 @@
+#include "simd.h"
+
+namespace wiese {
+
+#ifdef WIESE_HAS_SSE2
+
+bool HasAvx2() {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) return false;
+  __cpuid(info, 1);
+  const bool has_osxsave = (info[2] & (1 << 27)) != 0;
+  const bool has_avx = (info[2] & (1 << 28)) != 0;
+  if (!has_osxsave || !has_avx) return false;
+  // The OS has to save the YMM registers on context switches.
+  if ((_xgetbv(0) & 6) != 6) return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+}  // namespace wiese
@@ -0,0 +1,55 @@
+#ifndef WIESE_SIMD_H_
+#define WIESE_SIMD_H_
+
+#include <cstdint>
+
+// SSE2 is there on every x86 CPU Windows runs on. AVX2 has to be checked for
+// with HasAvx2() at run time, and functions using it have to be marked with
+// WIESE_TARGET_AVX2 for GCC and Clang.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define WIESE_HAS_SSE2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define WIESE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define WIESE_TARGET_AVX2
+#endif
+
+namespace wiese {
+
+#ifdef WIESE_HAS_SSE2
+
+bool HasAvx2();
+
+// Returns the index of the lowest set bit of |mask|, which must not be 0.
+inline int CountTrailingZeros(std::uint32_t mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+// Returns the index of the highest set bit of |mask|, which must not be 0.
+inline int FindLastSetBit(std::uint32_t mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanReverse(&index, mask);
+  return static_cast<int>(index);
+#else
+  return 31 - __builtin_clz(mask);
+#endif
+}
+
+#endif
+
+}  // namespace wiese
+
+#endif
@@ -0,0 +1,202 @@
+#include "text_cursor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+namespace wiese {
+
+TextCursor::TextCursor(std::shared_ptr<const DocumentSnapshot> snapshot,
+                       std::int64_t position)
+    : snapshot_(std::move(snapshot)), index_(0), line_(0), next_decoded_(0) {
+  if (snapshot_->is_compact()) {
+    decoded_ = std::make_unique<wchar_t[]>(2 * CompactText::kBlockSize);
+  }
+  Seek(position);
+}
+
+void TextCursor::Seek(std::int64_t position) {
+  const PieceTree& pieces = snapshot_->pieces();
+  assert(0 <= position && position <= pieces.GetCharCount());
+  it_ = pieces.FindPosition(position);
+  LoadChars();
+  index_ = static_cast<std::size_t>(position - it_.offset());
+  line_ = pieces.CountLineBreaksBefore(position);
+}
+
+void TextCursor::LoadChars() {
+  if (it_ == snapshot_->pieces().end()) {
+    chars_ = {};
+  } else {
+    wchar_t* buffer = nullptr;
+    if (decoded_) {
+      buffer = decoded_.get() + next_decoded_ * CompactText::kBlockSize;
+      next_decoded_ ^= 1;
+    }
+    chars_ = snapshot_->GetCharsInPiece(*it_, buffer);
+  }
+}
+
+void TextCursor::SkipEmptyPiecesForward() {
+  const auto end = snapshot_->pieces().end();
+  while (it_ != end && it_->GetCharCount() == 0) ++it_;
+  LoadChars();
+}
+
+void TextCursor::MoveForward() {
+  assert(!AtEnd());
+  if (it_->IsLineBreak()) ++line_;
+  if (++index_ < chars_.size()) return;
+  ++it_;
+  index_ = 0;
+  SkipEmptyPiecesForward();
+}
+
+void TextCursor::MoveBackward() {
+  assert(!AtStart());
+  if (index_ == 0) {
+    do {
+      --it_;
+    } while (it_->GetCharCount() == 0);
+    LoadChars();
+    index_ = chars_.size();
+  }
+  --index_;
+  if (it_->IsLineBreak()) --line_;
+}
+
+std::wstring_view TextCursor::NextChunk() {
+  if (AtEnd()) return {};
+  const std::wstring_view chunk = chars_.substr(index_);
+  if (it_->IsLineBreak()) ++line_;
+  ++it_;
+  index_ = 0;
+  SkipEmptyPiecesForward();
+  return chunk;
+}
+
+std::wstring_view TextCursor::PreviousChunk() {
+  if (AtStart()) return {};
+  if (index_ == 0) {
+    do {
+      --it_;
+    } while (it_->GetCharCount() == 0);
+    LoadChars();
+    index_ = chars_.size();
+  }
+  const std::wstring_view chunk = chars_.substr(0, index_);
+  index_ = 0;
+  if (it_->IsLineBreak()) --line_;
+  return chunk;
+}
+
+std::wstring_view TextCursor::GetRawChunk() const {
+  if (!AtEnd() && it_->IsLineBreak()) {
+    return GetLineEndingChars(it_->line_ending());
+  }
+  return GetChunk();
+}
+
+std::wstring_view TextCursor::NextRun() { return ReadNextRun(false); }
+
+std::wstring_view TextCursor::NextRawRun() { return ReadNextRun(true); }
+
+std::wstring_view TextCursor::ReadNextRun(bool raw_line_endings) {
+  std::wstring_view run = raw_line_endings ? GetRawChunk() : GetChunk();
+  NextChunk();
+  if (decoded_) return GatherNextRun(run, raw_line_endings);
+  while (!AtEnd() && run.size() < kMaxRunLength) {
+    const std::wstring_view longer =
+        snapshot_->AppendToRun(run, *it_, raw_line_endings);
+    if (longer.size() == run.size()) break;
+    run = longer;
+    NextChunk();
+  }
+  return run;
+}
+
+std::wstring_view TextCursor::PreviousRun() {
+  std::wstring_view run = PreviousChunk();
+  if (decoded_) return GatherPreviousRun(run);
+  while (!AtStart() && run.size() < kMaxRunLength) {
+    auto previous = it_;
+    do {
+      --previous;
+    } while (previous->GetCharCount() == 0);
+    const std::wstring_view longer = snapshot_->PrependToRun(*previous, run);
+    if (longer.size() == run.size()) break;
+    run = longer;
+    PreviousChunk();
+  }
+  return run;
+}
+
+std::wstring_view TextCursor::GatherNextRun(std::wstring_view chunk,
+                                            bool raw_line_endings) {
+  const auto get_chunk = [this, raw_line_endings] {
+    return raw_line_endings ? GetRawChunk() : GetChunk();
+  };
+  // Long chunks, such as a large paste, are still read in place.
+  if (AtEnd() || chunk.size() + get_chunk().size() > kMaxRunLength) {
+    return chunk;
+  }
+  run_.assign(chunk);
+  while (!AtEnd() && run_.size() + get_chunk().size() <= kMaxRunLength) {
+    run_.append(get_chunk());
+    NextChunk();
+  }
+  return run_;
+}
+
+std::wstring_view TextCursor::GatherPreviousRun(std::wstring_view chunk) {
+  // The chunks are appended backwards and the run turned around at the end,
+  // which keeps gathering linear.
+  run_.clear();
+  while (!AtStart()) {
+    auto previous = it_;
+    do {
+      --previous;
+    } while (previous->GetCharCount() == 0);
+    const std::size_t size = std::max(run_.size(), chunk.size());
+    if (size + static_cast<std::size_t>(previous->GetCharCount()) >
+        kMaxRunLength) {
+      break;
+    }
+    if (run_.empty()) run_.assign(chunk.rbegin(), chunk.rend());
+    const std::wstring_view previous_chunk = PreviousChunk();
+    run_.append(previous_chunk.rbegin(), previous_chunk.rend());
+  }
+  if (run_.empty()) return chunk;
+  std::reverse(run_.begin(), run_.end());
+  return run_;
+}
+
+bool TextCursor::NextLine() {
+  while (!AtEnd()) {
+    const bool is_line_break = it_->IsLineBreak();
+    NextChunk();
+    if (is_line_break) return true;
+  }
+  return false;
+}
+
+void TextCursor::MoveToLineStart() {
+  while (!AtStart()) {
+    // A line break is a piece of its own, so the cursor can be right after
+    // one only at the start of a piece.
+    if (index_ == 0) {
+      auto previous = it_;
+      do {
+        --previous;
+      } while (previous->GetCharCount() == 0);
+      if (previous->IsLineBreak()) return;
+    }
+    PreviousChunk();
+  }
+}
+
+}  // namespace wiese
@@ -0,0 +1,113 @@
+#ifndef WIESE_TEXT_CURSOR_H_
+#define WIESE_TEXT_CURSOR_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "document_snapshot.h"
+#include "piece_tree.h"
+
+namespace wiese {
+
+// Sequential access to the text of a snapshot without copying it. Seeking is
+// O(log n) in the number of pieces; moving by a character or a chunk from
+// there is amortized O(1). A chunk is a run of characters which are
+// contiguous in memory, i.e. the rest of a piece.
+//
+// The cursor is between two characters; |position()| is the index of the
+// character after it. It holds a reference to the snapshot, so it can be
+// used on any thread.
+//
+// Pieces of a compact original text (see CompactText) are decoded into
+// buffers of the cursor, so the characters returned by the functions below
+// are only valid until the cursor moves again.
+class TextCursor {
+ public:
+  static constexpr std::size_t kMaxRunLength = 1 << 16;
+
+  TextCursor(std::shared_ptr<const DocumentSnapshot> snapshot,
+             std::int64_t position);
+
+  std::int64_t position() const {
+    return it_.offset() + static_cast<std::int64_t>(index_);
+  }
+  // Line the character after the cursor is on.
+  std::int64_t line() const { return line_; }
+  bool AtStart() const { return position() == 0; }
+  bool AtEnd() const { return index_ == chars_.size(); }
+
+  // Moves the cursor to |position| in O(log n).
+  void Seek(std::int64_t position);
+
+  // Returns the character after the cursor. The cursor must not be at the
+  // end.
+  wchar_t GetChar() const {
+    assert(!AtEnd());
+    return chars_[index_];
+  }
+  void MoveForward();
+  void MoveBackward();
+
+  // Returns the characters from the cursor to the end of the current chunk
+  // without moving. Empty at the end of the text.
+  std::wstring_view GetChunk() const { return chars_.substr(index_); }
+  // Returns the characters from the cursor to the end of the current chunk
+  // and moves past them. Empty at the end of the text.
+  std::wstring_view NextChunk();
+  // Returns the characters from the start of the chunk before the cursor to
+  // the cursor and moves in front of them. Empty at the start of the text.
+  std::wstring_view PreviousChunk();
+  // Same as NextChunk and PreviousChunk, but take as many pieces as are
+  // contiguous in memory, e.g. all the unedited lines of the original text
+  // (see DocumentSnapshot::AppendToRun). Good for scanning the text. A run
+  // stops growing at kMaxRunLength characters, so that finding something
+  // close to the cursor does not walk every piece of an unedited file.
+  // Nothing is contiguous in a compact snapshot, where runs are copied
+  // together from the chunks up to the same length instead.
+  std::wstring_view NextRun();
+  std::wstring_view PreviousRun();
+  // Same as NextRun, but every line break is given as the characters of its
+  // line ending (see LineEnding), so the run may be longer than the distance
+  // the cursor moved. For writing the text out as it was read.
+  std::wstring_view NextRawRun();
+
+  // Moves to the start of the next line. Returns false, and moves to the end
+  // of the text, if the cursor is on the last line.
+  bool NextLine();
+  // Moves to the start of the line the cursor is on.
+  void MoveToLineStart();
+
+ private:
+  // Makes |it_| point to a non-empty piece, or end, and loads its chars.
+  void SkipEmptyPiecesForward();
+  void LoadChars();
+  // Same as GetChunk, but gives a line break as the characters of its line
+  // ending.
+  std::wstring_view GetRawChunk() const;
+  std::wstring_view ReadNextRun(bool raw_line_endings);
+  std::wstring_view GatherNextRun(std::wstring_view chunk,
+                                  bool raw_line_endings);
+  std::wstring_view GatherPreviousRun(std::wstring_view chunk);
+
+  std::shared_ptr<const DocumentSnapshot> snapshot_;
+  PieceTree::const_iterator it_;
+  // Characters of the piece |it_| points to; empty at the end.
+  std::wstring_view chars_;
+  std::size_t index_;
+  std::int64_t line_;
+  // Two buffers of CompactText::kBlockSize characters which pieces of a
+  // compact snapshot are decoded into in turn, so that the chunk before the
+  // current piece stays valid; null for other snapshots.
+  std::unique_ptr<wchar_t[]> decoded_;
+  int next_decoded_;
+  // Runs gathered from chunks of a compact snapshot.
+  std::wstring run_;
+};
+
+}  // namespace wiese
+
+#endif
@@ -0,0 +1,218 @@
+#include "text_cursor.h"
+
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <string>
+
+#include "document.h"
+
+namespace {
+
+constexpr const wchar_t* kText = L"01234\n6789a\n\ncd";
+
+// Returns a document whose text is kText, spread over several pieces.
+std::unique_ptr<wiese::Document> MakeDocument() {
+  auto doc = std::make_unique<wiese::Document>(L"0134\n6789a\nd");
+  doc->InsertStringBefore(L"2", 2);
+  doc->InsertStringBefore(L"\nc", 12);
+  return doc;
+}
+
+}  // namespace
+
+TEST(TextCursor, MoveForward) {
+  auto doc = MakeDocument();
+  ASSERT_EQ(kText, doc->GetText());
+  wiese::TextCursor cursor(doc->Snapshot(), 0);
+  std::wstring text;
+  for (; !cursor.AtEnd(); cursor.MoveForward()) {
+    EXPECT_EQ(static_cast<int>(text.size()), cursor.position());
+    text += cursor.GetChar();
+  }
+  EXPECT_EQ(kText, text);
+  EXPECT_EQ(3, cursor.line());
+}
+
+TEST(TextCursor, MoveBackward) {
+  auto doc = MakeDocument();
+  wiese::TextCursor cursor(doc->Snapshot(), doc->GetCharCount());
+  std::wstring text;
+  while (!cursor.AtStart()) {
+    cursor.MoveBackward();
+    text.insert(text.begin(), cursor.GetChar());
+  }
+  EXPECT_EQ(kText, text);
+  EXPECT_EQ(0, cursor.line());
+}
+
+TEST(TextCursor, Seek) {
+  auto doc = MakeDocument();
+  wiese::TextCursor cursor(doc->Snapshot(), 7);
+  EXPECT_EQ(L'7', cursor.GetChar());
+  EXPECT_EQ(1, cursor.line());
+  cursor.Seek(12);
+  EXPECT_EQ(L'\n', cursor.GetChar());
+  EXPECT_EQ(2, cursor.line());
+  cursor.Seek(doc->GetCharCount());
+  EXPECT_TRUE(cursor.AtEnd());
+}
+
+TEST(TextCursor, NextChunk) {
+  auto doc = MakeDocument();
+  wiese::TextCursor cursor(doc->Snapshot(), 1);
+  EXPECT_EQ(L"1", cursor.GetChunk());
+  std::wstring text;
+  for (auto chunk = cursor.NextChunk(); !chunk.empty();
+       chunk = cursor.NextChunk()) {
+    text += chunk;
+  }
+  EXPECT_EQ(std::wstring(kText).substr(1), text);
+  EXPECT_TRUE(cursor.AtEnd());
+}
+
+TEST(TextCursor, PreviousChunk) {
+  auto doc = MakeDocument();
+  wiese::TextCursor cursor(doc->Snapshot(), 8);
+  std::wstring text;
+  for (auto chunk = cursor.PreviousChunk(); !chunk.empty();
+       chunk = cursor.PreviousChunk()) {
+    text.insert(0, chunk);
+  }
+  EXPECT_EQ(L"01234\n67", text);
+  EXPECT_TRUE(cursor.AtStart());
+  EXPECT_EQ(0, cursor.line());
+}
+
+TEST(TextCursor, NextLine) {
+  auto doc = MakeDocument();
+  wiese::TextCursor cursor(doc->Snapshot(), 2);
+  EXPECT_TRUE(cursor.NextLine());
+  EXPECT_EQ(6, cursor.position());
+  EXPECT_TRUE(cursor.NextLine());
+  EXPECT_EQ(12, cursor.position());
+  EXPECT_TRUE(cursor.NextLine());
+  EXPECT_EQ(13, cursor.position());
+  EXPECT_EQ(3, cursor.line());
+  EXPECT_FALSE(cursor.NextLine());
+  EXPECT_TRUE(cursor.AtEnd());
+}
+
+TEST(TextCursor, MoveToLineStart) {
+  auto doc = MakeDocument();
+  wiese::TextCursor cursor(doc->Snapshot(), 10);
+  cursor.MoveToLineStart();
+  EXPECT_EQ(6, cursor.position());
+  cursor.MoveToLineStart();
+  EXPECT_EQ(6, cursor.position());
+  cursor.Seek(12);
+  cursor.MoveToLineStart();
+  EXPECT_EQ(12, cursor.position());
+  cursor.Seek(4);
+  cursor.MoveToLineStart();
+  EXPECT_EQ(0, cursor.position());
+}
+
+TEST(TextCursor, KeepsSnapshot) {
+  auto doc = MakeDocument();
+  wiese::TextCursor cursor(doc->Snapshot(), 0);
+  doc->EraseCharsInRange(0, doc->GetCharCount());
+  doc.reset();
+  std::wstring text;
+  for (auto chunk = cursor.NextChunk(); !chunk.empty();
+       chunk = cursor.NextChunk()) {
+    text += chunk;
+  }
+  EXPECT_EQ(kText, text);
+}
+
+TEST(TextCursor, NextRun) {
+  auto doc = MakeDocument();
+  wiese::TextCursor cursor(doc->Snapshot(), 0);
+  EXPECT_EQ(L"01", cursor.NextRun());
+  EXPECT_EQ(L"2", cursor.NextRun());
+  // The original text is contiguous from here up to the inserted line break.
+  EXPECT_EQ(L"34\n6789a\n", cursor.NextRun());
+  EXPECT_EQ(2, cursor.line());
+  EXPECT_EQ(L"\n", cursor.NextRun());
+  EXPECT_EQ(L"c", cursor.NextRun());
+  EXPECT_EQ(L"d", cursor.NextRun());
+  EXPECT_TRUE(cursor.AtEnd());
+  EXPECT_EQ(3, cursor.line());
+}
+
+TEST(TextCursor, PreviousRun) {
+  auto doc = MakeDocument();
+  wiese::TextCursor cursor(doc->Snapshot(), 9);
+  EXPECT_EQ(L"34\n678", cursor.PreviousRun());
+  EXPECT_EQ(3, cursor.position());
+  EXPECT_EQ(0, cursor.line());
+  EXPECT_EQ(L"2", cursor.PreviousRun());
+  EXPECT_EQ(L"01", cursor.PreviousRun());
+  EXPECT_TRUE(cursor.AtStart());
+}
+
+TEST(TextCursor, NextRawRun) {
+  wiese::Document doc(L"ab\r\ncd\ref\r\n");
+  doc.InsertLineBreakBefore(7);
+  doc.InsertStringBefore(L"x", 1);
+  wiese::TextCursor cursor(doc.Snapshot(), 0);
+  EXPECT_EQ(L"a", cursor.NextRawRun());
+  EXPECT_EQ(L"x", cursor.NextRawRun());
+  // Line breaks of the original text are read in place with the rest.
+  EXPECT_EQ(L"b\r\ncd\re", cursor.NextRawRun());
+  EXPECT_EQ(L"\r\n", cursor.NextRawRun());
+  EXPECT_EQ(9, cursor.position());
+  EXPECT_EQ(L"f\r\n", cursor.NextRawRun());
+  EXPECT_TRUE(cursor.AtEnd());
+  EXPECT_EQ(4, cursor.line());
+}
+
+TEST(TextCursor, NextRawRunOfCompactText) {
+  wiese::Document doc(L"ab\r\ncd\ref\r\n", wiese::TextStorage::kCompact);
+  doc.InsertLineBreakBefore(7);
+  wiese::TextCursor cursor(doc.Snapshot(), 0);
+  EXPECT_EQ(L"ab\r\ncd\re\r\nf\r\n", cursor.NextRawRun());
+  EXPECT_TRUE(cursor.AtEnd());
+}
+
+TEST(TextCursor, RunsOfCompactText) {
+  wiese::Document doc(L"0134\n6789a\nd", wiese::TextStorage::kCompact);
+  doc.InsertStringBefore(L"2", 2);
+  doc.InsertStringBefore(L"\nc", 12);
+  ASSERT_EQ(kText, doc.GetText());
+  // Runs are copied together from all kinds of pieces.
+  wiese::TextCursor cursor(doc.Snapshot(), 1);
+  EXPECT_EQ(L"1234\n6789a\n\ncd", cursor.NextRun());
+  EXPECT_EQ(3, cursor.line());
+  EXPECT_EQ(kText, cursor.PreviousRun());
+  EXPECT_EQ(0, cursor.line());
+  EXPECT_TRUE(cursor.AtStart());
+}
+
+TEST(TextCursor, LongRunsOfCompactText) {
+  std::wstring text;
+  for (int i = 0; text.size() < 3 * wiese::TextCursor::kMaxRunLength; ++i) {
+    text += i % 7 == 0 ? L"\u3042\n" : L"abc\n";
+  }
+  wiese::Document doc(text.c_str(), wiese::TextStorage::kCompact);
+  doc.InsertStringBefore(L"xyz", 5000);
+  text.insert(5000, L"xyz");
+  wiese::TextCursor cursor(doc.Snapshot(), 0);
+  std::wstring forward;
+  while (!cursor.AtEnd()) {
+    const std::wstring_view run = cursor.NextRun();
+    EXPECT_LE(run.size(), wiese::TextCursor::kMaxRunLength);
+    forward += run;
+  }
+  EXPECT_EQ(text, forward);
+  std::wstring backward;
+  while (!cursor.AtStart()) {
+    const std::wstring_view run = cursor.PreviousRun();
+    EXPECT_LE(run.size(), wiese::TextCursor::kMaxRunLength);
+    backward.insert(0, run);
+    EXPECT_EQ(text.size() - backward.size(),
+              static_cast<std::size_t>(cursor.position()));
+  }
+  EXPECT_EQ(text, backward);
+}
@@ -0,0 +1,226 @@
+#include "text_encoder.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+#include "simd.h"
+
+namespace wiese {
+
+namespace {
+
+constexpr char32_t kReplacementChar = 0xFFFD;
+
+bool IsHighSurrogate(char32_t ch) { return 0xD800 <= ch && ch < 0xDC00; }
+bool IsLowSurrogate(char32_t ch) { return 0xDC00 <= ch && ch < 0xE000; }
+bool IsSurrogate(char32_t ch) { return 0xD800 <= ch && ch < 0xE000; }
+
+char32_t CodePointOf(wchar_t ch) {
+  // wchar_t is signed where it is 32 bits; negative values are not
+  // characters and end up replaced.
+  return static_cast<char32_t>(
+      static_cast<std::make_unsigned_t<wchar_t>>(ch));
+}
+
+char32_t CombineSurrogates(char32_t high, char32_t low) {
+  return 0x10000 + ((high - 0xD800) << 10) + (low - 0xDC00);
+}
+
+char* PutUtf8(char32_t ch, char* out) {
+  if (ch < 0x80) {
+    *out++ = static_cast<char>(ch);
+  } else if (ch < 0x800) {
+    *out++ = static_cast<char>(0xC0 | (ch >> 6));
+    *out++ = static_cast<char>(0x80 | (ch & 0x3F));
+  } else if (ch < 0x10000) {
+    *out++ = static_cast<char>(0xE0 | (ch >> 12));
+    *out++ = static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+    *out++ = static_cast<char>(0x80 | (ch & 0x3F));
+  } else {
+    *out++ = static_cast<char>(0xF0 | (ch >> 18));
+    *out++ = static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+    *out++ = static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+    *out++ = static_cast<char>(0x80 | (ch & 0x3F));
+  }
+  return out;
+}
+
+char* PutUtf16Le(char32_t unit, char* out) {
+  *out++ = static_cast<char>(unit & 0xFF);
+  *out++ = static_cast<char>(unit >> 8);
+  return out;
+}
+
+// Copies the ASCII characters at the start of |chars| to |out| as bytes and
+// returns how many there are.
+std::size_t CopyAscii(const wchar_t* chars, std::size_t count, char* out) {
+  std::size_t i = 0;
+#ifdef WIESE_HAS_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  if constexpr (sizeof(wchar_t) == 2) {
+    const __m128i non_ascii = _mm_set1_epi16(static_cast<short>(0xFF80));
+    for (; i + 16 <= count; i += 16) {
+      const __m128i a =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(chars + i));
+      const __m128i b =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(chars + i + 8));
+      const __m128i high_bits = _mm_and_si128(_mm_or_si128(a, b), non_ascii);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi16(high_bits, zero)) != 0xFFFF) {
+        break;
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                       _mm_packus_epi16(a, b));
+    }
+  } else {
+    const __m128i non_ascii = _mm_set1_epi32(static_cast<int>(0xFFFFFF80u));
+    for (; i + 16 <= count; i += 16) {
+      __m128i v[4];
+      __m128i all = zero;
+      for (int j = 0; j < 4; ++j) {
+        v[j] = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(chars + i + 4 * j));
+        all = _mm_or_si128(all, v[j]);
+      }
+      const __m128i high_bits = _mm_and_si128(all, non_ascii);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(high_bits, zero)) != 0xFFFF) {
+        break;
+      }
+      const __m128i low = _mm_packs_epi32(v[0], v[1]);
+      const __m128i high = _mm_packs_epi32(v[2], v[3]);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                       _mm_packus_epi16(low, high));
+    }
+  }
+#endif
+  for (; i < count && CodePointOf(chars[i]) < 0x80; ++i) {
+    out[i] = static_cast<char>(chars[i]);
+  }
+  return i;
+}
+
+// Stores the characters in the BMP at the start of |chars| (32-bit wchar_t
+// only) to |out| as UTF-16LE units and returns how many there are.
+std::size_t NarrowBmp(const wchar_t* chars, std::size_t count, char* out) {
+  std::size_t i = 0;
+#ifdef WIESE_HAS_SSE2
+  if constexpr (sizeof(wchar_t) == 4) {
+    // SSE2 can only pack with signed saturation, so the values are moved
+    // into the signed range and back.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i non_bmp = _mm_set1_epi32(static_cast<int>(0xFFFF0000u));
+    const __m128i bias32 = _mm_set1_epi32(0x8000);
+    const __m128i bias16 = _mm_set1_epi16(static_cast<short>(0x8000));
+    for (; i + 8 <= count; i += 8) {
+      const __m128i a =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(chars + i));
+      const __m128i b =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(chars + i + 4));
+      const __m128i high_bits = _mm_and_si128(_mm_or_si128(a, b), non_bmp);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(high_bits, zero)) != 0xFFFF) {
+        break;
+      }
+      const __m128i packed = _mm_packs_epi32(_mm_sub_epi32(a, bias32),
+                                             _mm_sub_epi32(b, bias32));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i),
+                       _mm_add_epi16(packed, bias16));
+    }
+  }
+#endif
+  for (; i < count && CodePointOf(chars[i]) < 0x10000; ++i) {
+    PutUtf16Le(CodePointOf(chars[i]), out + 2 * i);
+  }
+  return i;
+}
+
+}  // namespace
+
+TextEncoder::TextEncoder(TextEncoding encoding)
+    : encoding_(encoding), pending_surrogate_(0) {}
+
+std::size_t TextEncoder::Encode(std::wstring_view chars, char* out) {
+  switch (encoding_) {
+    case TextEncoding::kUtf8:
+      return EncodeUtf8(chars, out);
+    case TextEncoding::kUtf16Le:
+      return EncodeUtf16Le(chars, out);
+  }
+  return 0;
+}
+
+std::size_t TextEncoder::Finish(char* out) {
+  if (!pending_surrogate_) return 0;
+  pending_surrogate_ = 0;
+  return PutUtf8(kReplacementChar, out) - out;
+}
+
+std::size_t TextEncoder::EncodeUtf8(std::wstring_view chars, char* out) {
+  char* p = out;
+  std::size_t i = 0;
+  if (pending_surrogate_ && !chars.empty()) {
+    const char32_t high = CodePointOf(pending_surrogate_);
+    const char32_t low = CodePointOf(chars[0]);
+    if (IsLowSurrogate(low)) {
+      p = PutUtf8(CombineSurrogates(high, low), p);
+      i = 1;
+    } else {
+      p = PutUtf8(kReplacementChar, p);
+    }
+    pending_surrogate_ = 0;
+  }
+  while (i < chars.size()) {
+    const std::size_t ascii_count =
+        CopyAscii(chars.data() + i, chars.size() - i, p);
+    i += ascii_count;
+    p += ascii_count;
+    if (i == chars.size()) break;
+
+    char32_t ch = CodePointOf(chars[i++]);
+    if (sizeof(wchar_t) == 2 && IsHighSurrogate(ch)) {
+      if (i == chars.size()) {
+        pending_surrogate_ = chars[i - 1];
+        break;
+      }
+      const char32_t low = CodePointOf(chars[i]);
+      if (IsLowSurrogate(low)) {
+        p = PutUtf8(CombineSurrogates(ch, low), p);
+        ++i;
+        continue;
+      }
+    }
+    if (IsSurrogate(ch) || ch > 0x10FFFF) ch = kReplacementChar;
+    p = PutUtf8(ch, p);
+  }
+  return p - out;
+}
+
+std::size_t TextEncoder::EncodeUtf16Le(std::wstring_view chars, char* out) {
+  if constexpr (sizeof(wchar_t) == 2) {
+    // Every target Windows runs on is little endian.
+    std::memcpy(out, chars.data(), chars.size() * sizeof(wchar_t));
+    return chars.size() * sizeof(wchar_t);
+  }
+  char* p = out;
+  std::size_t i = 0;
+  while (i < chars.size()) {
+    const std::size_t bmp_count =
+        NarrowBmp(chars.data() + i, chars.size() - i, p);
+    i += bmp_count;
+    p += 2 * bmp_count;
+    if (i == chars.size()) break;
+
+    char32_t ch = CodePointOf(chars[i++]);
+    if (ch > 0x10FFFF) {
+      p = PutUtf16Le(kReplacementChar, p);
+    } else {
+      ch -= 0x10000;
+      p = PutUtf16Le(0xD800 + (ch >> 10), p);
+      p = PutUtf16Le(0xDC00 + (ch & 0x3FF), p);
+    }
+  }
+  return p - out;
+}
+
+}  // namespace wiese
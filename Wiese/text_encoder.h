@@ -0,0 +1,51 @@
+#ifndef WIESE_TEXT_ENCODER_H_
+#define WIESE_TEXT_ENCODER_H_
+
+#include <cstddef>
+#include <string_view>
+
+namespace wiese {
+
+enum class TextEncoding { kUtf8, kUtf16Le };
+
+// Converts text, as wchar_t units (UTF-16 on Windows, UTF-32 elsewhere), into
+// bytes in |encoding| a slice at a time, so that a text of any size can be
+// encoded through a small buffer. A surrogate pair split between two slices
+// is carried over to the next call.
+//
+// Runs of ASCII characters, the bulk of most source code and logs, are
+// converted 16 at a time with SSE2.
+//
+// Unpaired surrogates become U+FFFD in UTF-8. UTF-16LE output is the units
+// as they are when wchar_t is 16 bits, so that any text survives a round
+// trip.
+class TextEncoder {
+ public:
+  explicit TextEncoder(TextEncoding encoding);
+
+  // Upper bound of the bytes Encode writes for |char_count| units, including
+  // a surrogate carried over from the previous call.
+  static constexpr std::size_t MaxEncodedSize(std::size_t char_count) {
+    return 4 * char_count + 4;
+  }
+
+  // Encodes |chars| into |out|, which must have room for
+  // MaxEncodedSize(chars.size()) bytes, and returns the number of bytes
+  // written.
+  std::size_t Encode(std::wstring_view chars, char* out);
+  // Writes what is left of a surrogate pair cut off at the end of the text,
+  // at most MaxEncodedSize(0) bytes, and returns the number of bytes written.
+  std::size_t Finish(char* out);
+
+ private:
+  std::size_t EncodeUtf8(std::wstring_view chars, char* out);
+  std::size_t EncodeUtf16Le(std::wstring_view chars, char* out);
+
+  TextEncoding encoding_;
+  // High surrogate at the end of the last slice, or 0.
+  wchar_t pending_surrogate_;
+};
+
+}  // namespace wiese
+
+#endif
@@ -0,0 +1,97 @@
+#include "text_encoder.h"
+
+#include "gtest/gtest.h"
+
+#include <initializer_list>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Returns the code points as wchar_t units, with surrogate pairs where
+// wchar_t is 16 bits.
+std::wstring FromCodePoints(std::initializer_list<char32_t> code_points) {
+  std::wstring text;
+  for (char32_t ch : code_points) {
+    if (sizeof(wchar_t) == 2 && ch >= 0x10000) {
+      text += static_cast<wchar_t>(0xD800 + ((ch - 0x10000) >> 10));
+      text += static_cast<wchar_t>(0xDC00 + ((ch - 0x10000) & 0x3FF));
+    } else {
+      text += static_cast<wchar_t>(ch);
+    }
+  }
+  return text;
+}
+
+// Encodes |text| in slices of the given sizes, repeated as needed.
+std::string Encode(wiese::TextEncoding encoding, std::wstring_view text,
+                   const std::vector<std::size_t>& slice_sizes) {
+  wiese::TextEncoder encoder(encoding);
+  std::string bytes;
+  std::size_t i = 0;
+  while (!text.empty()) {
+    const std::size_t size =
+        std::min(slice_sizes[i++ % slice_sizes.size()], text.size());
+    std::string out(wiese::TextEncoder::MaxEncodedSize(size), '\0');
+    out.resize(encoder.Encode(text.substr(0, size), &out[0]));
+    bytes += out;
+    text.remove_prefix(size);
+  }
+  std::string out(wiese::TextEncoder::MaxEncodedSize(0), '\0');
+  out.resize(encoder.Finish(&out[0]));
+  return bytes + out;
+}
+
+std::string Encode(wiese::TextEncoding encoding, std::wstring_view text) {
+  return Encode(encoding, text, {text.size() + 1});
+}
+
+}  // namespace
+
+TEST(TextEncoder, EncodesUtf8) {
+  const std::wstring text = FromCodePoints({'a', 0xE9, 0x3042, 0x1F600, '\n'});
+  EXPECT_EQ("a\xC3\xA9\xE3\x81\x82\xF0\x9F\x98\x80\n",
+            Encode(wiese::TextEncoding::kUtf8, text));
+}
+
+TEST(TextEncoder, EncodesUtf16Le) {
+  const std::wstring text = FromCodePoints({'a', 0x3042, 0x1F600});
+  EXPECT_EQ(std::string("a\0\x42\x30\x3D\xD8\x00\xDE", 8),
+            Encode(wiese::TextEncoding::kUtf16Le, text));
+}
+
+TEST(TextEncoder, ReplacesUnpairedSurrogatesInUtf8) {
+  const std::string replacement = "\xEF\xBF\xBD";
+  const wchar_t high = static_cast<wchar_t>(0xD83D);
+  const wchar_t low = static_cast<wchar_t>(0xDE00);
+  EXPECT_EQ("a" + replacement + "b",
+            Encode(wiese::TextEncoding::kUtf8, std::wstring{L'a', low, L'b'}));
+  EXPECT_EQ("a" + replacement + "b",
+            Encode(wiese::TextEncoding::kUtf8, std::wstring{L'a', high, L'b'}));
+  EXPECT_EQ("a" + replacement,
+            Encode(wiese::TextEncoding::kUtf8, std::wstring{L'a', high}));
+}
+
+TEST(TextEncoder, SlicesDoNotChangeTheOutput) {
+  std::mt19937 random(1);
+  const std::vector<char32_t> alphabet = {'a', '\n', 0x7F, 0x80, 0x7FF, 0x800,
+                                          0x3042, 0xFFFF, 0x10000, 0x1F600};
+  std::wstring text;
+  for (int i = 0; i < 5000; ++i) {
+    // Long ASCII runs go through the vector code.
+    if (random() % 2) {
+      text += std::wstring(random() % 40, L'x');
+    } else {
+      text += FromCodePoints({alphabet[random() % alphabet.size()]});
+    }
+  }
+  for (auto encoding :
+       {wiese::TextEncoding::kUtf8, wiese::TextEncoding::kUtf16Le}) {
+    const std::string expected = Encode(encoding, text);
+    for (std::size_t slice_size : {1, 2, 3, 7, 16, 33, 1000}) {
+      EXPECT_EQ(expected, Encode(encoding, text, {slice_size})) << slice_size;
+    }
+    EXPECT_EQ(expected, Encode(encoding, text, {5, 1, 17, 2, 64}));
+  }
+}
@@ -0,0 +1,168 @@
+#include "unit_index.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "simd.h"
+
+namespace wiese {
+
+namespace {
+
+constexpr bool kWideCharIsUtf16 = sizeof(wchar_t) == 2;
+
+using WideUnit = std::make_unsigned_t<wchar_t>;
+
+bool IsHighSurrogate(wchar_t ch) {
+  return 0xD800 <= static_cast<WideUnit>(ch) &&
+         static_cast<WideUnit>(ch) < 0xDC00;
+}
+
+bool IsLowSurrogate(wchar_t ch) {
+  return 0xDC00 <= static_cast<WideUnit>(ch) &&
+         static_cast<WideUnit>(ch) < 0xE000;
+}
+
+bool IsOutsideBmp(wchar_t ch) {
+  return 0x10000 <= static_cast<WideUnit>(ch) &&
+         static_cast<WideUnit>(ch) <= 0x10FFFF;
+}
+
+// Returns the first character in [first, last) which may take two UTF-16
+// units: a surrogate where wchar_t is 16 bits, and a character above U+FFFF
+// elsewhere. Returns |last| if there is none.
+const wchar_t* FindCandidate(const wchar_t* first, const wchar_t* last) {
+#ifdef WIESE_HAS_SSE2
+  constexpr std::size_t kCharsPerVector = 16 / sizeof(wchar_t);
+  const __m128i zero = _mm_setzero_si128();
+  for (; last - first >= static_cast<std::ptrdiff_t>(kCharsPerVector);
+       first += kCharsPerVector) {
+    const __m128i chars =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+    int mask;
+    if constexpr (kWideCharIsUtf16) {
+      const __m128i masked = _mm_and_si128(
+          chars, _mm_set1_epi16(static_cast<short>(0xF800)));
+      mask = _mm_movemask_epi8(_mm_cmpeq_epi16(
+          masked, _mm_set1_epi16(static_cast<short>(0xD800))));
+    } else {
+      const __m128i high_bits = _mm_and_si128(
+          chars, _mm_set1_epi32(static_cast<int>(0xFFFF0000u)));
+      mask = ~_mm_movemask_epi8(_mm_cmpeq_epi32(high_bits, zero)) & 0xFFFF;
+    }
+    if (mask != 0) {
+      return first + CountTrailingZeros(mask) / sizeof(wchar_t);
+    }
+  }
+#endif
+  for (; first != last; ++first) {
+    const WideUnit ch = static_cast<WideUnit>(*first);
+    if (kWideCharIsUtf16 ? (ch & 0xF800) == 0xD800 : ch > 0xFFFF) break;
+  }
+  return first;
+}
+
+}  // namespace
+
+UnitIndex::Builder::Builder() : pending_high_surrogate_(false) {}
+
+void UnitIndex::Builder::Add(std::wstring_view chars) {
+  const wchar_t* p = chars.data();
+  const wchar_t* const last = p + chars.size();
+  if (pending_high_surrogate_ && p != last) {
+    if (IsLowSurrogate(*p)) {
+      AddMarker();
+    } else {
+      AddGap(1);
+    }
+    pending_high_surrogate_ = false;
+  }
+  while (true) {
+    const wchar_t* const candidate = FindCandidate(p, last);
+    AddGap(candidate - p);
+    if (candidate == last) return;
+    p = candidate + 1;
+    if (!kWideCharIsUtf16) {
+      if (IsOutsideBmp(*candidate)) {
+        AddMarker();
+      } else {
+        AddGap(1);
+      }
+    } else if (!IsHighSurrogate(*candidate)) {
+      AddGap(1);
+    } else if (p == last) {
+      pending_high_surrogate_ = true;
+      return;
+    } else if (IsLowSurrogate(*p)) {
+      // The low surrogate is counted as an ordinary character.
+      AddMarker();
+    } else {
+      AddGap(1);
+    }
+  }
+}
+
+std::vector<Piece> UnitIndex::Builder::Finish(wchar_t next) {
+  if (pending_high_surrogate_) {
+    if (IsLowSurrogate(next)) {
+      AddMarker();
+    } else {
+      AddGap(1);
+    }
+    pending_high_surrogate_ = false;
+  }
+  return std::move(pieces_);
+}
+
+void UnitIndex::Builder::AddGap(std::int64_t count) {
+  if (count == 0) return;
+  if (!pieces_.empty() && pieces_.back().IsPlain()) {
+    Piece& last = pieces_.back();
+    const std::int64_t added =
+        std::min(count, Piece::kMaxLength - last.GetCharCount());
+    last.set_end(last.end() + added);
+    count -= added;
+    if (count == 0) return;
+  }
+  Piece::AppendPlain(0, count, pieces_);
+}
+
+void UnitIndex::Builder::AddMarker() {
+  pieces_.push_back(Piece::MakeLineBreak());
+}
+
+void UnitIndex::MergeGaps(const std::vector<UnitIndex*>& indexes) {
+  std::vector<PieceTree*> trees;
+  for (UnitIndex* index : indexes) trees.push_back(&index->markers_);
+  PieceTree::MergeGaps(trees);
+}
+
+std::int64_t UnitIndex::ToUtf16Offset(std::int64_t position) const {
+  if (kWideCharIsUtf16) return position;
+  return position + markers_.CountLineBreaksBefore(position);
+}
+
+std::int64_t UnitIndex::FromUtf16Offset(std::int64_t offset) const {
+  assert(0 <= offset);
+  if (kWideCharIsUtf16) return std::min(offset, GetCharCount());
+  return markers_.FindWeightedOffset(offset, 2);
+}
+
+std::int64_t UnitIndex::ToCodePointOffset(std::int64_t position) const {
+  if (!kWideCharIsUtf16) return position;
+  return position - markers_.CountLineBreaksBefore(position);
+}
+
+std::int64_t UnitIndex::FromCodePointOffset(std::int64_t offset) const {
+  assert(0 <= offset);
+  if (!kWideCharIsUtf16) return std::min(offset, GetCharCount());
+  return markers_.FindWeightedOffset(offset, 0);
+}
+
+}  // namespace wiese
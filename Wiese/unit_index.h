@@ -0,0 +1,85 @@
+#ifndef WIESE_UNIT_INDEX_H_
+#define WIESE_UNIT_INDEX_H_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "piece_tree.h"
+
+namespace wiese {
+
+// Converts between the three ways of counting the characters of a text in
+// O(log n): positions, which count wchar_t units like everything else in a
+// document; offsets in UTF-16 code units, which TSF uses for ACP offsets; and
+// offsets in code points.
+//
+// They only differ at the characters which take two UTF-16 units. Where
+// wchar_t is 16 bits those are the surrogate pairs, each two positions and
+// one code point; elsewhere they are the characters outside the BMP, each one
+// position and one code point. The index keeps where they are as the line
+// breaks of a piece tree (as MatchIndex does with matches): every one of them
+// is a line break piece, and the characters in between are plain pieces.
+// The tree counts them in front of any position, and FindWeightedOffset
+// converts back.
+//
+// A position inside a surrogate pair converts to the offset of the pair; an
+// offset inside a pair (UTF-16 offsets where wchar_t is 32 bits) converts to
+// the position after it.
+class UnitIndex {
+ public:
+  // Collects the characters taking two UTF-16 units from text given a chunk
+  // at a time. A surrogate pair may be split between chunks.
+  class Builder {
+   public:
+    Builder();
+
+    void Add(std::wstring_view chars);
+    // Returns the pieces for the characters added. |next| is the character
+    // following them, if any, which tells whether a high surrogate at the end
+    // starts a pair.
+    std::vector<Piece> Finish(wchar_t next = 0);
+
+   private:
+    void AddGap(std::int64_t count);
+    void AddMarker();
+
+    std::vector<Piece> pieces_;
+    // True if the last character added is a high surrogate which has not
+    // been added to |pieces_| yet.
+    bool pending_high_surrogate_;
+  };
+
+  // An index of the empty text.
+  UnitIndex() = default;
+  explicit UnitIndex(const std::vector<Piece>& pieces) : markers_(pieces) {}
+
+  std::int64_t GetCharCount() const { return markers_.GetCharCount(); }
+  std::int64_t GetUtf16Count() const { return ToUtf16Offset(GetCharCount()); }
+  std::int64_t GetCodePointCount() const {
+    return ToCodePointOffset(GetCharCount());
+  }
+
+  std::int64_t ToUtf16Offset(std::int64_t position) const;
+  std::int64_t FromUtf16Offset(std::int64_t offset) const;
+  std::int64_t ToCodePointOffset(std::int64_t position) const;
+  std::int64_t FromCodePointOffset(std::int64_t offset) const;
+
+  // Replaces the pieces for the ranges of the text, like PieceTree::Replace,
+  // with pieces made by a Builder. The gaps around the ranges are merged, so
+  // the index does not grow with the number of edits.
+  void Replace(const std::vector<PieceTree::Replacement>& replacements) {
+    markers_.ReplaceGaps(replacements);
+  }
+
+  // Merges the gaps of |indexes|, which may share pieces, as
+  // PieceTree::MergeGaps does.
+  static void MergeGaps(const std::vector<UnitIndex*>& indexes);
+
+ private:
+  PieceTree markers_;
+};
+
+}  // namespace wiese
+
+#endif
@@ -0,0 +1,144 @@
+#include "unit_index.h"
+
+#include "gtest/gtest.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool IsHighSurrogate(wchar_t ch) { return 0xD800 <= ch && ch < 0xDC00; }
+bool IsLowSurrogate(wchar_t ch) { return 0xDC00 <= ch && ch < 0xE000; }
+
+// Returns true if the character at |i| is the low surrogate of a surrogate
+// pair, which is not a code point of its own. Where wchar_t is 32 bits
+// surrogates are never paired.
+bool IsLowSurrogateOfPair(const std::wstring& text, int i) {
+  return sizeof(wchar_t) == 2 && i > 0 && IsHighSurrogate(text[i - 1]) &&
+         IsLowSurrogate(text[i]);
+}
+
+// Returns the number of UTF-16 units and code points of the first |position|
+// characters of |text|, counted one by one.
+int CountUtf16Units(const std::wstring& text, int position) {
+  int count = 0;
+  for (int i = 0; i < position; ++i) {
+    count += sizeof(wchar_t) == 4 && text[i] > 0xFFFF ? 2 : 1;
+  }
+  return count;
+}
+
+int CountCodePoints(const std::wstring& text, int position) {
+  int count = 0;
+  for (int i = 0; i < position; ++i) {
+    if (!IsLowSurrogateOfPair(text, i)) ++count;
+  }
+  return count;
+}
+
+// Returns a random text with surrogate pairs, unpaired surrogates and, where
+// wchar_t is 32 bits, characters outside the BMP.
+std::wstring MakeRandomText(std::mt19937& random, int size) {
+  std::wstring text;
+  while (static_cast<int>(text.size()) < size) {
+    switch (random() % 6) {
+      case 0:
+        text += static_cast<wchar_t>(0xD800 + random() % 0x400);
+        break;
+      case 1:
+        text += static_cast<wchar_t>(0xDC00 + random() % 0x400);
+        break;
+      case 2:
+        if (sizeof(wchar_t) == 4) {
+          text += static_cast<wchar_t>(0x10000 + random() % 0x100000);
+        } else {
+          text += static_cast<wchar_t>(0xD800 + random() % 0x400);
+          text += static_cast<wchar_t>(0xDC00 + random() % 0x400);
+        }
+        break;
+      default:
+        text += static_cast<wchar_t>(L'a' + random() % 26);
+        break;
+    }
+  }
+  return text;
+}
+
+wiese::UnitIndex MakeIndex(const std::wstring& text,
+                           const std::vector<std::size_t>& chunk_sizes) {
+  wiese::UnitIndex::Builder builder;
+  std::size_t position = 0;
+  for (std::size_t i = 0; position < text.size(); ++i) {
+    const std::size_t size = chunk_sizes[i % chunk_sizes.size()];
+    builder.Add(std::wstring_view(text).substr(position, size));
+    position += size;
+  }
+  return wiese::UnitIndex(builder.Finish());
+}
+
+void ExpectIndexOf(const std::wstring& text, const wiese::UnitIndex& index) {
+  const int size = static_cast<int>(text.size());
+  ASSERT_EQ(size, index.GetCharCount());
+  EXPECT_EQ(CountUtf16Units(text, size), index.GetUtf16Count());
+  EXPECT_EQ(CountCodePoints(text, size), index.GetCodePointCount());
+  for (int position = 0; position <= size; ++position) {
+    // Positions inside a surrogate pair convert to the pair and back.
+    const bool inside_pair =
+        position < size && IsLowSurrogateOfPair(text, position);
+    const int utf16_offset = CountUtf16Units(text, position);
+    const int code_point_offset =
+        CountCodePoints(text, inside_pair ? position - 1 : position);
+    ASSERT_EQ(utf16_offset, index.ToUtf16Offset(position)) << position;
+    ASSERT_EQ(code_point_offset, index.ToCodePointOffset(position))
+        << position;
+    ASSERT_EQ(position, index.FromUtf16Offset(utf16_offset)) << position;
+    ASSERT_EQ(inside_pair ? position - 1 : position,
+              index.FromCodePointOffset(code_point_offset))
+        << position;
+  }
+}
+
+}  // namespace
+
+TEST(UnitIndex, Empty) {
+  wiese::UnitIndex index;
+  EXPECT_EQ(0, index.GetUtf16Count());
+  EXPECT_EQ(0, index.GetCodePointCount());
+  EXPECT_EQ(0, index.FromUtf16Offset(0));
+  EXPECT_EQ(0, index.FromCodePointOffset(5));
+}
+
+TEST(UnitIndex, CountsSurrogatePairsOnce) {
+  std::wstring text = L"a";
+  if (sizeof(wchar_t) == 2) {
+    text += {static_cast<wchar_t>(0xD83D), static_cast<wchar_t>(0xDE00)};
+  } else {
+    text += static_cast<wchar_t>(0x1F600);
+  }
+  text += L"b";
+  const wiese::UnitIndex index = MakeIndex(text, {1});
+  EXPECT_EQ(4, index.GetUtf16Count());
+  EXPECT_EQ(3, index.GetCodePointCount());
+  EXPECT_EQ(static_cast<int>(text.size()) - 1,
+            index.FromCodePointOffset(2));
+  EXPECT_EQ(static_cast<int>(text.size()) - 1, index.FromUtf16Offset(3));
+}
+
+TEST(UnitIndex, ChunksDoNotChangeTheIndex) {
+  std::mt19937 random(1);
+  const std::wstring text = MakeRandomText(random, 500);
+  for (const auto& chunk_sizes : std::vector<std::vector<std::size_t>>{
+           {1}, {2, 3}, {17}, {1000}}) {
+    ExpectIndexOf(text, MakeIndex(text, chunk_sizes));
+  }
+}
+
+TEST(UnitIndex, PairSplitAtTheEnd) {
+  const std::wstring high(1, static_cast<wchar_t>(0xD800));
+  wiese::UnitIndex::Builder builder;
+  builder.Add(high);
+  // The character after the text completes the pair.
+  const wiese::UnitIndex index(builder.Finish(static_cast<wchar_t>(0xDC00)));
+  EXPECT_EQ(sizeof(wchar_t) == 2 ? 0 : 1, index.GetCodePointCount());
+}